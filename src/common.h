@@ -122,6 +122,7 @@ typedef struct _WI_ITEM_REC WI_ITEM_REC;
 typedef struct _CHANNEL_REC CHANNEL_REC;
 typedef struct _QUERY_REC QUERY_REC;
 typedef struct _NICK_REC NICK_REC;
+typedef struct _NICK_USER_REC NICK_USER_REC;
 
 typedef struct _SERVER_CONNECT_REC SERVER_CONNECT_REC;
 typedef struct _SERVER_SETUP_REC SERVER_SETUP_REC;
@@ -33,6 +33,7 @@
 
 GSList *commands;
 char *current_command;
+int command_user_input;
 
 static int signal_default_command;
 
@@ -976,6 +977,7 @@ void commands_init(void)
 {
 	commands = NULL;
 	current_command = NULL;
+	command_user_input = FALSE;
 	alias_runstack = NULL;
 
 	signal_default_command = signal_get_uniq_id("default command");
@@ -64,6 +64,7 @@ enum {
 
 extern GSList *commands;
 extern char *current_command; /* the command we're right now. */
+extern int command_user_input; /* TRUE while running a line the user typed */
 
 /* Bind command to specified function. */
 void command_bind_full(const char *module, int priority, const char *cmd,
@@ -30,14 +30,38 @@
 #include "channels.h"
 #include "nicklist.h"
 #include "nickmatch-cache.h"
+#include "multimatch.h"
 
 #include "ignore.h"
 
+typedef struct _HOST_NODE HOST_NODE;
+
+/* nick!user@host masks are kept in a trie by the text after their last
+   wildcard, which is walked backwards from the end of nick!user@host.
+   match_wildcards() can't match unless the text is at the end. */
+struct _HOST_NODE {
+	HOST_NODE *child, *sibling;
+	GSList *ignores;
+	char chr; /* uppercased */
+};
+
 GSList *ignores;
 
 static NICKMATCH_REC *nickmatch;
 static int time_tag;
 
+/* The ignores compiled into an index, rebuilt after each change */
+static int ignore_levels; /* all levels that are ignored somewhere */
+static GHashTable *nick_index; /* "NICK" => ignores with that mask */
+static HOST_NODE *host_suffixes; /* eg. "*!*@*.host" ignores */
+static GSList *unindexed_ignores; /* no mask or a more complex mask */
+static GSList *reply_ignores; /* ignores with -replies */
+static MULTIMATCH_REC *ignore_patterns; /* non-regexp patterns */
+static unsigned int ignore_check_count;
+static int patterns_scanned;
+
+static GPtrArray *candidates;
+
 /* check if `text' contains ignored nick at the start of the line. */
 static int ignore_check_replies_rec(IGNORE_REC *rec, CHANNEL_REC *channel,
 				    const char *text)
@@ -70,7 +94,7 @@ static int ignore_check_replies(CHANNEL_REC *chanrec, const char *text)
 		return FALSE;
 
         /* check reply ignores */
-	for (tmp = ignores; tmp != NULL; tmp = tmp->next) {
+	for (tmp = reply_ignores; tmp != NULL; tmp = tmp->next) {
 		IGNORE_REC *rec = tmp->data;
 
 		if (rec->mask != NULL && rec->replies &&
@@ -82,6 +106,21 @@ static int ignore_check_replies(CHANNEL_REC *chanrec, const char *text)
 	return FALSE;
 }
 
+static int ignore_pattern_found(IGNORE_REC *rec, const char *text,
+				int pos, int len, void *user_data)
+{
+	if (rec->fullword) {
+		/* same as stristr_full() */
+		if (pos > 0 && !isbound(text[pos-1]))
+			return FALSE;
+		if (text[pos+len] != '\0' && !isbound(text[pos+len]))
+			return FALSE;
+	}
+
+	rec->pattern_found = ignore_check_count;
+	return FALSE;
+}
+
 static int ignore_match_pattern(IGNORE_REC *rec, const char *text)
 {
 	if (rec->pattern == NULL)
@@ -99,9 +138,16 @@ static int ignore_match_pattern(IGNORE_REC *rec, const char *text)
 #endif
 	}
 
-	return rec->fullword ?
-		stristr_full(text, rec->pattern) != NULL :
-		stristr(text, rec->pattern) != NULL;
+	if (*rec->pattern == '\0')
+		return TRUE;
+
+	/* find all the patterns from text at once */
+	if (!patterns_scanned) {
+		multimatch_scan(ignore_patterns, text,
+				(MULTIMATCH_FUNC) ignore_pattern_found, NULL);
+		patterns_scanned = TRUE;
+	}
+	return rec->pattern_found == ignore_check_count;
 }
 
 #define ignore_match_level(rec, level) \
@@ -117,6 +163,212 @@ static int ignore_match_pattern(IGNORE_REC *rec, const char *text)
 	((rec)->servertag == NULL || \
 	g_strcasecmp((server)->tag, (rec)->servertag) == 0)
 
+static void host_suffixes_destroy(HOST_NODE *node)
+{
+	HOST_NODE *next;
+
+	for (; node != NULL; node = next) {
+		next = node->sibling;
+
+		host_suffixes_destroy(node->child);
+		g_slist_free(node->ignores);
+		g_free(node);
+	}
+}
+
+static HOST_NODE *host_node_child(HOST_NODE *node, char chr, int create)
+{
+	HOST_NODE *child;
+
+	for (child = node->child; child != NULL; child = child->sibling) {
+		if (child->chr == chr)
+			return child;
+	}
+
+	if (!create)
+		return NULL;
+
+	child = g_new0(HOST_NODE, 1);
+	child->chr = chr;
+	child->sibling = node->child;
+	node->child = child;
+	return child;
+}
+
+static void host_suffixes_add(IGNORE_REC *rec, const char *suffix)
+{
+	HOST_NODE *node;
+	const char *p;
+
+	node = host_suffixes;
+	for (p = suffix+strlen(suffix); p > suffix; p--)
+		node = host_node_child(node, i_toupper(p[-1]), TRUE);
+	node->ignores = g_slist_append(node->ignores, rec);
+}
+
+static char *ignore_index_key(const char *str)
+{
+	char *key, *p;
+
+	key = g_strdup(str);
+	for (p = key; *p != '\0'; p++)
+		*p = i_toupper(*p);
+	return key;
+}
+
+static void index_add(GHashTable *index, const char *str, IGNORE_REC *rec)
+{
+	GSList *list;
+	char *key;
+
+	key = ignore_index_key(str);
+	list = g_hash_table_lookup(index, key);
+	if (list == NULL)
+		g_hash_table_insert(index, key, g_slist_append(NULL, rec));
+	else {
+		/* the list head doesn't change */
+		g_slist_append(list, rec);
+		g_free(key);
+	}
+}
+
+static void index_add_list(GPtrArray *array, GHashTable *index,
+			   const char *str, int len)
+{
+	GSList *tmp;
+	char buf[256], *key;
+	int i;
+
+	key = len < (int) sizeof(buf) ? buf : g_malloc(len+1);
+	for (i = 0; i < len; i++)
+		key[i] = i_toupper(str[i]);
+	key[len] = '\0';
+
+	tmp = g_hash_table_lookup(index, key);
+	for (; tmp != NULL; tmp = tmp->next)
+		g_ptr_array_add(array, tmp->data);
+
+	if (key != buf)
+		g_free(key);
+}
+
+static void index_destroy_entry(char *key, GSList *list)
+{
+	g_free(key);
+	g_slist_free(list);
+}
+
+static void index_destroy(GHashTable *index)
+{
+	g_hash_table_foreach(index, (GHFunc) index_destroy_entry, NULL);
+	g_hash_table_destroy(index);
+}
+
+static void ignore_index_add(IGNORE_REC *rec)
+{
+	const char *p;
+
+	if (rec->mask == NULL) {
+		unindexed_ignores = g_slist_append(unindexed_ignores, rec);
+		return;
+	}
+
+	if (strchr(rec->mask, '!') == NULL) {
+		/* matched against nick only */
+		if (strpbrk(rec->mask, "*?") == NULL)
+			index_add(nick_index, rec->mask, rec);
+		else {
+			unindexed_ignores =
+				g_slist_append(unindexed_ignores, rec);
+		}
+		return;
+	}
+
+	/* the text after the last wildcard */
+	for (p = rec->mask+strlen(rec->mask); p > rec->mask; p--) {
+		if (p[-1] == '*' || p[-1] == '?')
+			break;
+	}
+	if (*p != '\0') {
+		host_suffixes_add(rec, p);
+		return;
+	}
+
+	unindexed_ignores = g_slist_append(unindexed_ignores, rec);
+}
+
+/* Rebuild the ignore index and the nickmatch cache after ignores have
+   been changed */
+static void ignore_rebuild(void)
+{
+	GSList *tmp;
+	int index;
+
+	if (nick_index != NULL) index_destroy(nick_index);
+	host_suffixes_destroy(host_suffixes);
+	g_slist_free(unindexed_ignores);
+	g_slist_free(reply_ignores);
+	multimatch_clear(ignore_patterns);
+
+	nick_index = g_hash_table_new((GHashFunc) g_str_hash,
+				      (GCompareFunc) g_str_equal);
+	host_suffixes = g_new0(HOST_NODE, 1);
+	unindexed_ignores = reply_ignores = NULL;
+	ignore_levels = 0;
+
+	index = 0;
+	for (tmp = ignores; tmp != NULL; tmp = tmp->next) {
+		IGNORE_REC *rec = tmp->data;
+
+		rec->index = index++;
+		rec->pattern_found = 0;
+		ignore_levels |= rec->level;
+
+		ignore_index_add(rec);
+		if (rec->mask != NULL && rec->replies)
+			reply_ignores = g_slist_append(reply_ignores, rec);
+		if (rec->pattern != NULL && !rec->regexp)
+			multimatch_add(ignore_patterns, rec->pattern, rec);
+	}
+
+	nickmatch_rebuild(nickmatch);
+}
+
+static int ignore_index_cmp(IGNORE_REC **rec1, IGNORE_REC **rec2)
+{
+	return (*rec1)->index - (*rec2)->index;
+}
+
+/* Get all ignores whose mask could match `nickmask', in the same order
+   as they are in `ignores'. Their masks still need to be checked. */
+static void ignore_get_candidates(GPtrArray *array, const char *nick,
+				  const char *nickmask)
+{
+	HOST_NODE *node;
+	GSList *tmp;
+	const char *p;
+
+	for (tmp = unindexed_ignores; tmp != NULL; tmp = tmp->next)
+		g_ptr_array_add(array, tmp->data);
+
+	index_add_list(array, nick_index, nick, strlen(nick));
+
+	node = host_suffixes;
+	for (p = nickmask+strlen(nickmask); p > nickmask; p--) {
+		node = host_node_child(node, i_toupper(p[-1]), FALSE);
+		if (node == NULL)
+			break;
+
+		for (tmp = node->ignores; tmp != NULL; tmp = tmp->next)
+			g_ptr_array_add(array, tmp->data);
+	}
+
+	if (array->len > 1) {
+		qsort(array->pdata, array->len, sizeof(void *),
+		      (int (*) (const void *, const void *)) ignore_index_cmp);
+	}
+}
+
 int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 		 const char *channel, const char *text, int level)
 {
@@ -124,38 +376,56 @@ int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 	NICK_REC *nickrec;
         IGNORE_REC *rec;
 	GSList *tmp;
-        char *nickmask;
-        int len, best_mask, best_match, best_patt;
+        char *nickmask, nickmask_buf[256];
+        int i, len, best_mask, best_match, best_patt;
 
 	g_return_val_if_fail(server != NULL, 0);
         if (nick == NULL) nick = "";
 
 	chanrec = server == NULL || channel == NULL ? NULL :
 		channel_find(server, channel);
+	g_ptr_array_set_size(candidates, 0);
 	if (chanrec != NULL && nick != NULL &&
 	    (nickrec = nicklist_find(chanrec, nick)) != NULL) {
                 /* nick found - check only ignores in nickmatch cache */
-		if (nickrec->host == NULL)
+		if (nickrec->user->host == NULL)
 			nicklist_set_host(chanrec, nickrec, host);
 
-		tmp = nickmatch_find(nickmatch, nickrec);
+		if ((level & ignore_levels) != 0) {
+			tmp = nickmatch_find(nickmatch, nickrec);
+			for (; tmp != NULL; tmp = tmp->next)
+				g_ptr_array_add(candidates, tmp->data);
+		}
 		nickmask = NULL;
+	} else if ((level & ignore_levels) != 0) {
+		if (host == NULL) host = "";
+		len = strlen(nick) + strlen(host) + 2;
+		nickmask = len <= (int) sizeof(nickmask_buf) ? nickmask_buf :
+			g_malloc(len);
+		g_snprintf(nickmask, len, "%s!%s", nick, host);
+
+		ignore_get_candidates(candidates, nick, nickmask);
 	} else {
-		tmp = ignores;
-		nickmask = g_strconcat(nick, "!", host, NULL);
+		/* no ignores with this level, only replies need checking */
+		nickmask = NULL;
 	}
 
+	ignore_check_count++;
+	patterns_scanned = FALSE;
+
         best_mask = best_patt = -1; best_match = FALSE;
-	for (; tmp != NULL; tmp = tmp->next) {
+	for (i = 0; i < (int) candidates->len; i++) {
 		int match = 1;
-		rec = tmp->data;
+		rec = g_ptr_array_index(candidates, i);
+
+		if (!ignore_match_level(rec, level))
+			continue;
 
 		if (nickmask != NULL)
 			match = ignore_match_server(rec, server) &&
 				ignore_match_channel(rec, channel) &&
 				ignore_match_nickmask(rec, nick, nickmask);
 		if (match &&
-		    ignore_match_level(rec, level) &&
 		    ignore_match_pattern(rec, text)) {
 			len = rec->mask == NULL ? 0 : strlen(rec->mask);
 			if (len > best_mask) {
@@ -171,7 +441,8 @@ int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 			}
 		}
 	}
-        g_free(nickmask);
+	if (nickmask != nickmask_buf)
+		g_free(nickmask);
 
 	if (best_match || (level & MSGLEVEL_PUBLIC) == 0)
 		return best_match;
@@ -308,7 +579,7 @@ void ignore_add_rec(IGNORE_REC *rec)
 	ignore_set_config(rec);
 
 	signal_emit("ignore created", 1, rec);
-	nickmatch_rebuild(nickmatch);
+	ignore_rebuild();
 }
 
 static void ignore_destroy(IGNORE_REC *rec, int send_signal)
@@ -326,7 +597,7 @@ static void ignore_destroy(IGNORE_REC *rec, int send_signal)
 	g_free_not_null(rec->pattern);
 	g_free(rec);
 
-	nickmatch_rebuild(nickmatch);
+	ignore_rebuild();
 }
 
 void ignore_update_rec(IGNORE_REC *rec)
@@ -345,7 +616,7 @@ void ignore_update_rec(IGNORE_REC *rec)
 
                 ignore_init_rec(rec);
 		signal_emit("ignore changed", 1, rec);
-		nickmatch_rebuild(nickmatch);
+		ignore_rebuild();
 	}
 }
 
@@ -379,7 +650,7 @@ static void read_ignores(void)
 
 	node = iconfig_node_traverse("ignores", FALSE);
 	if (node == NULL) {
-		nickmatch_rebuild(nickmatch);
+		ignore_rebuild();
 		return;
 	}
 
@@ -409,30 +680,38 @@ static void read_ignores(void)
 		ignore_init_rec(rec);
 	}
 
-	nickmatch_rebuild(nickmatch);
+	ignore_rebuild();
 }
 
 static void ignore_nick_cache(GHashTable *list, CHANNEL_REC *channel,
 			      NICK_REC *nick)
 {
-	GSList *tmp, *matches;
+	GPtrArray *array;
+	GSList *matches;
         char *nickmask;
+	int i;
 
-	if (nick->host == NULL)
+	if (nick->user->host == NULL)
 		return; /* don't check until host is known */
 
         matches = NULL;
-	nickmask = g_strconcat(nick->nick, "!", nick->host, NULL);
-	for (tmp = ignores; tmp != NULL; tmp = tmp->next) {
-		IGNORE_REC *rec = tmp->data;
+	nickmask = g_strconcat(nick->nick, "!", nick->user->host, NULL);
+
+	array = g_ptr_array_new();
+	ignore_get_candidates(array, nick->nick, nickmask);
+	for (i = 0; i < (int) array->len; i++) {
+		IGNORE_REC *rec = g_ptr_array_index(array, i);
 
 		if (ignore_match_nickmask(rec, nick->nick, nickmask) &&
 		    ignore_match_server(rec, channel->server) &&
 		    ignore_match_channel(rec, channel->name))
-			matches = g_slist_append(matches, rec);
+			matches = g_slist_prepend(matches, rec);
 	}
+	g_ptr_array_free(array, TRUE);
 	g_free_not_null(nickmask);
 
+	matches = g_slist_reverse(matches);
+
 	if (matches == NULL)
 		g_hash_table_remove(list, nick);
         else
@@ -442,6 +721,11 @@ static void ignore_nick_cache(GHashTable *list, CHANNEL_REC *channel,
 void ignore_init(void)
 {
 	ignores = NULL;
+	nick_index = NULL;
+	host_suffixes = NULL;
+	unindexed_ignores = reply_ignores = NULL;
+	ignore_patterns = multimatch_create();
+	candidates = g_ptr_array_new();
 	nickmatch = nickmatch_init(ignore_nick_cache);
 	time_tag = g_timeout_add(1000, (GSourceFunc) unignore_timeout, NULL);
 
@@ -456,5 +740,12 @@ void ignore_deinit(void)
                 ignore_destroy(ignores->data, TRUE);
         nickmatch_deinit(nickmatch);
 
+	index_destroy(nick_index);
+	host_suffixes_destroy(host_suffixes);
+	g_slist_free(unindexed_ignores);
+	g_slist_free(reply_ignores);
+	multimatch_destroy(ignore_patterns);
+	g_ptr_array_free(candidates, TRUE);
+
 	signal_remove("setup reread", (SIGNAL_FUNC) read_ignores);
 }
@@ -24,6 +24,10 @@ struct _IGNORE_REC {
 	unsigned int regexp_compiled:1; /* should always be TRUE, unless regexp is invalid */
 	regex_t preg;
 #endif
+
+	/* private to ignore.c */
+	int index; /* position in `ignores' */
+	unsigned int pattern_found; /* pattern was found in ignore check n */
 };
 
 extern GSList *ignores;
@@ -32,37 +32,90 @@
    too high. */
 #define MAX_CHARS_IN_LINE 65536
 
+/* The buffer is used linearly: lines are handed out straight from it by
+   terminating them in place, and `start' just moves forward past them.
+   Unused data is moved to the beginning of the buffer only when there's
+   not enough free space left at the end for the next read. */
 struct _LINEBUF_REC {
-        int len;
+	int start; /* beginning of unprocessed data */
+	int len; /* end of data */
+	int scanned; /* data before this has been checked not to contain LF */
 	int alloc;
-	int remove;
-        char *str;
+	int remove; /* size of the line returned last time */
+	char *str;
 };
 
-static void linebuf_append(LINEBUF_REC *rec, const char *data, int len)
+/* Make sure there's at least `size' bytes of free space after the data */
+static void linebuf_reserve(LINEBUF_REC *rec, int size)
 {
-	if (rec->len+len > rec->alloc) {
-		rec->alloc = nearest_power(rec->len+len);;
+	int used;
+
+	if (rec->len+size <= rec->alloc)
+		return;
+
+	used = rec->len - rec->start;
+	if (rec->start > 0) {
+		/* the tail reached the end, move the unprocessed
+		   data to beginning */
+		g_memmove(rec->str, rec->str+rec->start, used);
+		rec->scanned -= rec->start;
+		rec->len = used;
+		rec->start = 0;
+	}
+
+	if (used+size > rec->alloc) {
+		rec->alloc = nearest_power(used+size);
 		rec->str = g_realloc(rec->str, rec->alloc);
 	}
+}
+
+static void linebuf_append(LINEBUF_REC *rec, const char *data, int len)
+{
+	if (rec->str != NULL && data == rec->str+rec->len &&
+	    rec->len+len <= rec->alloc) {
+		/* data was read directly into buffer by the caller */
+		rec->len += len;
+		return;
+	}
 
+	linebuf_reserve(rec, len);
 	memcpy(rec->str + rec->len, data, len);
 	rec->len += len;
 }
 
+static void linebuf_consume(LINEBUF_REC *rec)
+{
+	if (rec->remove == 0)
+		return;
+
+	rec->start += rec->remove;
+	rec->remove = 0;
+
+	if (rec->start == rec->len) {
+		/* everything processed, start from the beginning again */
+		rec->start = rec->len = rec->scanned = 0;
+	} else if (rec->scanned < rec->start) {
+		rec->scanned = rec->start;
+	}
+}
+
 static char *linebuf_find(LINEBUF_REC *rec, char chr)
 {
-	return memchr(rec->str, chr, rec->len);
+	char *ptr;
+
+	ptr = memchr(rec->str + rec->scanned, chr, rec->len - rec->scanned);
+	rec->scanned = ptr == NULL ? rec->len : (int) (ptr-rec->str);
+	return ptr;
 }
 
 static int remove_newline(LINEBUF_REC *rec)
 {
-	char *ptr;
+	char *line, *ptr;
 
 	ptr = linebuf_find(rec, '\n');
 	if (ptr == NULL) {
 		/* LF wasn't found, wait for more data.. */
-		if (rec->len < MAX_CHARS_IN_LINE)
+		if (rec->len - rec->start < MAX_CHARS_IN_LINE)
 			return 0;
 
 		/* line buffer is too big - force a newline. */
@@ -70,8 +123,9 @@ static int remove_newline(LINEBUF_REC *rec)
 		ptr = rec->str+rec->len-1;
 	}
 
-	rec->remove = (int) (ptr-rec->str)+1;
-	if (ptr != rec->str && ptr[-1] == '\r') {
+	line = rec->str+rec->start;
+	rec->remove = (int) (ptr-line)+1;
+	if (ptr != line && ptr[-1] == '\r') {
 		/* remove CR too. */
 		ptr--;
 	}
@@ -80,6 +134,13 @@ static int remove_newline(LINEBUF_REC *rec)
 	return 1;
 }
 
+static LINEBUF_REC *linebuf_get(LINEBUF_REC **buffer)
+{
+	if (*buffer == NULL)
+		*buffer = g_new0(LINEBUF_REC, 1);
+	return *buffer;
+}
+
 /* line-split `data'. Initially `*buffer' should contain NULL. */
 int line_split(const char *data, int len, char **output, LINEBUF_REC **buffer)
 {
@@ -90,21 +151,14 @@ int line_split(const char *data, int len, char **output, LINEBUF_REC **buffer)
 	g_return_val_if_fail(output != NULL, -1);
 	g_return_val_if_fail(buffer != NULL, -1);
 
-	if (*buffer == NULL)
-		*buffer = g_new0(LINEBUF_REC, 1);
-	rec = *buffer;
-
-	if (rec->remove > 0) {
-		rec->len -= rec->remove;
-		g_memmove(rec->str, rec->str+rec->remove, rec->len);
-		rec->remove = 0;
-	}
+	rec = linebuf_get(buffer);
+	linebuf_consume(rec);
 
 	if (len > 0)
 		linebuf_append(rec, data, len);
 	else if (len < 0) {
 		/* connection closed.. */
-		if (rec->len == 0)
+		if (rec->len == rec->start)
 			return -1;
 
 		/* no new data got but still something in buffer.. */
@@ -117,10 +171,26 @@ int line_split(const char *data, int len, char **output, LINEBUF_REC **buffer)
 	}
 
 	ret = remove_newline(rec);
-	*output = rec->str;
+	*output = rec->str+rec->start;
 	return ret;
 }
 
+/* Returns pointer to at least `size' bytes of free space in the end of
+   the buffer. If the data is read directly there, it can be given to
+   line_split() without it being copied. */
+char *line_split_get_space(LINEBUF_REC **buffer, int size)
+{
+	LINEBUF_REC *rec;
+
+	g_return_val_if_fail(buffer != NULL, NULL);
+	g_return_val_if_fail(size > 0, NULL);
+
+	rec = linebuf_get(buffer);
+	linebuf_consume(rec);
+	linebuf_reserve(rec, size);
+	return rec->str+rec->len;
+}
+
 void line_split_free(LINEBUF_REC *buffer)
 {
 	if (buffer != NULL) {
@@ -132,5 +202,5 @@ void line_split_free(LINEBUF_REC *buffer)
 /* Return 1 if there is no data in the buffer */
 int line_split_is_empty(LINEBUF_REC *buffer)
 {
-	return buffer->len == 0;
+	return buffer->len == buffer->start;
 }
@@ -3,6 +3,10 @@
 
 /* line-split `data'. Initially `*buffer' should contain NULL. */
 int line_split(const char *data, int len, char **output, LINEBUF_REC **buffer);
+/* Returns pointer to at least `size' bytes of free space in the end of
+   the buffer. If the data is read directly there, it can be given to
+   line_split() without it being copied. */
+char *line_split_get_space(LINEBUF_REC **buffer, int size);
 void line_split_free(LINEBUF_REC *buffer);
 
 /* Return 1 if there is no data in the buffer */
@@ -24,6 +24,7 @@
 #include "levels.h"
 #include "misc.h"
 #include "servers.h"
+#include "window-item-def.h"
 #include "log.h"
 #include "write-buffer.h"
 
@@ -42,10 +43,34 @@ static const char *log_item_types[] = {
 };
 
 const char *log_timestamp;
+/* log_timestamp formatted for one second, lines written in the same
+   second don't need to format it again */
+static char log_timestamp_str[256];
+static int log_timestamp_len;
+static time_t log_timestamp_time;
 static int log_file_create_mode;
 static int log_dir_create_mode;
 static int rotate_tag;
 
+/* "type servertag item" => LOG_ITEM_LOGS_REC, cleared whenever logs or
+   their items are changed, and per item when the item or its server
+   goes away */
+static GHashTable *log_item_logs;
+static GSList *log_fallbacks; /* logs without items */
+static int log_fallbacks_valid;
+static unsigned int log_items_generation;
+static unsigned int log_write_id;
+static GString *log_item_key;
+
+/* autologs are closed while unused when there's more than this */
+static int autolog_max_open_files;
+static int autologs_open;
+
+typedef struct {
+	char *servertag;
+	GSList *logs;
+} LOG_ITEM_LOGS_REC;
+
 static int log_item_str2type(const char *type)
 {
 	int n;
@@ -73,6 +98,24 @@ static void log_write_timestamp(int handle, const char *format,
 	if (text != NULL) write_buffer(handle, text, strlen(text));
 }
 
+/* Empty log_timestamp only leaves out the timestamp, the line is
+   still written after it */
+static void log_write_line_timestamp(int handle, time_t stamp)
+{
+	if (*log_timestamp == '\0')
+		return;
+
+	if (stamp != log_timestamp_time) {
+		log_timestamp_len = strftime(log_timestamp_str,
+					     sizeof(log_timestamp_str),
+					     log_timestamp, localtime(&stamp));
+		log_timestamp_time = stamp;
+	}
+
+	if (log_timestamp_len > 0)
+		write_buffer(handle, log_timestamp_str, log_timestamp_len);
+}
+
 static char *log_filename(LOG_REC *log)
 {
 	char *str, fname[1024];
@@ -95,27 +138,25 @@ static char *log_filename(LOG_REC *log)
 	return g_strdup(fname);
 }
 
-int log_start_logging(LOG_REC *log)
+/* Open the log file, and if it's given a new name also
+   create the directories */
+static int log_open_file(LOG_REC *log, int new_name)
 {
 	char *dir;
 	struct flock lock;
 
-	g_return_val_if_fail(log != NULL, FALSE);
-
-	if (log->handle != -1)
-		return TRUE;
-
-	/* Append/create log file */
-	g_free_not_null(log->real_fname);
-	log->real_fname = log_filename(log);
-
-	if (log->real_fname != NULL &&
-	    strcmp(log->real_fname, log->fname) != 0) {
-		/* path may contain variables (%time, $vars),
-		   make sure the directory is created */
-		dir = g_path_get_dirname(log->real_fname);
-		mkpath(dir, log_dir_create_mode);
-		g_free(dir);
+	if (new_name) {
+		g_free_not_null(log->real_fname);
+		log->real_fname = log_filename(log);
+
+		if (log->real_fname != NULL &&
+		    strcmp(log->real_fname, log->fname) != 0) {
+			/* path may contain variables (%time, $vars),
+			   make sure the directory is created */
+			dir = g_path_get_dirname(log->real_fname);
+			mkpath(dir, log_dir_create_mode);
+			g_free(dir);
+		}
 	}
 
 	log->handle = log->real_fname == NULL ? -1 :
@@ -137,6 +178,96 @@ int log_start_logging(LOG_REC *log)
 	}
 	lseek(log->handle, 0, SEEK_END);
 
+	if (log->temp)
+		autologs_open++;
+	return TRUE;
+}
+
+static void log_close_file(LOG_REC *log)
+{
+	struct flock lock;
+
+        memset(&lock, 0, sizeof(lock));
+	lock.l_type = F_UNLCK;
+	fcntl(log->handle, F_SETLK, &lock);
+
+	write_buffer_flush_handle(log->handle);
+	close(log->handle);
+	log->handle = -1;
+
+	if (log->temp)
+		autologs_open--;
+}
+
+/* Too many autologs open - close the file of the one that has been
+   unused for the longest time. It's reopened when needed. */
+static void autologs_check_open_files(void)
+{
+	LOG_REC *oldest;
+	GSList *tmp;
+
+	if (autolog_max_open_files <= 0 ||
+	    autologs_open < autolog_max_open_files)
+		return;
+
+	oldest = NULL;
+	for (tmp = logs; tmp != NULL; tmp = tmp->next) {
+		LOG_REC *rec = tmp->data;
+
+		if (rec->temp && rec->handle != -1 &&
+		    (oldest == NULL || rec->last < oldest->last))
+			oldest = rec;
+	}
+
+	if (oldest != NULL) {
+		log_close_file(oldest);
+		oldest->suspended = TRUE;
+	}
+}
+
+static int log_resume(LOG_REC *log)
+{
+	char *new_fname;
+	int rotated;
+
+	log->suspended = FALSE;
+	autologs_check_open_files();
+
+	/* suspended logs aren't rotated, check if the file name
+	   changed while it was closed */
+	new_fname = log_filename(log);
+	rotated = new_fname != NULL && log->real_fname != NULL &&
+		strcmp(new_fname, log->real_fname) != 0;
+	g_free_not_null(new_fname);
+
+	if (!log_open_file(log, rotated))
+		return FALSE;
+
+	if (rotated) {
+		signal_emit("log rotated", 1, log);
+		log_write_timestamp(log->handle,
+				    settings_get_str("log_open_string"),
+				    "\n", time(NULL));
+	}
+	return TRUE;
+}
+
+int log_start_logging(LOG_REC *log)
+{
+	g_return_val_if_fail(log != NULL, FALSE);
+
+	if (log->handle != -1)
+		return TRUE;
+
+	if (log->suspended)
+		return log_resume(log);
+
+	/* Append/create log file */
+	if (log->temp)
+		autologs_check_open_files();
+	if (!log_open_file(log, TRUE))
+		return FALSE;
+
 	log->opened = log->last = time(NULL);
 	log_write_timestamp(log->handle,
 			    settings_get_str("log_open_string"),
@@ -149,10 +280,15 @@ int log_start_logging(LOG_REC *log)
 
 void log_stop_logging(LOG_REC *log)
 {
-	struct flock lock;
-
 	g_return_if_fail(log != NULL);
 
+	if (log->suspended) {
+		/* reopen it to write the close string */
+		log->suspended = FALSE;
+		if (!log_open_file(log, FALSE))
+			return;
+	}
+
 	if (log->handle == -1)
 		return;
 
@@ -162,13 +298,7 @@ void log_stop_logging(LOG_REC *log)
 			    settings_get_str("log_close_string"),
 			    "\n", time(NULL));
 
-        memset(&lock, 0, sizeof(lock));
-	lock.l_type = F_UNLCK;
-	fcntl(log->handle, F_SETLK, &lock);
-
-	write_buffer_flush();
-	close(log->handle);
-	log->handle = -1;
+	log_close_file(log);
 }
 
 static void log_rotate_check(LOG_REC *log)
@@ -201,39 +331,42 @@ void log_write_rec(LOG_REC *log, const char *str, int level)
 	g_return_if_fail(log != NULL);
 	g_return_if_fail(str != NULL);
 
-	if (log->handle == -1)
+	if (log->handle == -1 && (!log->suspended || !log_resume(log)))
 		return;
 
 	now = time(NULL);
-	tm = localtime(&now);
-	hour = tm->tm_hour;
-	day = tm->tm_mday;
-
-	tm = localtime(&log->last);
-	day -= tm->tm_mday; /* tm breaks in log_rotate_check() .. */
-	if (tm->tm_hour != hour) {
-		/* hour changed, check if we need to rotate log file */
-                log_rotate_check(log);
+	if (now != log->last) {
+		/* the date can't have changed if the last line was
+		   written during the same second */
+		tm = localtime(&now);
+		hour = tm->tm_hour;
+		day = tm->tm_mday;
+
+		tm = localtime(&log->last);
+		day -= tm->tm_mday; /* tm breaks in log_rotate_check() .. */
+		if (tm->tm_hour != hour) {
+			/* hour changed, check if we need to rotate log file */
+			log_rotate_check(log);
+		}
+
+		if (day != 0) {
+			/* day changed */
+			log_write_timestamp(log->handle,
+					    settings_get_str("log_day_changed"),
+					    "\n", now);
+		}
+
+		log->last = now;
 	}
 
-	if (day != 0) {
-		/* day changed */
-		log_write_timestamp(log->handle,
-				    settings_get_str("log_day_changed"),
-				    "\n", now);
-	}
-
-	log->last = now;
-
 	if (log->colorizer == NULL)
 		colorstr = NULL;
         else
                 str = colorstr = log->colorizer(str);
 
         if ((level & MSGLEVEL_LASTLOG) == 0)
-		log_write_timestamp(log->handle, log_timestamp, str, now);
-	else
-		write_buffer(log->handle, str, strlen(str));
+		log_write_line_timestamp(log->handle, now);
+	write_buffer(log->handle, str, strlen(str));
 	write_buffer(log->handle, "\n", 1);
 
 	signal_emit("log written", 2, log, str);
@@ -269,48 +402,174 @@ LOG_ITEM_REC *log_item_find(LOG_REC *log, int type, const char *item,
 	return NULL;
 }
 
-void log_file_write(const char *server_tag, const char *item, int level,
-		    const char *str, int no_fallbacks)
+static int log_item_logs_destroy(char *key, LOG_ITEM_LOGS_REC *rec)
 {
-	GSList *tmp, *fallbacks;
-	char *tmpstr;
-	int found;
+	g_slist_free(rec->logs);
+	g_free_not_null(rec->servertag);
+	g_free(rec);
+	g_free(key);
+	return TRUE;
+}
 
-	g_return_if_fail(str != NULL);
+static int log_item_logs_destroy_server(char *key, LOG_ITEM_LOGS_REC *rec,
+					const char *servertag)
+{
+	if (rec->servertag == NULL ||
+	    g_strcasecmp(rec->servertag, servertag) != 0)
+		return FALSE;
 
-	if (logs == NULL)
-		return;
+	return log_item_logs_destroy(key, rec);
+}
+
+/* Logs or their items were changed */
+static void log_items_changed(void)
+{
+	log_items_generation++;
+
+	g_hash_table_foreach_remove(log_item_logs,
+				    (GHRFunc) log_item_logs_destroy, NULL);
+	g_slist_free(log_fallbacks);
+	log_fallbacks = NULL;
+	log_fallbacks_valid = FALSE;
+}
 
-	fallbacks = NULL; found = FALSE;
+/* Build the lowercased lookup key into log_item_key */
+static void log_item_key_set(int type, const char *item,
+			     const char *servertag)
+{
+	g_string_printf(log_item_key, "%d %c%s %c%s", type,
+			servertag == NULL ? '-' : '+',
+			servertag == NULL ? "" : servertag,
+			item == NULL ? '-' : '+', item == NULL ? "" : item);
+	ascii_strdown(log_item_key->str);
+}
 
+GSList *log_find_item_logs(int type, const char *item,
+			   const char *servertag)
+{
+	LOG_ITEM_LOGS_REC *rec;
+	GSList *tmp;
+
+	log_item_key_set(type, item, servertag);
+	rec = g_hash_table_lookup(log_item_logs, log_item_key->str);
+	if (rec != NULL)
+		return rec->logs;
+
+	rec = g_new0(LOG_ITEM_LOGS_REC, 1);
+	rec->servertag = g_strdup(servertag);
 	for (tmp = logs; tmp != NULL; tmp = tmp->next) {
-		LOG_REC *rec = tmp->data;
+		LOG_REC *log = tmp->data;
 
-		if (rec->handle == -1)
-			continue; /* log not opened yet */
+		if (log_item_find(log, type, item, servertag) != NULL)
+			rec->logs = g_slist_append(rec->logs, log);
+	}
 
-		if ((level & rec->level) == 0)
-			continue;
+	g_hash_table_insert(log_item_logs, g_strdup(log_item_key->str), rec);
+	return rec->logs;
+}
+
+static void sig_item_destroyed(WI_ITEM_REC *item)
+{
+	gpointer key, rec;
+
+	log_item_key_set(LOG_ITEM_TARGET, window_item_get_target(item),
+			 item->server == NULL ? NULL : item->server->tag);
+	if (g_hash_table_lookup_extended(log_item_logs, log_item_key->str,
+					 &key, &rec)) {
+		/* a write in progress may be walking the list */
+		log_items_generation++;
+		g_hash_table_remove(log_item_logs, key);
+		log_item_logs_destroy(key, rec);
+	}
+}
+
+static void sig_server_disconnected(SERVER_REC *server)
+{
+	if (server->tag == NULL)
+		return;
+
+	log_items_generation++;
+	g_hash_table_foreach_remove(log_item_logs,
+				    (GHRFunc) log_item_logs_destroy_server,
+				    server->tag);
+}
+
+static GSList *log_get_fallbacks(void)
+{
+	GSList *tmp;
 
-		if (rec->items == NULL)
-			fallbacks = g_slist_append(fallbacks, rec);
-		else if (log_item_find(rec, LOG_ITEM_TARGET, item,
-				       server_tag) != NULL)
+	if (!log_fallbacks_valid) {
+		for (tmp = logs; tmp != NULL; tmp = tmp->next) {
+			LOG_REC *rec = tmp->data;
+
+			if (rec->items == NULL)
+				log_fallbacks = g_slist_append(log_fallbacks, rec);
+		}
+		log_fallbacks_valid = TRUE;
+	}
+
+	return log_fallbacks;
+}
+
+#define log_is_writable(log, level) \
+	(((log)->handle != -1 || (log)->suspended) && ((level) & (log)->level))
+
+/* Write to the logs in `list' that haven't been written to with this
+   `write_id' yet. Returns FALSE if the log lists were changed. */
+static int log_write_list(GSList *list, unsigned int write_id,
+			  const char *str, int level)
+{
+	unsigned int generation;
+
+	generation = log_items_generation;
+	for (; list != NULL; list = list->next) {
+		LOG_REC *rec = list->data;
+
+		if (rec->write_id != write_id && log_is_writable(rec, level)) {
+			rec->write_id = write_id;
 			log_write_rec(rec, str, level);
+			if (generation != log_items_generation)
+				return FALSE;
+		}
 	}
 
-	if (!found && !no_fallbacks && fallbacks != NULL) {
-		/* not found from any items, so write it to all main logs */
-		tmpstr = (level & MSGLEVEL_PUBLIC) && item != NULL ?
-			g_strconcat(item, ": ", str, NULL) :
-			g_strdup(str);
+	return TRUE;
+}
+
+void log_file_write(const char *server_tag, const char *item, int level,
+		    const char *str, int no_fallbacks)
+{
+	GSList *tmp;
+	char *tmpstr;
+	unsigned int write_id;
 
-		for (tmp = fallbacks; tmp != NULL; tmp = tmp->next)
-                        log_write_rec(tmp->data, tmpstr, level);
+	g_return_if_fail(str != NULL);
 
-		g_free(tmpstr);
+	if (logs == NULL)
+		return;
+
+	/* writing may open and close logs, which invalidates the lists.
+	   start again then, skipping the logs that were already written. */
+	write_id = ++log_write_id;
+	tmpstr = NULL;
+	for (;;) {
+		tmp = log_find_item_logs(LOG_ITEM_TARGET, item, server_tag);
+		if (!log_write_list(tmp, write_id, str, level))
+			continue;
+
+		if (no_fallbacks || log_get_fallbacks() == NULL)
+			break;
+
+		/* write it to all main logs */
+		if (tmpstr == NULL && (level & MSGLEVEL_PUBLIC) && item != NULL)
+			tmpstr = g_strconcat(item, ": ", str, NULL);
+
+		if (log_write_list(log_get_fallbacks(), write_id,
+				   tmpstr != NULL ? tmpstr : str, level))
+			break;
 	}
-        g_slist_free(fallbacks);
+
+	g_free_not_null(tmpstr);
 }
 
 LOG_REC *log_find(const char *fname)
@@ -411,6 +670,7 @@ void log_item_add(LOG_REC *log, int type, const char *name,
 	rec->servertag = g_strdup(servertag);
 
 	log->items = g_slist_append(log->items, rec);
+	log_items_changed();
 }
 
 void log_update(LOG_REC *log)
@@ -420,6 +680,7 @@ void log_update(LOG_REC *log)
 	if (log_find(log->fname) == NULL) {
 		logs = g_slist_append(logs, log);
 		log->handle = -1;
+		log_items_changed();
 	}
 
 	log_update_config(log);
@@ -429,6 +690,7 @@ void log_update(LOG_REC *log)
 void log_item_destroy(LOG_REC *log, LOG_ITEM_REC *item)
 {
 	log->items = g_slist_remove(log->items, item);
+	log_items_changed();
 
 	g_free(item->name);
 	g_free_not_null(item->servertag);
@@ -439,10 +701,11 @@ static void log_destroy(LOG_REC *log)
 {
 	g_return_if_fail(log != NULL);
 
-	if (log->handle != -1)
+	if (log->handle != -1 || log->suspended)
 		log_stop_logging(log);
 
 	logs = g_slist_remove(logs, log);
+	log_items_changed();
 	signal_emit("log remove", 1, log);
 
 	while (log->items != NULL)
@@ -502,6 +765,7 @@ static void log_items_read_config(CONFIG_NODE *node, LOG_REC *log)
 
 		log->items = g_slist_append(log->items, rec);
 	}
+	log_items_changed();
 }
 
 static void log_read_config(void)
@@ -559,6 +823,8 @@ static void log_read_config(void)
 static void read_settings(void)
 {
 	log_timestamp = settings_get_str("log_timestamp");
+	log_timestamp_time = (time_t) -1;
+	autolog_max_open_files = settings_get_int("autolog_max_open_files");
 	log_file_create_mode = octal2dec(settings_get_int("log_create_mode"));
 
         log_dir_create_mode = log_file_create_mode;
@@ -572,6 +838,13 @@ void log_init(void)
 	rotate_tag = g_timeout_add(60000, (GSourceFunc) sig_rotate_check, NULL);
 	logs = NULL;
 
+	log_item_logs = g_hash_table_new((GHashFunc) g_str_hash,
+					 (GCompareFunc) g_str_equal);
+	log_item_key = g_string_new(NULL);
+	log_fallbacks = NULL;
+	log_fallbacks_valid = FALSE;
+	autologs_open = 0;
+
 	settings_add_int("log", "log_create_mode",
 			 DEFAULT_LOG_FILE_CREATE_MODE);
 	settings_add_str("log", "log_timestamp", "%H:%M ");
@@ -581,11 +854,15 @@ void log_init(void)
 			 "--- Log closed %a %b %d %H:%M:%S %Y");
 	settings_add_str("log", "log_day_changed",
 			 "--- Day changed %a %b %d %Y");
+	settings_add_int("log", "autolog_max_open_files", 256);
 
 	read_settings();
         signal_add("setup changed", (SIGNAL_FUNC) read_settings);
         signal_add("setup reread", (SIGNAL_FUNC) log_read_config);
         signal_add("irssi init finished", (SIGNAL_FUNC) log_read_config);
+	signal_add("channel destroyed", (SIGNAL_FUNC) sig_item_destroyed);
+	signal_add("query destroyed", (SIGNAL_FUNC) sig_item_destroyed);
+	signal_add("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
 }
 
 void log_deinit(void)
@@ -595,7 +872,14 @@ void log_deinit(void)
 	while (logs != NULL)
 		log_close(logs->data);
 
+	log_items_changed();
+	g_hash_table_destroy(log_item_logs);
+	g_string_free(log_item_key, TRUE);
+
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
         signal_remove("setup reread", (SIGNAL_FUNC) log_read_config);
         signal_remove("irssi init finished", (SIGNAL_FUNC) log_read_config);
+	signal_remove("channel destroyed", (SIGNAL_FUNC) sig_item_destroyed);
+	signal_remove("query destroyed", (SIGNAL_FUNC) sig_item_destroyed);
+	signal_remove("server disconnected", (SIGNAL_FUNC) sig_server_disconnected);
 }
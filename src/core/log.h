@@ -28,10 +28,13 @@ struct _LOG_REC {
 
 	time_t last; /* when last message was written */
         COLORIZE_FUNC colorizer;
+	unsigned int write_id; /* last log_file_write() that wrote here */
 
 	unsigned int autoopen:1; /* automatically start logging at startup */
 	unsigned int failed:1; /* opening log failed last time */
 	unsigned int temp:1; /* don't save this to config file */
+	unsigned int suspended:1; /* file closed to save file handles,
+				     reopened when it's written to */
 };
 
 extern GSList *logs;
@@ -48,6 +51,10 @@ void log_item_add(LOG_REC *log, int type, const char *name,
 void log_item_destroy(LOG_REC *log, LOG_ITEM_REC *item);
 LOG_ITEM_REC *log_item_find(LOG_REC *log, int type, const char *item,
 			    const char *servertag);
+/* Returns the logs that have an item matching type, item and servertag.
+   The list is valid until logs or their items are changed. */
+GSList *log_find_item_logs(int type, const char *item,
+			   const char *servertag);
 
 void log_file_write(const char *server_tag, const char *item, int level,
 		    const char *str, int no_fallbacks);
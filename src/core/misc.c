@@ -312,10 +312,6 @@ char *stristr(const char *data, const char *key)
 	return NULL;
 }
 
-#define isbound(c) \
-	((unsigned char) (c) < 128 && \
-	(i_isspace(c) || i_ispunct(c)))
-
 static char *strstr_full_case(const char *data, const char *key, int icase)
 {
 	const char *start, *max;
@@ -469,13 +465,38 @@ unsigned int g_istr_hash(gconstpointer v)
 	return h /* % M */;
 }
 
+/* stristr() for a key that isn't NUL-terminated */
+static const char *stristr_len(const char *data, const char *key, int keylen)
+{
+	const char *max;
+	int datalen, pos;
+
+	datalen = strlen(data);
+	if (keylen > datalen)
+		return NULL;
+
+	max = data+datalen-keylen;
+	pos = 0;
+	while (data <= max) {
+		if (pos == keylen)
+			return data;
+
+		if (i_toupper(data[pos]) == i_toupper(key[pos]))
+			pos++;
+		else {
+			data++;
+			pos = 0;
+		}
+	}
+
+	return NULL;
+}
+
 /* Find `mask' from `data', you can use * and ? wildcards. */
-int match_wildcards(const char *cmask, const char *data)
+int match_wildcards(const char *mask, const char *data)
 {
-	char *mask, *newmask, *p1, *p2;
-	int ret;
+	int len;
 
-	newmask = mask = g_strdup(cmask);
 	for (; *mask != '\0' && *data != '\0'; mask++) {
 		if (*mask != '*') {
 			if (*mask != '?' && i_toupper(*mask) != i_toupper(*data))
@@ -491,27 +512,18 @@ int match_wildcards(const char *cmask, const char *data)
 			break;
 		}
 
-		p1 = strchr(mask, '*');
-		p2 = strchr(mask, '?');
-		if (p1 == NULL || (p2 < p1 && p2 != NULL)) p1 = p2;
-
-		if (p1 != NULL) *p1 = '\0';
-
-		data = stristr(data, mask);
+		/* find the text up to the next wildcard */
+		len = strcspn(mask, "*?");
+		data = stristr_len(data, mask, len);
 		if (data == NULL) break;
 
-		data += strlen(mask);
-		mask += strlen(mask)-1;
-
-		if (p1 != NULL) *p1 = p1 == p2 ? '?' : '*';
+		data += len;
+		mask += len-1;
 	}
 
 	while (*mask == '*') mask++;
 
-	ret = data != NULL && *data == '\0' && *mask == '\0';
-	g_free(newmask);
-
-	return ret;
+	return data != NULL && *data == '\0' && *mask == '\0';
 }
 
 /* Return TRUE if all characters in `str' are numbers.
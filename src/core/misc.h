@@ -89,6 +89,9 @@ int strocpy(char *dest, const char *src, size_t dstsize);
 char *stristr(const char *data, const char *key);
 
 /* like strstr(), but matches only for full words. */
+#define isbound(c) \
+	((unsigned char) (c) < 128 && \
+	(i_isspace(c) || i_ispunct(c)))
 char *strstr_full(const char *data, const char *key);
 char *stristr_full(const char *data, const char *key);
 
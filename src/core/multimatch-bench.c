@@ -0,0 +1,145 @@
+/*
+ multimatch-bench.c : compare stristr() per key against one multimatch scan
+
+    Copyright (C) 2010 The Irssi project
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Build with "make multimatch-bench" in src/core. This is what hilight
+   matching does for each printed line: the old code ran stristr() for
+   each text hilight, now all of them are found with one scan.
+
+   Usage: multimatch-bench [<lines> [<hilight count> ...]] */
+
+#include "module.h"
+#include "misc.h"
+#include "multimatch.h"
+
+#define DEFAULT_LINES 100000
+#define LINE_WORDS 15
+
+static const char *words[] = {
+	"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+	"irssi", "channel", "server", "split", "hello", "anyone", "here",
+	"know", "how", "to", "fix", "this", "build", "error", "thanks"
+};
+
+static int match_found(void *data, const char *text, int pos, int len,
+		       void *user_data)
+{
+	(*(int *) user_data)++;
+	return TRUE;
+}
+
+static char **lines_create(GRand *rand, int count)
+{
+	GString *str;
+	char **lines;
+	int i, n;
+
+	lines = g_new(char *, count+1);
+	str = g_string_new(NULL);
+	for (i = 0; i < count; i++) {
+		g_string_truncate(str, 0);
+		for (n = 0; n < LINE_WORDS; n++) {
+			g_string_append(str, words[g_rand_int_range(rand, 0,
+					G_N_ELEMENTS(words))]);
+			g_string_append_c(str, ' ');
+		}
+		/* every 100th line mentions one of the keys */
+		if (i % 100 == 0)
+			g_string_append_printf(str, "Nick%d", i % 7);
+		lines[i] = g_strdup(str->str);
+	}
+	lines[count] = NULL;
+	g_string_free(str, TRUE);
+	return lines;
+}
+
+static void bench(char **lines, int nkeys)
+{
+	MULTIMATCH_REC *match;
+	GTimer *timer;
+	char **keys, **line;
+	double old_time, new_time;
+	int i, old_count, new_count;
+
+	keys = g_new(char *, nkeys);
+	match = multimatch_create();
+	for (i = 0; i < nkeys; i++) {
+		keys[i] = g_strdup_printf("nick%d", i);
+		multimatch_add(match, keys[i], keys[i]);
+	}
+
+	timer = g_timer_new();
+	old_count = 0;
+	for (line = lines; *line != NULL; line++) {
+		for (i = 0; i < nkeys; i++) {
+			if (stristr(*line, keys[i]) != NULL) {
+				old_count++;
+				break;
+			}
+		}
+	}
+	old_time = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	new_count = 0;
+	for (line = lines; *line != NULL; line++)
+		multimatch_scan(match, *line, match_found, &new_count);
+	new_time = g_timer_elapsed(timer, NULL);
+
+	printf("%4d hilights: stristr %.3fs, multimatch %.3fs "
+	       "(%d/%d lines matched)\n",
+	       nkeys, old_time, new_time, old_count, new_count);
+
+	g_timer_destroy(timer);
+	multimatch_destroy(match);
+	for (i = 0; i < nkeys; i++)
+		g_free(keys[i]);
+	g_free(keys);
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_keys[] = { 1, 5, 20, 100, 500 };
+	GRand *rand;
+	char **lines;
+	int i, count;
+
+	count = argc > 1 ? atoi(argv[1]) : DEFAULT_LINES;
+	if (count <= 0) {
+		fprintf(stderr, "usage: %s [<lines> [<hilight count> ...]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	rand = g_rand_new_with_seed(1);
+	lines = lines_create(rand, count);
+	printf("%d lines of %d words\n", count, LINE_WORDS);
+
+	if (argc > 2) {
+		for (i = 2; i < argc; i++)
+			bench(lines, atoi(argv[i]));
+	} else {
+		for (i = 0; i < (int) G_N_ELEMENTS(default_keys); i++)
+			bench(lines, default_keys[i]);
+	}
+
+	g_strfreev(lines);
+	g_rand_free(rand);
+	return 0;
+}
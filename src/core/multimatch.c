@@ -0,0 +1,219 @@
+/*
+ multimatch.c : irssi
+
+    Copyright (C) 2010 The Irssi project
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "module.h"
+#include "multimatch.h"
+
+typedef struct _MATCH_NODE MATCH_NODE;
+
+typedef struct {
+	void *data;
+	int len;
+} MATCH_KEY_REC;
+
+struct _MATCH_NODE {
+	MATCH_NODE *child, *sibling; /* trie */
+	MATCH_NODE *fail; /* longest proper suffix that's in trie */
+	MATCH_NODE *output; /* next node in fail chain that has keys */
+	GSList *keys; /* MATCH_KEY_RECs ending here */
+	unsigned char chr; /* uppercased */
+};
+
+struct _MULTIMATCH_REC {
+	MATCH_NODE *root[256]; /* the first level is looked up directly */
+	int keys;
+	unsigned int dirty:1; /* fail links need to be rebuilt */
+};
+
+MULTIMATCH_REC *multimatch_create(void)
+{
+	return g_new0(MULTIMATCH_REC, 1);
+}
+
+static void node_destroy(MATCH_NODE *node)
+{
+	MATCH_NODE *next;
+
+	for (; node != NULL; node = next) {
+		next = node->sibling;
+
+		node_destroy(node->child);
+		g_slist_foreach(node->keys, (GFunc) g_free, NULL);
+		g_slist_free(node->keys);
+		g_free(node);
+	}
+}
+
+void multimatch_clear(MULTIMATCH_REC *rec)
+{
+	int i;
+
+	g_return_if_fail(rec != NULL);
+
+	for (i = 0; i < 256; i++) {
+		node_destroy(rec->root[i]);
+		rec->root[i] = NULL;
+	}
+	rec->keys = 0;
+	rec->dirty = FALSE;
+}
+
+void multimatch_destroy(MULTIMATCH_REC *rec)
+{
+	g_return_if_fail(rec != NULL);
+
+	multimatch_clear(rec);
+	g_free(rec);
+}
+
+int multimatch_is_empty(MULTIMATCH_REC *rec)
+{
+	return rec == NULL || rec->keys == 0;
+}
+
+static MATCH_NODE *node_find_child(MATCH_NODE *node, unsigned char chr)
+{
+	for (node = node->child; node != NULL; node = node->sibling) {
+		if (node->chr == chr)
+			return node;
+	}
+	return NULL;
+}
+
+void multimatch_add(MULTIMATCH_REC *rec, const char *key, void *data)
+{
+	MATCH_NODE *node, *child;
+	MATCH_KEY_REC *keyrec;
+	unsigned char chr;
+	int len;
+
+	g_return_if_fail(rec != NULL);
+	g_return_if_fail(key != NULL);
+
+	if (*key == '\0')
+		return;
+
+	chr = (unsigned char) i_toupper(*key);
+	node = rec->root[chr];
+	if (node == NULL) {
+		node = rec->root[chr] = g_new0(MATCH_NODE, 1);
+		node->chr = chr;
+	}
+
+	for (len = 1; key[len] != '\0'; len++) {
+		chr = (unsigned char) i_toupper(key[len]);
+		child = node_find_child(node, chr);
+		if (child == NULL) {
+			child = g_new0(MATCH_NODE, 1);
+			child->chr = chr;
+			child->sibling = node->child;
+			node->child = child;
+		}
+		node = child;
+	}
+
+	keyrec = g_new(MATCH_KEY_REC, 1);
+	keyrec->data = data;
+	keyrec->len = len;
+	node->keys = g_slist_append(node->keys, keyrec);
+
+	rec->keys++;
+	rec->dirty = TRUE;
+}
+
+/* Returns the next state after `node' when reading `chr'.
+   NULL `node' is the root. */
+static MATCH_NODE *node_next(MULTIMATCH_REC *rec, MATCH_NODE *node,
+			     unsigned char chr)
+{
+	MATCH_NODE *next;
+
+	for (; node != NULL; node = node->fail) {
+		next = node_find_child(node, chr);
+		if (next != NULL)
+			return next;
+	}
+	return rec->root[chr];
+}
+
+/* Build the fail and output links breadth-first */
+static void multimatch_compile(MULTIMATCH_REC *rec)
+{
+	GQueue *queue;
+	MATCH_NODE *node, *child;
+	int i;
+
+	queue = g_queue_new();
+	for (i = 0; i < 256; i++) {
+		if (rec->root[i] != NULL) {
+			rec->root[i]->fail = NULL;
+			rec->root[i]->output = NULL;
+			g_queue_push_tail(queue, rec->root[i]);
+		}
+	}
+
+	while ((node = g_queue_pop_head(queue)) != NULL) {
+		for (child = node->child; child != NULL; child = child->sibling) {
+			child->fail = node_next(rec, node->fail, child->chr);
+			child->output = child->fail == NULL ? NULL :
+				child->fail->keys != NULL ? child->fail :
+				child->fail->output;
+			g_queue_push_tail(queue, child);
+		}
+	}
+	g_queue_free(queue);
+
+	rec->dirty = FALSE;
+}
+
+void multimatch_scan(MULTIMATCH_REC *rec, const char *text,
+		     MULTIMATCH_FUNC func, void *user_data)
+{
+	MATCH_NODE *node, *out;
+	MATCH_KEY_REC *key;
+	GSList *tmp;
+	int pos;
+
+	g_return_if_fail(rec != NULL);
+	g_return_if_fail(text != NULL);
+	g_return_if_fail(func != NULL);
+
+	if (rec->keys == 0)
+		return;
+	if (rec->dirty)
+		multimatch_compile(rec);
+
+	node = NULL;
+	for (pos = 0; text[pos] != '\0'; pos++) {
+		node = node_next(rec, node, (unsigned char) i_toupper(text[pos]));
+		if (node == NULL)
+			continue;
+
+		out = node->keys != NULL ? node : node->output;
+		for (; out != NULL; out = out->output) {
+			for (tmp = out->keys; tmp != NULL; tmp = tmp->next) {
+				key = tmp->data;
+				if (func(key->data, text, pos-key->len+1,
+					 key->len, user_data))
+					return;
+			}
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef __MULTIMATCH_H
+#define __MULTIMATCH_H
+
+/* Finds all occurances of any number of strings from a text with a single
+   pass over the text (Aho-Corasick). Matching is case-insensitive, like
+   with stristr(). */
+
+typedef struct _MULTIMATCH_REC MULTIMATCH_REC;
+
+/* Called for each found string. `pos' is the position of the match in
+   `text' and `len' its length. Return TRUE to stop scanning. */
+typedef int (*MULTIMATCH_FUNC) (void *data, const char *text,
+				int pos, int len, void *user_data);
+
+MULTIMATCH_REC *multimatch_create(void);
+void multimatch_destroy(MULTIMATCH_REC *rec);
+
+/* Add `key' to strings to be searched, `data' is given to the match
+   function when it's found. Empty keys are ignored. */
+void multimatch_add(MULTIMATCH_REC *rec, const char *key, void *data);
+/* Remove all strings */
+void multimatch_clear(MULTIMATCH_REC *rec);
+
+/* Returns TRUE if no strings have been added */
+int multimatch_is_empty(MULTIMATCH_REC *rec);
+
+/* Scan `text' and call `func' for each found string */
+void multimatch_scan(MULTIMATCH_REC *rec, const char *text,
+		     MULTIMATCH_FUNC func, void *user_data);
+
+#endif
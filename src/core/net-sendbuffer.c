@@ -24,6 +24,19 @@
 #include "net-sendbuffer.h"
 #include "line-split.h"
 
+/* Maximum number of chunks given to one writev() call */
+#define MAX_SEND_CHUNKS 16
+
+struct _NET_SENDBUF_CHUNK {
+	NET_SENDBUF_CHUNK *next;
+	int size;
+	int start, end; /* unsent data is data[start..end) */
+	char data[1];
+};
+
+static GSList *pending_buffers; /* buffers with pending data */
+static int flush_tag = -1;
+
 /* Create new buffer - if `bufsize' is zero or less, DEFAULT_BUFFER_SIZE
    is used */
 NET_SENDBUF_REC *net_sendbuffer_create(GIOChannel *handle, int bufsize)
@@ -36,126 +49,272 @@ NET_SENDBUF_REC *net_sendbuffer_create(GIOChannel *handle, int bufsize)
         rec->send_tag = -1;
 	rec->handle = handle;
 	rec->bufsize = bufsize > 0 ? bufsize : DEFAULT_BUFFER_SIZE;
-	rec->def_bufsize = rec->bufsize;
 
 	return rec;
 }
 
-/* Destroy the buffer. `close' specifies if socket handle should be closed. */
-void net_sendbuffer_destroy(NET_SENDBUF_REC *rec, int close)
+static NET_SENDBUF_CHUNK *chunk_new(NET_SENDBUF_REC *rec, int size)
 {
-        if (rec->send_tag != -1) g_source_remove(rec->send_tag);
-	if (close) net_disconnect(rec->handle);
-	if (rec->readbuffer != NULL) line_split_free(rec->readbuffer);
-	g_free_not_null(rec->buffer);
-	g_free(rec);
+	NET_SENDBUF_CHUNK *chunk;
+
+	if (size <= rec->bufsize && rec->spare != NULL) {
+		chunk = rec->spare;
+		rec->spare = NULL;
+	} else {
+		size = MAX(size, rec->bufsize);
+		chunk = g_malloc(sizeof(NET_SENDBUF_CHUNK) + size);
+		chunk->size = size;
+	}
+
+	chunk->next = NULL;
+	chunk->start = chunk->end = 0;
+	return chunk;
 }
 
-/* Transmit all data from buffer - return TRUE if the whole buffer was sent */
-static int buffer_send(NET_SENDBUF_REC *rec)
+static void chunk_free(NET_SENDBUF_REC *rec, NET_SENDBUF_CHUNK *chunk)
+{
+	/* keep one chunk around, most of the time it's all we need */
+	if (rec->spare == NULL && chunk->size == rec->bufsize)
+		rec->spare = chunk;
+	else
+		g_free(chunk);
+}
+
+/* Remove `size' bytes of sent data from the beginning of the buffer */
+static void buffer_consume(NET_SENDBUF_REC *rec, int size)
 {
-	int ret;
+	NET_SENDBUF_CHUNK *chunk;
+	int len;
+
+	rec->bufpos -= size;
+	while (size > 0) {
+		chunk = rec->first;
+		len = chunk->end - chunk->start;
+		if (size < len) {
+			chunk->start += size;
+			break;
+		}
 
-	ret = net_transmit(rec->handle, rec->buffer, rec->bufpos);
-	if (ret < 0 || rec->bufpos == ret) {
-		/* error/all sent - don't try to send it anymore */
-		rec->bufsize = rec->def_bufsize;
-		rec->buffer = g_realloc(rec->buffer, rec->bufsize);
-		rec->bufpos = 0;
-		return TRUE;
+		size -= len;
+		rec->first = chunk->next;
+		if (rec->first == NULL)
+			rec->last = NULL;
+		chunk_free(rec, chunk);
 	}
+}
 
-	if (ret > 0) {
-                rec->bufpos -= ret;
-		g_memmove(rec->buffer, rec->buffer+ret, rec->bufpos);
+static void buffer_clear(NET_SENDBUF_REC *rec)
+{
+	NET_SENDBUF_CHUNK *chunk;
+
+	while (rec->first != NULL) {
+		chunk = rec->first;
+		rec->first = chunk->next;
+		g_free(chunk);
 	}
-	return FALSE;
+	rec->last = NULL;
+	rec->bufpos = 0;
 }
 
-static void sig_sendbuffer(NET_SENDBUF_REC *rec)
+/* Transmit data from buffer - return TRUE if the whole buffer was sent
+   or an error occured */
+static int buffer_send(NET_SENDBUF_REC *rec)
 {
-	if (rec->buffer != NULL) {
-		if (!buffer_send(rec))
-                        return;
+	struct iovec iov[MAX_SEND_CHUNKS];
+	NET_SENDBUF_CHUNK *chunk;
+	int count, ret;
+
+	while (rec->first != NULL) {
+		count = 0;
+		for (chunk = rec->first; chunk != NULL && count < MAX_SEND_CHUNKS;
+		     chunk = chunk->next) {
+			iov[count].iov_base = chunk->data + chunk->start;
+			iov[count].iov_len = chunk->end - chunk->start;
+			count++;
+		}
+
+		ret = net_transmitv(rec->handle, iov, count);
+		if (ret < 0) {
+			/* error - don't try to send it anymore */
+			rec->failed = TRUE;
+			buffer_clear(rec);
+			return TRUE;
+		}
+		if (ret == 0)
+			return FALSE;
+
+		buffer_consume(rec, ret);
 	}
 
+	return TRUE;
+}
+
+static void sig_sendbuffer(NET_SENDBUF_REC *rec)
+{
+	if (!buffer_send(rec))
+		return;
+
 	g_source_remove(rec->send_tag);
 	rec->send_tag = -1;
 }
 
+/* Try to send the queued data now. Returns -1 if sending failed. */
+int net_sendbuffer_flush(NET_SENDBUF_REC *rec)
+{
+	g_return_val_if_fail(rec != NULL, -1);
+
+	if (rec->pending) {
+		rec->pending = FALSE;
+		pending_buffers = g_slist_remove(pending_buffers, rec);
+	}
+
+	/* if we're waiting for the socket to become writable, there's
+	   no point in trying now */
+	if (rec->send_tag == -1 && !buffer_send(rec)) {
+		rec->send_tag =
+			g_input_add(rec->handle, G_INPUT_WRITE,
+				    (GInputFunction) sig_sendbuffer, rec);
+	}
+
+	return rec->failed ? -1 : 0;
+}
+
+/* net_sendbuffer_flush() all the buffers that have queued data */
+void net_sendbuffer_flush_all(void)
+{
+	while (pending_buffers != NULL)
+		net_sendbuffer_flush(pending_buffers->data);
+
+	if (flush_tag != -1) {
+		g_source_remove(flush_tag);
+		flush_tag = -1;
+	}
+}
+
+static int sig_flush(void)
+{
+	flush_tag = -1;
+	net_sendbuffer_flush_all();
+	return FALSE;
+}
+
+/* Destroy the buffer. `close' specifies if socket handle should be closed. */
+void net_sendbuffer_destroy(NET_SENDBUF_REC *rec, int close)
+{
+	if (rec->pending)
+		pending_buffers = g_slist_remove(pending_buffers, rec);
+
+	/* try to get out whatever is still queued */
+	if (rec->first != NULL && !rec->failed)
+		buffer_send(rec);
+
+        if (rec->send_tag != -1) g_source_remove(rec->send_tag);
+	if (close) net_disconnect(rec->handle);
+	if (rec->readbuffer != NULL) line_split_free(rec->readbuffer);
+	buffer_clear(rec);
+	g_free_not_null(rec->spare);
+	g_free(rec);
+}
+
 /* Add `data' to transmit buffer - return FALSE if buffer is full */
 static int buffer_add(NET_SENDBUF_REC *rec, const void *data, int size)
 {
-	if (rec->buffer == NULL) {
-		rec->buffer = g_malloc(rec->bufsize);
-		rec->bufpos = 0;
+	NET_SENDBUF_CHUNK *chunk;
+	int len;
+
+	if (rec->bufpos+size > MAX_BUFFER_SIZE) {
+		if (!rec->dead)
+			g_warning("Dropping some data on an outgoing connection");
+		rec->dead = 1;
+		return FALSE;
 	}
 
-	while (rec->bufpos+size > rec->bufsize) {
-		if (rec->bufsize >= MAX_BUFFER_SIZE) {
-			if (!rec->dead)
-				g_warning("Dropping some data on an outgoing connection");
-			rec->dead = 1;
-			return FALSE;
-		}
-		rec->bufsize *= 2;
-		rec->buffer = g_realloc(rec->buffer, rec->bufsize);
+	chunk = rec->last;
+	if (chunk != NULL && chunk->end < chunk->size) {
+		/* fill the last chunk first */
+		len = MIN(size, chunk->size - chunk->end);
+		memcpy(chunk->data + chunk->end, data, len);
+		chunk->end += len;
+		rec->bufpos += len;
+
+		data = ((const char *) data) + len;
+		size -= len;
 	}
 
-	memcpy(rec->buffer+rec->bufpos, data, size);
-	rec->bufpos += size;
+	if (size > 0) {
+		chunk = chunk_new(rec, size);
+		memcpy(chunk->data, data, size);
+		chunk->end = size;
+		rec->bufpos += size;
+
+		if (rec->last == NULL)
+			rec->first = chunk;
+		else
+			rec->last->next = chunk;
+		rec->last = chunk;
+	}
 	return TRUE;
 }
 
-/* Send data, if all of it couldn't be sent immediately, it will be resent
-   automatically after a while. Returns -1 if some unrecoverable error
-   occured. */
+/* Queue data for sending. Everything queued during one main loop run is
+   sent with a single writev() by net_sendbuffer_flush(), or right after
+   the current event source if nothing flushes it before. Data that can't
+   be sent immediately is resent when the socket becomes writable. Returns
+   -1 if some unrecoverable error occured, an error in sending the queued
+   data is returned by the next call. */
 int net_sendbuffer_send(NET_SENDBUF_REC *rec, const void *data, int size)
 {
-	int ret;
-
 	g_return_val_if_fail(rec != NULL, -1);
 	g_return_val_if_fail(data != NULL, -1);
+	if (rec->failed) return -1;
 	if (size <= 0) return 0;
 
-	if (rec->buffer == NULL || rec->bufpos == 0) {
-                /* nothing in buffer - transmit immediately */
-		ret = net_transmit(rec->handle, data, size);
-		if (ret < 0) return -1;
-		size -= ret;
-		data = ((const char *) data) + ret;
-	}
+	if (!buffer_add(rec, data, size))
+		return -1;
 
-	if (size <= 0)
+	/* when waiting for the socket to become writable, sig_sendbuffer()
+	   sends this with the rest */
+	if (rec->send_tag != -1 || rec->pending)
 		return 0;
 
-	/* everything couldn't be sent. */
-	if (rec->send_tag == -1) {
-		rec->send_tag =
-			g_input_add(rec->handle, G_INPUT_WRITE,
-				    (GInputFunction) sig_sendbuffer, rec);
-	}
+	rec->pending = TRUE;
+	pending_buffers = g_slist_prepend(pending_buffers, rec);
 
-	return buffer_add(rec, data, size) ? 0 : -1;
+	/* Input watches run at the default priority, use a higher one so
+	   that a busy socket can't delay the sending. */
+	if (flush_tag == -1) {
+		flush_tag = g_timeout_add_full(G_PRIORITY_HIGH, 0,
+					       (GSourceFunc) sig_flush,
+					       NULL, NULL);
+	}
+	return 0;
 }
 
 int net_sendbuffer_receive_line(NET_SENDBUF_REC *rec, char **str, int read_socket)
 {
-	char tmpbuf[2048];
+	char *buf = "";
 	int recvlen = 0;
 
-	if (read_socket)
-		recvlen = net_receive(rec->handle, tmpbuf, sizeof(tmpbuf));
+	if (read_socket) {
+		/* receive straight into the line buffer */
+		buf = line_split_get_space(&rec->readbuffer, READ_BUFFER_SIZE);
+		recvlen = net_receive(rec->handle, buf, READ_BUFFER_SIZE);
+	}
 
-	return line_split(tmpbuf, recvlen, str, &rec->readbuffer);
+	return line_split(buf, recvlen, str, &rec->readbuffer);
 }
 
-/* Flush the buffer, blocks until finished. */
-void net_sendbuffer_flush(NET_SENDBUF_REC *rec)
+/* Send everything in the buffer, blocks until finished. */
+void net_sendbuffer_flush_sync(NET_SENDBUF_REC *rec)
 {
 	int handle;
 
-	if (rec->buffer == NULL)
+	if (rec->pending) {
+		rec->pending = FALSE;
+		pending_buffers = g_slist_remove(pending_buffers, rec);
+	}
+
+	if (rec->first == NULL || rec->failed)
 		return;
 
         /* set the socket blocking while doing this */
@@ -3,17 +3,24 @@
 
 #define DEFAULT_BUFFER_SIZE 8192
 #define MAX_BUFFER_SIZE 1048576
+#define READ_BUFFER_SIZE 16384
+
+typedef struct _NET_SENDBUF_CHUNK NET_SENDBUF_CHUNK;
 
 struct _NET_SENDBUF_REC {
         GIOChannel *handle;
         LINEBUF_REC *readbuffer; /* receive buffer */
 
-        int send_tag;
-        int bufsize;
-        int bufpos;
-        char *buffer; /* Buffer is NULL until it's actually needed. */
-        int def_bufsize;
+        int send_tag; /* waiting for the socket to become writable */
+
+        /* Data waiting to be sent. Chunks are allocated only when
+           they're actually needed. */
+        NET_SENDBUF_CHUNK *first, *last, *spare;
+        int bufsize; /* size of one chunk */
+        int bufpos; /* number of bytes waiting */
         unsigned int dead:1;
+        unsigned int failed:1; /* sending failed, socket is unusable */
+        unsigned int pending:1; /* queued data not tried to send yet */
 };
 
 /* Create new buffer - if `bufsize' is zero or less, DEFAULT_BUFFER_SIZE
@@ -22,15 +29,22 @@ NET_SENDBUF_REC *net_sendbuffer_create(GIOChannel *handle, int bufsize);
 /* Destroy the buffer. `close' specifies if socket handle should be closed. */
 void net_sendbuffer_destroy(NET_SENDBUF_REC *rec, int close);
 
-/* Send data, if all of it couldn't be sent immediately, it will be resent
-   automatically after a while. Returns -1 if some unrecoverable error
-   occured. */
+/* Queue data for sending. Everything queued during one main loop run is
+   sent with a single writev() by net_sendbuffer_flush(), or right after
+   the current event source if nothing flushes it before. Data that can't
+   be sent immediately is resent when the socket becomes writable. Returns
+   -1 if some unrecoverable error occured, an error in sending the queued
+   data is returned by the next call. */
 int net_sendbuffer_send(NET_SENDBUF_REC *rec, const void *data, int size);
+/* Try to send the queued data now. Returns -1 if sending failed. */
+int net_sendbuffer_flush(NET_SENDBUF_REC *rec);
+/* net_sendbuffer_flush() all the buffers that have queued data */
+void net_sendbuffer_flush_all(void);
 
 int net_sendbuffer_receive_line(NET_SENDBUF_REC *rec, char **str, int read_socket);
 
-/* Flush the buffer, blocks until finished. */
-void net_sendbuffer_flush(NET_SENDBUF_REC *rec);
+/* Send everything in the buffer, blocks until finished. */
+void net_sendbuffer_flush_sync(NET_SENDBUF_REC *rec);
 
 /* Returns the socket handle */
 GIOChannel *net_sendbuffer_handle(NET_SENDBUF_REC *rec);
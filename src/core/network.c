@@ -42,6 +42,12 @@ union sockaddr_union {
 #  define SIZEOF_SOCKADDR(so) (sizeof(so.sin))
 #endif
 
+#ifndef WIN32
+/* functions of plain unix channels - others (eg. SSL) can't be written
+   to directly with writev() */
+static GIOFuncs *unix_channel_funcs;
+#endif
+
 GIOChannel *g_io_channel_new(int handle)
 {
 	GIOChannel *chan;
@@ -49,6 +55,7 @@ GIOChannel *g_io_channel_new(int handle)
 	chan = g_io_channel_win32_new_socket(handle);
 #else
 	chan = g_io_channel_unix_new(handle);
+	unix_channel_funcs = chan->funcs;
 #endif
 	g_io_channel_set_encoding(chan, NULL, NULL);
 	g_io_channel_set_buffered(chan, FALSE);
@@ -386,6 +393,38 @@ int net_transmit(GIOChannel *handle, const char *data, int len)
 	return ret;
 }
 
+/* Transmit data from `count' buffers with one call if possible, return
+   number of bytes sent, -1 = error */
+int net_transmitv(GIOChannel *handle, const struct iovec *iov, int count)
+{
+	int i, ret, sent;
+
+	g_return_val_if_fail(handle != NULL, -1);
+	g_return_val_if_fail(iov != NULL, -1);
+
+#ifndef WIN32
+	if (handle->funcs == unix_channel_funcs) {
+		ret = writev(g_io_channel_unix_get_fd(handle), iov, count);
+		if (ret >= 0)
+			return ret;
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+	}
+#endif
+
+	/* SSL, send the buffers one by one */
+	sent = 0;
+	for (i = 0; i < count; i++) {
+		ret = net_transmit(handle, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return sent > 0 ? sent : -1;
+
+		sent += ret;
+		if (ret < (int) iov[i].iov_len)
+			break;
+	}
+	return sent;
+}
+
 /* Get socket address/port */
 int net_getsockname(GIOChannel *handle, IPADDR *addr, int *port)
 {
@@ -8,9 +8,15 @@
 #include <sys/types.h>
 #ifndef WIN32
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <netinet/in.h>
 #  include <netdb.h>
 #  include <arpa/inet.h>
+#else
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
 #endif
 
 #ifndef AF_INET6
@@ -67,6 +73,9 @@ GIOChannel *net_accept(GIOChannel *handle, IPADDR *addr, int *port);
 int net_receive(GIOChannel *handle, char *buf, int len);
 /* Transmit data, return number of bytes sent, -1 = error */
 int net_transmit(GIOChannel *handle, const char *data, int len);
+/* Transmit data from `count' buffers with one call if possible, return
+   number of bytes sent, -1 = error */
+int net_transmitv(GIOChannel *handle, const struct iovec *iov, int count);
 
 /* Get IP addresses for host, both IPv4 and IPv6 if possible.
    If ip->family is 0, the address wasn't found.
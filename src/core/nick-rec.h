@@ -3,16 +3,12 @@
 int type; /* module_get_uniq_id("NICK", 0) */
 int chat_type; /* chat_protocol_lookup(xx) */
 
-time_t last_check; /* last time gone was checked */
-
+/* Set with g_strdup() before nicklist_insert(), after it this is the
+   same string as user->nick. Change it only with nicklist_rename(). */
 char *nick;
-char *host;
-char *realname;
-int hops;
-
-/* status in server */
-unsigned int gone:1;
-unsigned int serverop:1;
+/* host, realname and status in server, shared with the user's nick
+   records in the server's other channels */
+NICK_USER_REC *user;
 
 /* status in channel */
 unsigned int send_massjoin:1; /* Waiting to be sent in massjoin signal */
@@ -30,6 +30,126 @@
 #define isalnumhigh(a) \
         (i_isalnum(a) || (unsigned char) (a) >= 128)
 
+static NICK_USER_REC *nick_user_find(SERVER_REC *server, const char *nick,
+				     void *id)
+{
+	NICK_USER_REC *user;
+
+	if (server->nicklist_users == NULL)
+		return NULL;
+
+	user = g_hash_table_lookup(server->nicklist_users, nick);
+	while (user != NULL && user->unique_id != id)
+		user = user->next;
+	return user;
+}
+
+static void nick_user_link(SERVER_REC *server, NICK_USER_REC *user)
+{
+	NICK_USER_REC *list;
+
+	if (server->nicklist_users == NULL) {
+		server->nicklist_users =
+			g_hash_table_new((GHashFunc) g_istr_hash,
+					 (GCompareFunc) g_istr_equal);
+	}
+
+	user->next = NULL;
+	list = g_hash_table_lookup(server->nicklist_users, user->nick);
+	if (list == NULL)
+		g_hash_table_insert(server->nicklist_users, user->nick, user);
+	else {
+		/* same nick with a different unique_id */
+		while (list->next != NULL)
+			list = list->next;
+		list->next = user;
+	}
+}
+
+static void nick_user_unlink(SERVER_REC *server, NICK_USER_REC *user)
+{
+	NICK_USER_REC *list;
+
+	list = g_hash_table_lookup(server->nicklist_users, user->nick);
+	if (list == user) {
+		g_hash_table_remove(server->nicklist_users, user->nick);
+		if (user->next != NULL) {
+			g_hash_table_insert(server->nicklist_users,
+					    user->next->nick, user->next);
+		}
+	} else {
+		while (list->next != user)
+			list = list->next;
+		list->next = user->next;
+	}
+	user->next = NULL;
+}
+
+/* Attach the nick record to its user. The record's own nick string is
+   replaced with the user's. */
+static void nick_user_add(CHANNEL_REC *channel, NICK_REC *nick)
+{
+	NICK_USER_REC *user;
+
+	user = nick_user_find(channel->server, nick->nick, nick->unique_id);
+	if (user == NULL) {
+		user = g_new0(NICK_USER_REC, 1);
+		user->nick = nick->nick;
+		user->unique_id = nick->unique_id;
+		nick_user_link(channel->server, user);
+	} else if (nick->nick != user->nick) {
+		g_free(nick->nick);
+		nick->nick = user->nick;
+	}
+
+	nick->user = user;
+	user->nicks = g_slist_append(user->nicks, channel);
+	user->nicks = g_slist_append(user->nicks, nick);
+}
+
+static void nick_user_remove(CHANNEL_REC *channel, NICK_REC *nick)
+{
+	NICK_USER_REC *user = nick->user;
+	GSList *tmp, *prev;
+
+	prev = NULL;
+	for (tmp = user->nicks; tmp != NULL; tmp = tmp->next->next) {
+		if (tmp->next->data == nick)
+			break;
+		prev = tmp->next;
+	}
+	if (tmp == NULL)
+		return;
+
+	/* drop the channel, nick pair */
+	if (prev == NULL)
+		user->nicks = tmp->next->next;
+	else
+		prev->next = tmp->next->next;
+	tmp->next->next = NULL;
+	g_slist_free(tmp);
+
+	if (user->nicks == NULL) {
+		/* not in any channel anymore */
+		nick_user_unlink(channel->server, user);
+		g_free_not_null(user->host);
+		g_free_not_null(user->realname);
+		g_free(user->nick);
+		g_free(user);
+	}
+}
+
+/* Send the signal for each of the user's nick records */
+static void nick_user_signal(NICK_USER_REC *user, const char *signal)
+{
+	GSList *nicks, *tmp;
+
+	nicks = g_slist_copy(user->nicks);
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next)
+		signal_emit(signal, 2, tmp->data, tmp->next->data);
+	g_slist_free(nicks);
+}
+
 static void nick_hash_add(CHANNEL_REC *channel, NICK_REC *nick)
 {
 	NICK_REC *list;
@@ -81,34 +201,56 @@ void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick)
 	nick->type = module_get_uniq_id("NICK", 0);
         nick->chat_type = channel->chat_type;
 
+	nick_user_add(channel, nick);
         nick_hash_add(channel, nick);
-	signal_emit("nicklist new", 2, channel, nick);
+	signal_emit_id(signal_get_const_id("nicklist new"), 2, channel, nick);
 }
 
 /* Set host address for nick */
 void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick, const char *host)
 {
+	NICK_USER_REC *user;
+
         g_return_if_fail(channel != NULL);
         g_return_if_fail(nick != NULL);
 	g_return_if_fail(host != NULL);
 
-        g_free_not_null(nick->host);
-	nick->host = g_strdup(host);
+	user = nick->user;
+	if (user->host != NULL && strcmp(user->host, host) == 0)
+		return;
+
+	g_free_not_null(user->host);
+	user->host = g_strdup(host);
 
-        signal_emit("nicklist host changed", 2, channel, nick);
+	nick_user_signal(user, "nicklist host changed");
+}
+
+/* Set real name for nick */
+void nicklist_set_realname(CHANNEL_REC *channel, NICK_REC *nick,
+			   const char *realname)
+{
+	NICK_USER_REC *user;
+
+        g_return_if_fail(channel != NULL);
+        g_return_if_fail(nick != NULL);
+
+	user = nick->user;
+	if (user->realname == realname)
+		return;
+
+	g_free_not_null(user->realname);
+	user->realname = g_strdup(realname);
 }
 
 static void nicklist_destroy(CHANNEL_REC *channel, NICK_REC *nick)
 {
-	signal_emit("nicklist remove", 2, channel, nick);
+	signal_emit_id(signal_get_const_id("nicklist remove"), 2, channel, nick);
 
 	if (channel->ownnick == nick)
                 channel->ownnick = NULL;
 
         /*MODULE_DATA_DEINIT(nick);*/
-	g_free(nick->nick);
-	g_free_not_null(nick->realname);
-	g_free_not_null(nick->host);
+	nick_user_remove(channel, nick);
 	g_free(nick);
 }
 
@@ -122,14 +264,25 @@ void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick)
 	nicklist_destroy(channel, nick);
 }
 
-static void nicklist_rename_list(SERVER_REC *server, void *new_nick_id,
-				 const char *old_nick, const char *new_nick,
-				 GSList *nicks)
+static void nicklist_rename_user(SERVER_REC *server, NICK_USER_REC *user,
+				 void *new_nick_id, const char *old_nick,
+				 const char *new_nick)
 {
 	CHANNEL_REC *channel;
 	NICK_REC *nickrec;
-	GSList *tmp;
-
+	GSList *nicks, *tmp;
+	char *old_str;
+
+	/* the channels' hash tables still have the old string as key,
+	   keep it until all the records are moved */
+	old_str = user->nick;
+	nick_user_unlink(server, user);
+	user->nick = g_strdup(new_nick);
+	if (new_nick_id != NULL)
+		user->unique_id = new_nick_id;
+	nick_user_link(server, user);
+
+	nicks = g_slist_copy(user->nicks);
 	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
 		channel = tmp->data;
 		nickrec = tmp->next->data;
@@ -139,9 +292,7 @@ static void nicklist_rename_list(SERVER_REC *server, void *new_nick_id,
 
 		if (new_nick_id != NULL)
 			nickrec->unique_id = new_nick_id;
-
-		g_free(nickrec->nick);
-		nickrec->nick = g_strdup(new_nick);
+		nickrec->nick = user->nick;
 
 		/* add new nick to hash table */
                 nick_hash_add(channel, nickrec);
@@ -149,21 +300,43 @@ static void nicklist_rename_list(SERVER_REC *server, void *new_nick_id,
 		signal_emit("nicklist changed", 3, channel, nickrec, old_nick);
 	}
 	g_slist_free(nicks);
+	g_free(old_str);
 }
 
 void nicklist_rename(SERVER_REC *server, const char *old_nick,
 		     const char *new_nick)
 {
-	nicklist_rename_list(server, NULL, old_nick, new_nick,
-			     nicklist_get_same(server, old_nick));
+	NICK_USER_REC *user, *next;
+
+	g_return_if_fail(IS_SERVER(server));
+	g_return_if_fail(old_nick != NULL);
+	g_return_if_fail(new_nick != NULL);
+
+	if (server->nicklist_users == NULL)
+		return;
+
+	user = g_hash_table_lookup(server->nicklist_users, old_nick);
+	for (; user != NULL; user = next) {
+		next = user->next;
+		nicklist_rename_user(server, user, NULL, old_nick, new_nick);
+	}
 }
 
 void nicklist_rename_unique(SERVER_REC *server,
 			    void *old_nick_id, const char *old_nick,
 			    void *new_nick_id, const char *new_nick)
 {
-	nicklist_rename_list(server, new_nick_id, old_nick, new_nick,
-			     nicklist_get_same_unique(server, old_nick_id));
+	NICK_USER_REC *user;
+
+	g_return_if_fail(IS_SERVER(server));
+	g_return_if_fail(old_nick != NULL);
+	g_return_if_fail(new_nick != NULL);
+
+	user = nick_user_find(server, old_nick, old_nick_id);
+	if (user != NULL) {
+		nicklist_rename_user(server, user, new_nick_id,
+				     old_nick, new_nick);
+	}
 }
 
 static NICK_REC *nicklist_find_wildcards(CHANNEL_REC *channel,
@@ -178,7 +351,7 @@ static NICK_REC *nicklist_find_wildcards(CHANNEL_REC *channel,
 		nick = tmp->data;
 
 		if (mask_match_address(channel->server, mask,
-				       nick->nick, nick->host))
+				       nick->nick, nick->user->host))
 			break;
 	}
 	g_slist_free(nicks);
@@ -198,7 +371,7 @@ GSList *nicklist_find_multiple(CHANNEL_REC *channel, const char *mask)
 
 		next = tmp->next;
 		if (!mask_match_address(channel->server, mask,
-					nick->nick, nick->host))
+					nick->nick, nick->user->host))
                         nicks = g_slist_remove(nicks, tmp->data);
 	}
 
@@ -251,8 +424,8 @@ NICK_REC *nicklist_find_mask(CHANNEL_REC *channel, const char *mask)
 
 	if (host != NULL) {
 		while (nickrec != NULL) {
-			if (nickrec->host != NULL &&
-			    match_wildcards(host, nickrec->host))
+			if (nickrec->user->host != NULL &&
+			    match_wildcards(host, nickrec->user->host))
 				break; /* match */
 			nickrec = nickrec->next;
 		}
@@ -281,79 +454,67 @@ GSList *nicklist_getnicks(CHANNEL_REC *channel)
 	return list;
 }
 
-typedef struct {
-        CHANNEL_REC *channel;
-	const char *nick;
-	GSList *list;
-} NICKLIST_GET_SAME_REC;
-
-static void get_nicks_same_hash(gpointer key, NICK_REC *nick,
-				NICKLIST_GET_SAME_REC *rec)
-{
-	while (nick != NULL) {
-		if (g_strcasecmp(nick->nick, rec->nick) == 0) {
-			rec->list = g_slist_append(rec->list, rec->channel);
-			rec->list = g_slist_append(rec->list, nick);
-		}
-
-		nick = nick->next;
-	}
-}
-
 GSList *nicklist_get_same(SERVER_REC *server, const char *nick)
 {
-	NICKLIST_GET_SAME_REC rec;
-	GSList *tmp;
+	NICK_USER_REC *user;
+	GSList *list;
 
 	g_return_val_if_fail(IS_SERVER(server), NULL);
 
-	rec.nick = nick;
-	rec.list = NULL;
-	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
-		rec.channel = tmp->data;
-		g_hash_table_foreach(rec.channel->nicks,
-				     (GHFunc) get_nicks_same_hash, &rec);
-	}
-	return rec.list;
+	if (server->nicklist_users == NULL)
+		return NULL;
+
+	list = NULL;
+	user = g_hash_table_lookup(server->nicklist_users, nick);
+	for (; user != NULL; user = user->next)
+		list = g_slist_concat(list, g_slist_copy(user->nicks));
+	return list;
 }
 
 typedef struct {
-	CHANNEL_REC *channel;
         void *id;
 	GSList *list;
 } NICKLIST_GET_SAME_UNIQUE_REC;
 
-static void get_nicks_same_hash_unique(gpointer key, NICK_REC *nick,
-				       NICKLIST_GET_SAME_UNIQUE_REC *rec)
+static void get_users_same_unique(gpointer key, NICK_USER_REC *user,
+				  NICKLIST_GET_SAME_UNIQUE_REC *rec)
 {
-	while (nick != NULL) {
-		if (nick->unique_id == rec->id) {
-			rec->list = g_slist_append(rec->list, rec->channel);
-			rec->list = g_slist_append(rec->list, nick);
-                        break;
-		}
+	for (; user != NULL; user = user->next) {
+		if (user->unique_id == rec->id)
+			rec->list = g_slist_append(rec->list, user);
+	}
+}
+
+/* Get the users with `id', usually there's only one */
+static GSList *nick_users_find_unique(SERVER_REC *server, void *id)
+{
+	NICKLIST_GET_SAME_UNIQUE_REC rec;
 
-                nick = nick->next;
+        rec.id = id;
+	rec.list = NULL;
+	if (server->nicklist_users != NULL) {
+		g_hash_table_foreach(server->nicklist_users,
+				     (GHFunc) get_users_same_unique, &rec);
 	}
+	return rec.list;
 }
 
 GSList *nicklist_get_same_unique(SERVER_REC *server, void *id)
 {
-	NICKLIST_GET_SAME_UNIQUE_REC rec;
-	GSList *tmp;
+	NICK_USER_REC *user;
+	GSList *users, *tmp, *list;
 
 	g_return_val_if_fail(IS_SERVER(server), NULL);
 	g_return_val_if_fail(id != NULL, NULL);
 
-        rec.id = id;
-	rec.list = NULL;
-	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
-		rec.channel = tmp->data;
-		g_hash_table_foreach(rec.channel->nicks,
-				     (GHFunc) get_nicks_same_hash_unique,
-				     &rec);
+	list = NULL;
+	users = nick_users_find_unique(server, id);
+	for (tmp = users; tmp != NULL; tmp = tmp->next) {
+		user = tmp->data;
+		list = g_slist_concat(list, g_slist_copy(user->nicks));
 	}
-	return rec.list;
+	g_slist_free(users);
+	return list;
 }
 
 /* nick record comparision for sort functions */
@@ -387,46 +548,53 @@ int nicklist_compare(NICK_REC *p1, NICK_REC *p2, const char *nick_prefix)
 	return g_strcasecmp(p1->nick, p2->nick);
 }
 
-static void nicklist_update_flags_list(SERVER_REC *server, int gone,
-				       int serverop, GSList *nicks)
+/* The status is the user's, so it's changed once for all the channels */
+static void nicklist_update_flags_user(NICK_USER_REC *user, int gone,
+				       int serverop)
 {
-	GSList *tmp;
-	CHANNEL_REC *channel;
-	NICK_REC *rec;
-
-	g_return_if_fail(IS_SERVER(server));
-
-	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
-		channel = tmp->data;
-		rec = tmp->next->data;
+	user->last_check = time(NULL);
 
-		rec->last_check = time(NULL);
-
-		if (gone != -1 && (int)rec->gone != gone) {
-			rec->gone = gone;
-			signal_emit("nicklist gone changed", 2, channel, rec);
-		}
+	if (gone != -1 && (int)user->gone != gone) {
+		user->gone = gone;
+		nick_user_signal(user, "nicklist gone changed");
+	}
 
-		if (serverop != -1 && (int)rec->serverop != serverop) {
-			rec->serverop = serverop;
-			signal_emit("nicklist serverop changed", 2, channel, rec);
-		}
+	if (serverop != -1 && (int)user->serverop != serverop) {
+		user->serverop = serverop;
+		nick_user_signal(user, "nicklist serverop changed");
 	}
-	g_slist_free(nicks);
 }
 
 void nicklist_update_flags(SERVER_REC *server, const char *nick,
 			   int gone, int serverop)
 {
-	nicklist_update_flags_list(server, gone, serverop,
-				   nicklist_get_same(server, nick));
+	NICK_USER_REC *user, *next;
+
+	g_return_if_fail(IS_SERVER(server));
+	g_return_if_fail(nick != NULL);
+
+	if (server->nicklist_users == NULL)
+		return;
+
+	user = g_hash_table_lookup(server->nicklist_users, nick);
+	for (; user != NULL; user = next) {
+		next = user->next;
+		nicklist_update_flags_user(user, gone, serverop);
+	}
 }
 
 void nicklist_update_flags_unique(SERVER_REC *server, void *id,
 				  int gone, int serverop)
 {
-	nicklist_update_flags_list(server, gone, serverop,
-				   nicklist_get_same_unique(server, id));
+	GSList *users, *tmp;
+
+	g_return_if_fail(IS_SERVER(server));
+	g_return_if_fail(id != NULL);
+
+	users = nick_users_find_unique(server, id);
+	for (tmp = users; tmp != NULL; tmp = tmp->next)
+		nicklist_update_flags_user(tmp->data, gone, serverop);
+	g_slist_free(users);
 }
 
 /* Specify which nick in channel is ours */
@@ -449,7 +617,9 @@ void nicklist_set_own(CHANNEL_REC *channel, NICK_REC *nick)
                 first = first->next;
 	first->next = next;
 
-        g_hash_table_insert(channel->nicks, nick->nick, nick);
+	/* the old first nick's string may be a different user's,
+	   don't keep it as the key */
+	g_hash_table_replace(channel->nicks, nick->nick, nick);
 }
 
 static void sig_channel_created(CHANNEL_REC *channel)
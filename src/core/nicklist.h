@@ -14,10 +14,33 @@ struct _NICK_REC {
 #include "nick-rec.h"
 };
 
-/* Add new nick to list */
+/* A user in the server's channels. All the user's nick records point to
+   the same NICK_USER_REC, so its host and status are stored and updated
+   only once. */
+struct _NICK_USER_REC {
+	char *nick;
+	char *host;
+	char *realname;
+	int hops;
+
+	time_t last_check; /* last time gone was checked */
+	unsigned int gone:1;
+	unsigned int serverop:1;
+
+	void *unique_id; /* unique_id of the nick records */
+	GSList *nicks; /* channel, nick, channel, nick, ... */
+	NICK_USER_REC *next; /* other users with the same nick */
+};
+
+/* Add new nick to list. The nick record is attached to the server's
+   NICK_USER_REC with the same nick and unique_id, which is created if
+   the user isn't in any other channel yet. */
 void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick);
-/* Set host address for nick */
+/* Set host address for nick, in all the channels it's in */
 void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick, const char *host);
+/* Set real name for nick, in all the channels it's in */
+void nicklist_set_realname(CHANNEL_REC *channel, NICK_REC *nick,
+			   const char *realname);
 /* Remove nick from list */
 void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick);
 /* Change nick */
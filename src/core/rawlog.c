@@ -49,7 +49,7 @@ void rawlog_destroy(RAWLOG_REC *rawlog)
 	g_slist_free(rawlog->lines);
 
 	if (rawlog->logging) {
-		write_buffer_flush();
+		write_buffer_flush_handle(rawlog->handle);
 		close(rawlog->handle);
 	}
 	g_free(rawlog);
@@ -131,7 +131,7 @@ void rawlog_open(RAWLOG_REC *rawlog, const char *fname)
 void rawlog_close(RAWLOG_REC *rawlog)
 {
 	if (rawlog->logging) {
-		write_buffer_flush();
+		write_buffer_flush_handle(rawlog->handle);
 		close(rawlog->handle);
 		rawlog->logging = 0;
 	}
@@ -17,7 +17,6 @@
     with this program; if not, write to the Free Software Foundation, Inc.,
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
-
 #include "module.h"
 #include "settings.h"
 #include "servers.h"
@@ -25,9 +24,32 @@
 #include "lib-config/iconfig.h"
 #include "misc.h"
 
+/* drop the caches if they grow past these, they're rebuilt on demand */
+#define RECODE_MAX_TARGETS 1024
+#define RECODE_MAX_CONVERTERS 32
+
+/* every byte has its high bit set */
+#define WORD_HIGH_BITS (((gulong) -1 / 0xff) * 0x80)
+
+typedef struct {
+	GIConv cd; /* (GIConv) -1 if the conversion isn't supported */
+	unsigned int ascii_identity:1; /* 7bit text passes through unchanged */
+} RECODE_CONV_REC;
+
+typedef struct {
+	char *conv; /* /RECODE charset for the target, or NULL */
+	char *out; /* charset for outgoing text, or NULL to send as is */
+} RECODE_TARGET_REC;
+
 static char *translit_charset;
 static gboolean term_is_utf8;
 
+static int recode, recode_transliterate, recode_autodetect_utf8;
+static char *recode_fallback, *recode_out_default_charset;
+
+static GHashTable *converters, *targets;
+static GString *target_key;
+
 gboolean is_utf8(void)
 {
 	return term_is_utf8;
@@ -61,9 +83,108 @@ gboolean is_valid_charset(const char *charset)
 	return FALSE;
 }
 
-static char *find_conversion(const SERVER_REC *server, const char *target)
+static int cache_remove(void *key, void *value)
+{
+	return TRUE;
+}
+
+static void cache_clear(GHashTable *cache)
+{
+	g_hash_table_foreach_remove(cache, (GHRFunc) cache_remove, NULL);
+}
+
+static void converter_destroy(RECODE_CONV_REC *rec)
+{
+	if (rec->cd != (GIConv) -1)
+		g_iconv_close(rec->cd);
+	g_free(rec);
+}
+
+static void target_destroy(RECODE_TARGET_REC *rec)
+{
+	g_free(rec->conv);
+	g_free(rec->out);
+	g_free(rec);
+}
+
+/* Check if the converter leaves 7bit text untouched, so plain ASCII
+   strings don't need to go through it at all. ESC is left out since
+   it's what switches the state in ISO-2022 style charsets. */
+static int converter_check_ascii(GIConv cd)
+{
+	char in[127], *out;
+	gsize len, out_len;
+	int i;
+
+	for (i = 1, len = 0; i < 128; i++) {
+		if (i != '\e')
+			in[len++] = i;
+	}
+
+	out = g_convert_with_iconv(in, len, cd, NULL, &out_len, NULL);
+	g_iconv(cd, NULL, NULL, NULL, NULL);
+
+	i = out != NULL && out_len == len && memcmp(in, out, len) == 0;
+	g_free(out);
+	return i;
+}
+
+static RECODE_CONV_REC *converter_get(const char *to, const char *from)
+{
+	RECODE_CONV_REC *rec;
+	char *key;
+
+	key = g_strconcat(to, "\n", from, NULL);
+	rec = g_hash_table_lookup(converters, key);
+	if (rec != NULL) {
+		g_free(key);
+		return rec;
+	}
+
+	if (g_hash_table_size(converters) >= RECODE_MAX_CONVERTERS)
+		cache_clear(converters);
+
+	rec = g_new0(RECODE_CONV_REC, 1);
+	rec->cd = g_iconv_open(to, from);
+	if (rec->cd != (GIConv) -1)
+		rec->ascii_identity = converter_check_ascii(rec->cd);
+	g_hash_table_insert(converters, key, rec);
+	return rec;
+}
+
+/* g_convert() with a cached iconv handle */
+static char *recode_convert(const char *str, int len, const char *to,
+			    const char *from, int fallback)
+{
+	RECODE_CONV_REC *conv;
+	GError *error;
+	char *recoded;
+
+	conv = converter_get(to, from);
+	if (conv->cd == (GIConv) -1)
+		return NULL;
+
+	/* reset the state, a failed conversion may have left it dirty */
+	g_iconv(conv->cd, NULL, NULL, NULL, NULL);
+
+	error = NULL;
+	recoded = g_convert_with_iconv(str, len, conv->cd, NULL, NULL, &error);
+	if (recoded != NULL)
+		return recoded;
+
+	if (fallback && error->code == G_CONVERT_ERROR_ILLEGAL_SEQUENCE) {
+		/* characters that can't be represented in the target
+		   charset, let glib escape them */
+		recoded = g_convert_with_fallback(str, len, to, from,
+						  NULL, NULL, NULL, NULL);
+	}
+	g_error_free(error);
+	return recoded;
+}
+
+static const char *find_conversion_config(const SERVER_REC *server, const char *target)
 {
-	char *conv = NULL;
+	const char *conv = NULL;
 
 	if (server != NULL && target != NULL) {
 		char *tagtarget = g_strdup_printf("%s/%s", server->tag, target);
@@ -77,12 +198,57 @@ static char *find_conversion(const SERVER_REC *server, const char *target)
 	return conv;
 }
 
-static int str_is_ascii(const char *str)
+/* Resolve the charsets for server/target, the results are cached until
+   the settings or /RECODE conversions change. */
+static RECODE_TARGET_REC *find_conversion(const SERVER_REC *server, const char *target)
 {
-	int i;
+	RECODE_TARGET_REC *rec;
+	const char *out;
+
+	g_string_truncate(target_key, 0);
+	if (server != NULL)
+		g_string_append(target_key, server->tag);
+	g_string_append_c(target_key, '\n');
+	if (target != NULL)
+		g_string_append(target_key, target);
+	ascii_strdown(target_key->str);
+
+	rec = g_hash_table_lookup(targets, target_key->str);
+	if (rec != NULL)
+		return rec;
+
+	if (g_hash_table_size(targets) >= RECODE_MAX_TARGETS)
+		cache_clear(targets);
+
+	rec = g_new0(RECODE_TARGET_REC, 1);
+	rec->conv = g_strdup(find_conversion_config(server, target));
+
+	/* default outgoing charset if set */
+	out = rec->conv != NULL ? rec->conv : recode_out_default_charset;
+	if (out != NULL && *out != '\0') {
+		rec->out = recode_transliterate && !is_translit(out) ?
+			g_strconcat(out, "//TRANSLIT", NULL) : g_strdup(out);
+	}
+
+	g_hash_table_insert(targets, g_strdup(target_key->str), rec);
+	return rec;
+}
+
+static int str_is_ascii(const char *str, int len)
+{
+	const unsigned char *p = (const unsigned char *) str;
+	gulong word;
 
-	for (i = 0; str[i] != '\0'; i++)
-		if (str[i] & 0x80)
+	/* a word at a time, compilers turn this into vector code */
+	for (; len >= (int) sizeof(word); len -= sizeof(word)) {
+		memcpy(&word, p, sizeof(word));
+		if (word & WORD_HIGH_BITS)
+			return 0;
+		p += sizeof(word);
+	}
+
+	for (; len > 0; len--, p++)
+		if (*p & 0x80)
 			return 0;
 	return 1;
 }
@@ -92,36 +258,38 @@ char *recode_in(const SERVER_REC *server, const char *str, const char *target)
 	const char *from = NULL;
 	const char *to = translit_charset;
 	char *recoded = NULL;
-	gboolean str_is_utf8, recode, autodetect;
+	gboolean str_is_utf8, is7bit, ascii;
 	int len;
 
 	if (!str)
 		return NULL;
 
-	recode = settings_get_bool("recode");
 	if (!recode)
 		return g_strdup(str);
 
 	len = strlen(str);
 
 	/* Only validate for UTF-8 if an 8-bit encoding. */
-	str_is_utf8 = 0;
-	if (!str_is_ascii(str))
+	is7bit = str_is_ascii(str, len);
+	ascii = is7bit && memchr(str, '\e', len) == NULL;
+	if (!is7bit)
 		str_is_utf8 = g_utf8_validate(str, len, NULL);
-	else if (!strchr(str, '\e'))
-		str_is_utf8 = 1;
-	autodetect = settings_get_bool("recode_autodetect_utf8");
+	else
+		str_is_utf8 = ascii;
 
-	if (autodetect && str_is_utf8)
+	if (recode_autodetect_utf8 && str_is_utf8)
 		if (term_is_utf8)
 			return g_strdup(str);
 		else
 			from = "UTF-8";
 	else
-		from = find_conversion(server, target);
+		from = find_conversion(server, target)->conv;
 
-	if (from)
-		recoded = g_convert_with_fallback(str, len, to, from, NULL, NULL, NULL, NULL);
+	if (from) {
+		if (ascii && converter_get(to, from)->ascii_identity)
+			return g_strdup(str);
+		recoded = recode_convert(str, len, to, from, TRUE);
+	}
 
 	if (!recoded) {
 		if (str_is_utf8)
@@ -131,12 +299,12 @@ char *recode_in(const SERVER_REC *server, const char *str, const char *target)
 				from = "UTF-8";
 		else
 			if (term_is_utf8)
-				from = settings_get_str("recode_fallback");
+				from = recode_fallback;
 			else
 				from = NULL;
 
 		if (from)
-			recoded = g_convert_with_fallback(str, len, to, from, NULL, NULL, NULL, NULL);
+			recoded = recode_convert(str, len, to, from, TRUE);
 
 		if (!recoded)
 			recoded = g_strdup(str);
@@ -148,40 +316,36 @@ char *recode_out(const SERVER_REC *server, const char *str, const char *target)
 {
 	char *recoded = NULL;
 	const char *from = translit_charset;
-	const char *to = NULL;
-	char *translit_to = NULL;
-	gboolean translit, recode;
+	const char *to;
 	int len;
 
 	if (!str)
 		return NULL;
 
-	recode = settings_get_bool("recode");
 	if (!recode)
 		return g_strdup(str);
 
-	len = strlen(str);
-
-	translit = settings_get_bool("recode_transliterate");
-
-	to = find_conversion(server, target);
+	to = find_conversion(server, target)->out;
 	if (to == NULL)
-		/* default outgoing charset if set */
-		to = settings_get_str("recode_out_default_charset");
+		return g_strdup(str);
 
-	if (to && *to != '\0') {
-		if (translit && !is_translit(to))
-			to = translit_to = g_strconcat(to ,"//TRANSLIT", NULL);
+	len = strlen(str);
+	if (converter_get(to, from)->ascii_identity &&
+	    str_is_ascii(str, len) && memchr(str, '\e', len) == NULL)
+		return g_strdup(str);
 
-		recoded = g_convert(str, len, to, from, NULL, NULL, NULL);
-	}
-	g_free(translit_to);
+	recoded = recode_convert(str, len, to, from, FALSE);
 	if (!recoded)
 		recoded = g_strdup(str);
 
 	return recoded;
 }
 
+void recode_conversions_changed(void)
+{
+	cache_clear(targets);
+}
+
 void recode_update_charset(void)
 {
 	const char *charset = settings_get_str("term_charset");
@@ -193,16 +357,52 @@ void recode_update_charset(void)
 		translit_charset = g_strdup(charset);
 }
 
+static void read_settings(void)
+{
+	recode = settings_get_bool("recode");
+	recode_transliterate = settings_get_bool("recode_transliterate");
+	recode_autodetect_utf8 = settings_get_bool("recode_autodetect_utf8");
+
+	g_free(recode_fallback);
+	recode_fallback = g_strdup(settings_get_str("recode_fallback"));
+	g_free(recode_out_default_charset);
+	recode_out_default_charset =
+		g_strdup(settings_get_str("recode_out_default_charset"));
+
+	recode_update_charset();
+
+	/* the config may have been reloaded too */
+	cache_clear(targets);
+	cache_clear(converters);
+}
+
 void recode_init(void)
 {
+	converters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					   (GDestroyNotify) converter_destroy);
+	targets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					(GDestroyNotify) target_destroy);
+	target_key = g_string_new(NULL);
+
 	settings_add_bool("misc", "recode", TRUE);
 	settings_add_str("misc", "recode_fallback", "CP1252");
 	settings_add_str("misc", "recode_out_default_charset", "");
 	settings_add_bool("misc", "recode_transliterate", TRUE);
 	settings_add_bool("misc", "recode_autodetect_utf8", TRUE);
+
+	read_settings();
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 }
 
 void recode_deinit(void)
 {
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+
+	g_hash_table_destroy(converters);
+	g_hash_table_destroy(targets);
+	g_string_free(target_key, TRUE);
+
+	g_free(recode_fallback);
+	g_free(recode_out_default_charset);
 	g_free(translit_charset);
 }
@@ -6,6 +6,8 @@ char *recode_out (const SERVER_REC *server, const char *str, const char *target)
 gboolean is_valid_charset(const char *charset);
 gboolean is_utf8(void);
 void recode_update_charset(void);
+/* forget the cached charsets after "conversions" config changes */
+void recode_conversions_changed(void);
 
 void recode_init (void);
 void recode_deinit (void);
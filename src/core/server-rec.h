@@ -43,6 +43,8 @@ int lag; /* server lag in milliseconds */
 
 GSList *channels;
 GSList *queries;
+/* nick => NICK_USER_REC of the users in all the channels */
+GHashTable *nicklist_users;
 
 /* -- support for multiple server types -- */
 
@@ -34,6 +34,7 @@
 #include "servers-setup.h"
 #include "channels.h"
 #include "queries.h"
+#include "nicklist.h"
 
 GSList *servers, *lookup_servers;
 
@@ -519,6 +520,20 @@ void server_ref(SERVER_REC *server)
 	server->refcount++;
 }
 
+static void nicklist_users_free(char *key, NICK_USER_REC *user)
+{
+	NICK_USER_REC *next;
+
+	for (; user != NULL; user = next) {
+		next = user->next;
+		g_slist_free(user->nicks);
+		g_free_not_null(user->host);
+		g_free_not_null(user->realname);
+		g_free(user->nick);
+		g_free(user);
+	}
+}
+
 int server_unref(SERVER_REC *server)
 {
 	g_return_val_if_fail(IS_SERVER(server), FALSE);
@@ -533,6 +548,11 @@ int server_unref(SERVER_REC *server)
 	}
 
         MODULE_DATA_DEINIT(server);
+	if (server->nicklist_users != NULL) {
+		g_hash_table_foreach(server->nicklist_users,
+				     (GHFunc) nicklist_users_free, NULL);
+		g_hash_table_destroy(server->nicklist_users);
+	}
 	server_connect_unref(server->connrec);
 	if (server->rawlog != NULL) rawlog_destroy(server->rawlog);
 	g_free(server->version);
@@ -21,14 +21,16 @@
 #include "module.h"
 #include "signals.h"
 #include "modules.h"
+#include "misc.h"
 
 typedef struct _SignalHook {
-	struct _SignalHook *next;
-
         int priority;
 	const char *module;
 	SIGNAL_FUNC func;
 	void *user_data;
+
+	unsigned long calls; /* statistics */
+	unsigned long usecs;
 } SignalHook;
 
 typedef struct {
@@ -40,46 +42,69 @@ typedef struct {
 	int continue_emit; /* this signal emit was continued elsewhere */
         int remove_count; /* hooks were removed from signal */
 
-        SignalHook *hooks;
+	/* NULL-terminated array of hooks in priority order. the array is
+	   never modified, a new one is created whenever hooks are added
+	   or removed. if the signal is being emitted, the old arrays are
+	   kept in old_hooks until the emitting is done. */
+        SignalHook **hooks;
+	int hooks_count;
+	GSList *old_hooks;
+
+	unsigned long emits; /* statistics */
+	unsigned long usecs;
 } Signal;
 
 void *signal_user_data;
 
-static GHashTable *signals;
+/* signals indexed by their ID */
+static Signal **signals;
+static int signals_size;
+
 static Signal *current_emitted_signal;
-static SignalHook *current_emitted_hook;
+static SignalHook **current_emitted_hook;
+
+static int signal_stats_enabled;
+
+#define signal_find(id) \
+	((id) < signals_size ? signals[id] : NULL)
 
 #define signal_ref(signal) ++(signal)->refcount
-#define signal_unref(signal) (signal_unref_full(signal, TRUE))
 
-static int signal_unref_full(Signal *rec, int remove)
+static void signal_unref(Signal *rec)
 {
         g_assert(rec->refcount > 0);
 
 	if (--rec->refcount != 0)
-		return TRUE;
+		return;
 
 	/* remove whole signal from memory */
-	if (rec->hooks != NULL) {
+	if (rec->hooks_count > 0) {
 		g_error("signal_unref(%s) : BUG - hook list wasn't empty",
 			signal_get_id_str(rec->id));
 	}
 
-	if (remove)
-		g_hash_table_remove(signals, GINT_TO_POINTER(rec->id));
+	signals[rec->id] = NULL;
+	g_free(rec->hooks);
         g_free(rec);
-
-	return FALSE;
 }
 
-static void signal_hash_ref(void *key, Signal *rec)
+/* Replace the hook array of signal with `hooks' */
+static void signal_set_hooks(Signal *rec, SignalHook **hooks, int count)
 {
-	signal_ref(rec);
+	if (rec->emitting)
+		rec->old_hooks = g_slist_prepend(rec->old_hooks, rec->hooks);
+	else
+		g_free(rec->hooks);
+
+	rec->hooks = hooks;
+	rec->hooks_count = count;
 }
 
-static int signal_hash_unref(void *key, Signal *rec)
+static void signal_free_old_hooks(Signal *rec)
 {
-	return !signal_unref_full(rec, FALSE);
+	g_slist_foreach(rec->old_hooks, (GFunc) g_free, NULL);
+	g_slist_free(rec->old_hooks);
+	rec->old_hooks = NULL;
 }
 
 void signal_add_full(const char *module, int priority,
@@ -94,17 +119,25 @@ void signal_add_full_id(const char *module, int priority,
 			int signal_id, SIGNAL_FUNC func, void *user_data)
 {
 	Signal *signal;
-        SignalHook *hook, **tmp;
+        SignalHook *hook, **hooks;
+	int i, pos;
 
 	g_return_if_fail(signal_id >= 0);
 	g_return_if_fail(func != NULL);
 
-	signal = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	signal = signal_find(signal_id);
 	if (signal == NULL) {
                 /* new signal */
+		if (signal_id >= signals_size) {
+			i = signals_size;
+			signals_size = nearest_power(signal_id+1);
+			signals = g_renew(Signal *, signals, signals_size);
+			memset(signals+i, 0, (signals_size-i)*sizeof(Signal *));
+		}
+
 		signal = g_new0(Signal, 1);
 		signal->id = signal_id;
-		g_hash_table_insert(signals, GINT_TO_POINTER(signal_id), signal);
+		signals[signal_id] = signal;
 	}
 
 	hook = g_new0(SignalHook, 1);
@@ -113,50 +146,76 @@ void signal_add_full_id(const char *module, int priority,
 	hook->func = func;
 	hook->user_data = user_data;
 
-	/* insert signal to proper position in list */
-	for (tmp = &signal->hooks; ; tmp = &(*tmp)->next) {
-		if (*tmp == NULL) {
-                        /* last in list */
-			*tmp = hook;
-                        break;
-		} else if (priority <= (*tmp)->priority) {
-                        /* insert before others with same priority */
-			hook->next = *tmp;
-			*tmp = hook;
-                        break;
-		}
+	/* insert signal to proper position in list,
+	   before others with same priority */
+	for (pos = 0; pos < signal->hooks_count; pos++) {
+		if (priority <= signal->hooks[pos]->priority)
+			break;
 	}
 
+	hooks = g_new(SignalHook *, signal->hooks_count+2);
+	for (i = 0; i < pos; i++)
+		hooks[i] = signal->hooks[i];
+	hooks[pos] = hook;
+	for (i = pos; i < signal->hooks_count; i++)
+		hooks[i+1] = signal->hooks[i];
+	hooks[signal->hooks_count+1] = NULL;
+
+	signal_set_hooks(signal, hooks, signal->hooks_count+1);
         signal_ref(signal);
 }
 
-static void signal_remove_hook(Signal *rec, SignalHook **hook_pos)
+/* Remove all hooks whose function is NULL */
+static void signal_hooks_clean(Signal *rec)
 {
-	SignalHook *hook;
+	SignalHook **hooks;
+	int i, count;
+
+	hooks = g_new(SignalHook *, rec->hooks_count+1);
+	for (i = count = 0; i < rec->hooks_count; i++) {
+		if (rec->hooks[i]->func != NULL)
+			hooks[count++] = rec->hooks[i];
+	}
+	hooks[count] = NULL;
+
+	/* free the removed hooks before signal_set_hooks() frees
+	   the old array */
+	for (i = 0; i < rec->hooks_count; i++) {
+		if (rec->hooks[i]->func == NULL)
+			g_free(rec->hooks[i]);
+	}
 
-        hook = *hook_pos;
-        *hook_pos = hook->next;
+	i = rec->hooks_count - count;
+	rec->remove_count = 0;
+	signal_set_hooks(rec, hooks, count);
 
-	g_free(hook);
+	while (i-- > 0)
+		signal_unref(rec);
+}
 
-	signal_unref(rec);
+/* Remove the hook at `pos' from signal, or if signal is being emitted,
+   mark it to be removed after emitting is done */
+static void signal_remove_hook(Signal *rec, int pos)
+{
+	if (rec->emitting) {
+		rec->hooks[pos]->func = NULL;
+		rec->remove_count++;
+	} else {
+		rec->hooks[pos]->func = NULL;
+		signal_hooks_clean(rec);
+	}
 }
 
 /* Remove function from signal's emit list */
 static int signal_remove_func(Signal *rec, SIGNAL_FUNC func, void *user_data)
 {
-        SignalHook **hook;
-
-	for (hook = &rec->hooks; *hook != NULL; hook = &(*hook)->next) {
-		if ((*hook)->func == func && (*hook)->user_data == user_data) {
-			if (rec->emitting) {
-				/* mark it removed after emitting is done */
-				(*hook)->func = NULL;
-                                rec->remove_count++;
-			} else {
-				/* remove the function from emit list */
-				signal_remove_hook(rec, hook);
-			}
+	int i;
+
+	for (i = 0; i < rec->hooks_count; i++) {
+		SignalHook *hook = rec->hooks[i];
+
+		if (hook->func == func && hook->user_data == user_data) {
+			signal_remove_hook(rec, i);
 			return TRUE;
 		}
 	}
@@ -171,7 +230,7 @@ void signal_remove_id(int signal_id, SIGNAL_FUNC func, void *user_data)
 	g_return_if_fail(signal_id >= 0);
 	g_return_if_fail(func != NULL);
 
-	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	rec = signal_find(signal_id);
         if (rec != NULL)
                 signal_remove_func(rec, func, user_data);
 }
@@ -184,33 +243,19 @@ void signal_remove_full(const char *signal, SIGNAL_FUNC func, void *user_data)
 	signal_remove_id(signal_get_uniq_id(signal), func, user_data);
 }
 
-static void signal_hooks_clean(Signal *rec)
+static long get_usecs_diff(const GTimeVal *tv1, const GTimeVal *tv2)
 {
-	SignalHook **hook, **next;
-        int count;
-
-        count = rec->remove_count;
-        rec->remove_count = 0;
-
-	for (hook = &rec->hooks; *hook != NULL; hook = next) {
-		next = &(*hook)->next;
-
-		if ((*hook)->func == NULL) {
-                        next = hook;
-			signal_remove_hook(rec, hook);
-
-			if (--count == 0)
-                                break;
-		}
-	}
+	return (tv1->tv_sec - tv2->tv_sec) * 1000000 +
+		(tv1->tv_usec - tv2->tv_usec);
 }
 
 static int signal_emit_real(Signal *rec, int params, va_list va,
-			    SignalHook *first_hook)
+			    SignalHook **first_hook)
 {
 	const void *arglist[SIGNAL_MAX_ARGUMENTS];
 	Signal *prev_emitted_signal;
-        SignalHook *hook, *prev_emitted_hook;
+        SignalHook *hook, **hookp, **prev_emitted_hook;
+	GTimeVal start, end;
 	int i, stopped, stop_emit_count, continue_emit_count;
 
 	for (i = 0; i < SIGNAL_MAX_ARGUMENTS; i++)
@@ -225,16 +270,20 @@ static int signal_emit_real(Signal *rec, int params, va_list va,
 
 	stopped = FALSE;
 	rec->emitting++;
+	rec->emits++;
 
 	prev_emitted_signal = current_emitted_signal;
 	prev_emitted_hook = current_emitted_hook;
 	current_emitted_signal = rec;
 
-	for (hook = first_hook; hook != NULL; hook = hook->next) {
+	for (hookp = first_hook; *hookp != NULL; hookp++) {
+		hook = *hookp;
 		if (hook->func == NULL)
 			continue; /* removed */
 
-		current_emitted_hook = hook;
+		current_emitted_hook = hookp;
+		if (signal_stats_enabled)
+			g_get_current_time(&start);
 #if SIGNAL_MAX_ARGUMENTS != 6
 #  error SIGNAL_MAX_ARGUMENTS changed - update code
 #endif
@@ -242,6 +291,13 @@ static int signal_emit_real(Signal *rec, int params, va_list va,
 		hook->func(arglist[0], arglist[1], arglist[2], arglist[3],
 			   arglist[4], arglist[5]);
 
+		if (signal_stats_enabled) {
+			g_get_current_time(&end);
+			hook->calls++;
+			hook->usecs += get_usecs_diff(&end, &start);
+			rec->usecs += get_usecs_diff(&end, &start);
+		}
+
 		if (rec->continue_emit != continue_emit_count)
 			rec->continue_emit--;
 
@@ -264,6 +320,8 @@ static int signal_emit_real(Signal *rec, int params, va_list va,
 
                 if (rec->remove_count > 0)
 			signal_hooks_clean(rec);
+		if (rec->old_hooks != NULL)
+			signal_free_old_hooks(rec);
 	}
 
         signal_unref(rec);
@@ -280,7 +338,7 @@ int signal_emit(const char *signal, int params, ...)
 
 	signal_id = signal_get_uniq_id(signal);
 
-	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	rec = signal_find(signal_id);
 	if (rec != NULL) {
 		va_start(va, params);
 		signal_emit_real(rec, params, va, rec->hooks);
@@ -298,7 +356,7 @@ int signal_emit_id(int signal_id, int params, ...)
 	g_return_val_if_fail(signal_id >= 0, FALSE);
 	g_return_val_if_fail(params >= 0 && params <= SIGNAL_MAX_ARGUMENTS, FALSE);
 
-	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	rec = signal_find(signal_id);
 	if (rec != NULL) {
 		va_start(va, params);
 		signal_emit_real(rec, params, va, rec->hooks);
@@ -325,7 +383,7 @@ void signal_continue(int params, ...)
 
 		/* re-emit */
 		rec->continue_emit++;
-		signal_emit_real(rec, params, va, current_emitted_hook->next);
+		signal_emit_real(rec, params, va, current_emitted_hook+1);
 		va_end(va);
 	}
 }
@@ -349,7 +407,7 @@ void signal_stop_by_name(const char *signal)
 	int signal_id;
 
 	signal_id = signal_get_uniq_id(signal);
-	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	rec = signal_find(signal_id);
 	if (rec == NULL)
 		g_warning("signal_stop_by_name() : unknown signal \"%s\"", signal);
 	else if (rec->emitting > rec->stop_emit)
@@ -377,63 +435,145 @@ int signal_is_stopped(int signal_id)
 {
 	Signal *rec;
 
-	rec = g_hash_table_lookup(signals, GINT_TO_POINTER(signal_id));
+	rec = signal_find(signal_id);
 	g_return_val_if_fail(rec != NULL, FALSE);
 
         return rec->emitting <= rec->stop_emit;
 }
 
-static void signal_remove_module(void *signal, Signal *rec,
-				 const char *module)
+/* remove all signals that belong to `module' */
+void signals_remove_module(const char *module)
 {
-	SignalHook **hook, **next;
+	Signal *rec;
+	int id, i;
+
+	g_return_if_fail(module != NULL);
+
+	for (id = 0; id < signals_size; id++) {
+		rec = signals[id];
+		if (rec == NULL)
+			continue;
 
-	for (hook = &rec->hooks; *hook != NULL; hook = next) {
-		next = &(*hook)->next;
+		signal_ref(rec);
+		for (i = 0; i < rec->hooks_count; i++) {
+			SignalHook *hook = rec->hooks[i];
 
-		if (strcasecmp((*hook)->module, module) == 0) {
-                        next = hook;
-			signal_remove_hook(rec, hook);
+			if (hook->func != NULL &&
+			    strcasecmp(hook->module, module) == 0) {
+				hook->func = NULL;
+				rec->remove_count++;
+			}
 		}
+		if (!rec->emitting && rec->remove_count > 0)
+			signal_hooks_clean(rec);
+		signal_unref(rec);
 	}
 }
 
-/* remove all signals that belong to `module' */
-void signals_remove_module(const char *module)
+/* enable or disable collecting timing statistics */
+void signals_set_stats(int enable)
 {
-	g_return_if_fail(module != NULL);
+	signal_stats_enabled = enable;
+}
+
+int signals_get_stats_enabled(void)
+{
+	return signal_stats_enabled;
+}
+
+/* clear all the collected statistics */
+void signals_clear_stats(void)
+{
+	Signal *rec;
+	int id, i;
 
-	g_hash_table_foreach(signals, (GHFunc) signal_hash_ref, NULL);
-	g_hash_table_foreach(signals, (GHFunc) signal_remove_module,
-			     (void *) module);
-	g_hash_table_foreach_remove(signals, (GHRFunc) signal_hash_unref, NULL);
+	for (id = 0; id < signals_size; id++) {
+		rec = signals[id];
+		if (rec == NULL)
+			continue;
+
+		rec->emits = rec->usecs = 0;
+		for (i = 0; i < rec->hooks_count; i++)
+			rec->hooks[i]->calls = rec->hooks[i]->usecs = 0;
+	}
+}
+
+/* call `func' for each signal, and for each hook of the signal */
+void signals_stats_foreach(SIGNAL_STATS_FUNC func, void *user_data)
+{
+	SIGNAL_STATS_REC stats;
+	Signal *rec;
+	int id, i;
+
+	g_return_if_fail(func != NULL);
+
+	for (id = 0; id < signals_size; id++) {
+		rec = signals[id];
+		if (rec == NULL)
+			continue;
+
+		stats.signal = signal_get_id_str(rec->id);
+		stats.module = NULL;
+		stats.hooks = rec->hooks_count;
+		stats.count = rec->emits;
+		stats.usecs = rec->usecs;
+		func(&stats, user_data);
+
+		for (i = 0; i < rec->hooks_count; i++) {
+			SignalHook *hook = rec->hooks[i];
+
+			if (hook->func == NULL)
+				continue;
+
+			stats.module = hook->module;
+			stats.hooks = 1;
+			stats.count = hook->calls;
+			stats.usecs = hook->usecs;
+			func(&stats, user_data);
+		}
+	}
 }
 
 void signals_init(void)
 {
-	signals = g_hash_table_new(NULL, NULL);
+	signals = NULL;
+	signals_size = 0;
+	signal_stats_enabled = FALSE;
 }
 
-static void signal_free(void *key, Signal *rec)
+static void signal_free(Signal *rec)
 {
+	int i;
+
 	/* refcount-1 because we just referenced it ourself */
 	g_warning("signal_free(%s) : signal still has %d references:",
 		  signal_get_id_str(rec->id), rec->refcount-1);
 
-	while (rec->hooks != NULL) {
+	for (i = 0; i < rec->hooks_count; i++) {
 		g_warning(" - module '%s' function %p",
-			  rec->hooks->module, rec->hooks->func);
-
-		signal_remove_hook(rec, &rec->hooks);
+			  rec->hooks[i]->module, rec->hooks[i]->func);
+		rec->hooks[i]->func = NULL;
 	}
+	signal_hooks_clean(rec);
 }
 
 void signals_deinit(void)
 {
-	g_hash_table_foreach(signals, (GHFunc) signal_hash_ref, NULL);
-        g_hash_table_foreach(signals, (GHFunc) signal_free, NULL);
-	g_hash_table_foreach_remove(signals, (GHRFunc) signal_hash_unref, NULL);
-	g_hash_table_destroy(signals);
+	Signal *rec;
+	int id;
+
+	for (id = 0; id < signals_size; id++) {
+		rec = signals[id];
+		if (rec == NULL)
+			continue;
+
+		signal_ref(rec);
+		signal_free(rec);
+		signal_unref(rec);
+	}
+	g_free(signals);
+	signals = NULL;
+	signals_size = 0;
 
 	module_uniq_destroy("signals");
 }
@@ -63,9 +63,37 @@ int signal_is_stopped(int signal_id);
 /* remove all signals that belong to `module' */
 void signals_remove_module(const char *module);
 
+typedef struct {
+	const char *signal;
+	const char *module; /* NULL = the whole signal */
+	int hooks; /* number of hooks */
+	unsigned long count; /* number of emits/calls */
+	unsigned long usecs; /* time spent in hooks */
+} SIGNAL_STATS_REC;
+
+typedef void (*SIGNAL_STATS_FUNC) (SIGNAL_STATS_REC *stats, void *user_data);
+
+/* enable or disable collecting timing statistics */
+void signals_set_stats(int enable);
+int signals_get_stats_enabled(void);
+/* clear all the collected statistics */
+void signals_clear_stats(void);
+/* call `func' for each signal, and for each hook of the signal */
+void signals_stats_foreach(SIGNAL_STATS_FUNC func, void *user_data);
+
 /* signal name -> ID */
 #define signal_get_uniq_id(signal) \
         module_get_uniq_id_str("signals", signal)
+/* signal name -> ID, for string literals. The ID is looked up only once
+   and cached to a static variable. */
+#ifdef __GNUC__
+#  define signal_get_const_id(signal) __extension__ \
+	({ static int _signal_id = -1; \
+	   if (_signal_id == -1) _signal_id = signal_get_uniq_id(signal); \
+	   _signal_id; })
+#else
+#  define signal_get_const_id(signal) signal_get_uniq_id(signal)
+#endif
 /* signal ID -> name */
 #define signal_get_id_str(signal_id) \
 	module_find_id_str("signals", signal_id)
@@ -24,22 +24,33 @@
 #include "settings.h"
 #include "write-buffer.h"
 
+#include <sys/uio.h>
+
 #define BUFFER_BLOCK_SIZE 2048
+/* Maximum number of blocks given to one writev() call */
+#define BUFFER_MAX_IOV 64
 
 typedef struct {
+	int handle;
+
 	char *active_block;
         int active_block_pos;
 
-	GSList *blocks;
+	GPtrArray *blocks;
 } BUFFER_REC;
 
 static GSList *empty_blocks;
-static GHashTable *buffers;
+static GPtrArray *buffers; /* BUFFER_REC *, indexed by handle */
+static GSList *active_buffers;
 static int block_count;
 
-static int write_buffer_max_blocks;
+static int write_buffer_max_blocks, write_buffer_fsync;
 static int timeout_tag;
 
+static WRITE_BUFFER_STATS_REC stats;
+
+static void write_buffer_flush_all(int sync);
+
 static void write_buffer_new_block(BUFFER_REC *rec)
 {
 	char *block;
@@ -54,7 +65,38 @@ static void write_buffer_new_block(BUFFER_REC *rec)
         block_count++;
 	rec->active_block = block;
         rec->active_block_pos = 0;
-	rec->blocks = g_slist_append(rec->blocks, block);
+	g_ptr_array_add(rec->blocks, block);
+}
+
+/* Write all of iov, returns FALSE if it failed */
+static int write_iov(int handle, struct iovec *iov, int count)
+{
+	ssize_t ret;
+
+	while (count > 0) {
+		ret = writev(handle, iov, count);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			stats.errors++;
+			return FALSE;
+		}
+
+		stats.written += ret;
+		stats.writes++;
+
+		/* skip what was written, continue from the rest */
+		while (count > 0 && (size_t) ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++; count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return TRUE;
 }
 
 int write_buffer(int handle, const void *data, int size)
@@ -65,19 +107,32 @@ int write_buffer(int handle, const void *data, int size)
 
 	if (write_buffer_max_blocks <= 0) {
 		/* no write buffer */
+		stats.writes++;
+		stats.written += size > 0 ? size : 0;
                 return write(handle, data, size);
 	}
 
-	if (size <= 0)
+	if (size <= 0 || handle < 0)
 		return size;
 
-	rec = g_hash_table_lookup(buffers, GINT_TO_POINTER(handle));
+	rec = (guint) handle < buffers->len ?
+		g_ptr_array_index(buffers, handle) : NULL;
 	if (rec == NULL) {
 		rec = g_new0(BUFFER_REC, 1);
+		rec->handle = handle;
+		rec->blocks = g_ptr_array_new();
                 write_buffer_new_block(rec);
-		g_hash_table_insert(buffers, GINT_TO_POINTER(handle), rec);
+
+		if ((guint) handle >= buffers->len)
+			g_ptr_array_set_size(buffers, handle+1);
+		g_ptr_array_index(buffers, handle) = rec;
+		active_buffers = g_slist_prepend(active_buffers, rec);
 	}
 
+	stats.pending += size;
+	if (stats.pending > stats.max_pending)
+		stats.max_pending = stats.pending;
+
 	while (size > 0) {
                 if (rec->active_block_pos == BUFFER_BLOCK_SIZE)
 			write_buffer_new_block(rec);
@@ -92,40 +147,97 @@ int write_buffer(int handle, const void *data, int size)
                 size -= next_size;
 	}
 
-	if (block_count > write_buffer_max_blocks)
-                write_buffer_flush();
+	if (block_count > write_buffer_max_blocks) {
+		/* buffers are full before the timeout, write them now.
+		   we're in the middle of writing a line, so don't block
+		   in fsync() here. */
+		stats.forced_flushes++;
+		write_buffer_flush_all(FALSE);
+	}
 
         return size;
 }
 
-static int write_buffer_flush_rec(void *handlep, BUFFER_REC *rec)
+/* Write all blocks of the buffer with as few writev() calls as possible.
+   If `sync' is non-NULL, the file is also fsync()ed when
+   write_buffer_fsync is set. */
+static void write_buffer_flush_rec(BUFFER_REC *rec, void *sync)
 {
-	GSList *tmp;
-        int handle, size;
-
-        handle = GPOINTER_TO_INT(handlep);
-	for (tmp = rec->blocks; tmp != NULL; tmp = tmp->next) {
-		size = tmp->data != rec->active_block ? BUFFER_BLOCK_SIZE :
-			rec->active_block_pos;
-		write(handle, tmp->data, size);
+	struct iovec iov[BUFFER_MAX_IOV];
+	char *block;
+	guint i;
+	int count, failed;
+
+	count = 0; failed = FALSE;
+	for (i = 0; i < rec->blocks->len; i++) {
+		block = g_ptr_array_index(rec->blocks, i);
+
+		iov[count].iov_base = block;
+		iov[count].iov_len = block != rec->active_block ?
+			BUFFER_BLOCK_SIZE : rec->active_block_pos;
+		stats.pending -= iov[count].iov_len;
+		count++;
+
+		if (count == BUFFER_MAX_IOV || i == rec->blocks->len-1) {
+			if (!failed && !write_iov(rec->handle, iov, count))
+				failed = TRUE;
+			count = 0;
+		}
+
+		empty_blocks = g_slist_prepend(empty_blocks, block);
 	}
+	block_count -= rec->blocks->len;
 
-        empty_blocks = g_slist_concat(empty_blocks, rec->blocks);
+	if (sync != NULL && write_buffer_fsync && !failed)
+		fsync(rec->handle);
+
+	g_ptr_array_index(buffers, rec->handle) = NULL;
+	g_ptr_array_free(rec->blocks, TRUE);
 	g_free(rec);
-        return TRUE;
 }
 
-void write_buffer_flush(void)
+void write_buffer_flush_handle(int handle)
+{
+	BUFFER_REC *rec;
+
+	if (handle < 0 || (guint) handle >= buffers->len)
+		return;
+
+	rec = g_ptr_array_index(buffers, handle);
+	if (rec != NULL) {
+		active_buffers = g_slist_remove(active_buffers, rec);
+		write_buffer_flush_rec(rec, GINT_TO_POINTER(TRUE));
+	}
+}
+
+static void write_buffer_flush_all(int sync)
 {
 	g_slist_foreach(empty_blocks, (GFunc) g_free, NULL);
 	g_slist_free(empty_blocks);
         empty_blocks = NULL;
 
-	g_hash_table_foreach_remove(buffers,
-				    (GHRFunc) write_buffer_flush_rec, NULL);
+	g_slist_foreach(active_buffers, (GFunc) write_buffer_flush_rec,
+			sync ? GINT_TO_POINTER(TRUE) : NULL);
+	g_slist_free(active_buffers);
+	active_buffers = NULL;
         block_count = 0;
 }
 
+void write_buffer_flush(void)
+{
+	write_buffer_flush_all(TRUE);
+}
+
+void write_buffer_get_stats(WRITE_BUFFER_STATS_REC *ret)
+{
+	memcpy(ret, &stats, sizeof(WRITE_BUFFER_STATS_REC));
+}
+
+int write_buffer_is_enabled(void)
+{
+	return write_buffer_max_blocks > 0;
+}
+
 static int flush_timeout(void)
 {
 	write_buffer_flush();
@@ -138,6 +250,7 @@ static void read_settings(void)
 
 	write_buffer_max_blocks =
 		settings_get_size("write_buffer_size") / BUFFER_BLOCK_SIZE;
+	write_buffer_fsync = settings_get_bool("write_buffer_fsync");
 
 	if (settings_get_time("write_buffer_timeout") > 0) {
 		if (timeout_tag == -1) {
@@ -160,12 +273,14 @@ void write_buffer_init(void)
 {
 	settings_add_time("misc", "write_buffer_timeout", "0");
 	settings_add_size("misc", "write_buffer_size", "0");
+	settings_add_bool("misc", "write_buffer_fsync", FALSE);
 
-	buffers = g_hash_table_new((GHashFunc) g_direct_hash,
-				   (GCompareFunc) g_direct_equal);
+	buffers = g_ptr_array_new();
+	active_buffers = NULL;
 
         empty_blocks = NULL;
         block_count = 0;
+	memset(&stats, 0, sizeof(stats));
 
 	timeout_tag = -1;
 	read_settings();
@@ -179,7 +294,7 @@ void write_buffer_deinit(void)
 		g_source_remove(timeout_tag);
 
         write_buffer_flush();
-        g_hash_table_destroy(buffers);
+        g_ptr_array_free(buffers, TRUE);
 
 	g_slist_foreach(empty_blocks, (GFunc) g_free, NULL);
         g_slist_free(empty_blocks);
@@ -1,9 +1,24 @@
 #ifndef __WRITE_BUFFER_H
 #define __WRITE_BUFFER_H
 
+typedef struct {
+	unsigned long pending; /* bytes waiting in buffers */
+	unsigned long max_pending;
+	unsigned long written; /* bytes written to files */
+	unsigned long writes; /* write()/writev() calls */
+	unsigned int forced_flushes; /* buffers got full before timeout */
+	unsigned int errors;
+} WRITE_BUFFER_STATS_REC;
+
 int write_buffer(int handle, const void *data, int size);
+/* Write the buffered data of one handle, call before closing it */
+void write_buffer_flush_handle(int handle);
 void write_buffer_flush(void);
 
+/* Returns TRUE if writes are being buffered */
+int write_buffer_is_enabled(void);
+void write_buffer_get_stats(WRITE_BUFFER_STATS_REC *stats);
+
 void write_buffer_init(void);
 void write_buffer_deinit(void);
 
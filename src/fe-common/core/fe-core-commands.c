@@ -185,6 +185,122 @@ static void cmd_uptime(char *data)
 	}
 }
 
+static void signalstats_add(SIGNAL_STATS_REC *stats, GSList **list)
+{
+	SIGNAL_STATS_REC *rec;
+
+	if (stats->module != NULL || stats->count == 0)
+		return;
+
+	rec = g_new(SIGNAL_STATS_REC, 1);
+	memcpy(rec, stats, sizeof(SIGNAL_STATS_REC));
+	*list = g_slist_prepend(*list, rec);
+}
+
+static void signalstats_add_module(SIGNAL_STATS_REC *stats, GHashTable *modules)
+{
+	SIGNAL_STATS_REC *rec;
+
+	if (stats->module == NULL)
+		return;
+
+	rec = g_hash_table_lookup(modules, stats->module);
+	if (rec == NULL) {
+		rec = g_new0(SIGNAL_STATS_REC, 1);
+		rec->signal = stats->module;
+		rec->module = stats->module;
+		g_hash_table_insert(modules, (char *) rec->module, rec);
+	}
+	rec->hooks++;
+	rec->count += stats->count;
+	rec->usecs += stats->usecs;
+}
+
+static void signalstats_get_module(void *key, SIGNAL_STATS_REC *rec,
+				   GSList **list)
+{
+	if (rec->count > 0)
+		*list = g_slist_prepend(*list, rec);
+	else
+		g_free(rec);
+}
+
+static int signalstats_cmp(SIGNAL_STATS_REC *s1, SIGNAL_STATS_REC *s2)
+{
+	if (s1->usecs != s2->usecs)
+		return s1->usecs < s2->usecs ? 1 : -1;
+	if (s1->count != s2->count)
+		return s1->count < s2->count ? 1 : -1;
+	return 0;
+}
+
+/* SYNTAX: SIGNALSTATS [-enable | -disable | -clear] [-modules] [<count>] */
+static void cmd_signalstats(const char *data)
+{
+	GHashTable *optlist, *modules;
+	GSList *list, *tmp;
+	char *countstr;
+	void *free_arg;
+	int count;
+
+	if (!cmd_get_params(data, &free_arg, 1 | PARAM_FLAG_OPTIONS,
+			    "signalstats", &optlist, &countstr))
+		return;
+
+	if (g_hash_table_lookup(optlist, "clear") != NULL)
+		signals_clear_stats();
+	if (g_hash_table_lookup(optlist, "enable") != NULL) {
+		signals_set_stats(TRUE);
+		printtext(NULL, NULL, MSGLEVEL_CLIENTNOTICE,
+			  "Signal timing statistics enabled");
+	} else if (g_hash_table_lookup(optlist, "disable") != NULL) {
+		signals_set_stats(FALSE);
+		printtext(NULL, NULL, MSGLEVEL_CLIENTNOTICE,
+			  "Signal timing statistics disabled");
+	}
+	if (g_hash_table_size(optlist) > 0 &&
+	    g_hash_table_lookup(optlist, "modules") == NULL) {
+		cmd_params_free(free_arg);
+		return;
+	}
+
+	count = *countstr == '\0' ? 20 : atoi(countstr);
+
+	list = NULL;
+	if (g_hash_table_lookup(optlist, "modules") != NULL) {
+		modules = g_hash_table_new((GHashFunc) g_str_hash,
+					   (GCompareFunc) g_str_equal);
+		signals_stats_foreach((SIGNAL_STATS_FUNC) signalstats_add_module,
+				      modules);
+		g_hash_table_foreach(modules, (GHFunc) signalstats_get_module,
+				     &list);
+		g_hash_table_destroy(modules);
+	} else {
+		signals_stats_foreach((SIGNAL_STATS_FUNC) signalstats_add,
+				      &list);
+	}
+	list = g_slist_sort(list, (GCompareFunc) signalstats_cmp);
+
+	printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP, "%-35s %5s %10s %12s",
+		  "Name", "Hooks", "Count", "Time (usec)");
+	for (tmp = list; tmp != NULL && count-- > 0; tmp = tmp->next) {
+		SIGNAL_STATS_REC *rec = tmp->data;
+
+		printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP,
+			  "%-35s %5d %10lu %12lu", rec->signal,
+			  rec->hooks, rec->count, rec->usecs);
+	}
+	if (!signals_get_stats_enabled()) {
+		printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP,
+			  "Timing statistics are disabled, "
+			  "enable them with /SIGNALSTATS -enable");
+	}
+
+	g_slist_foreach(list, (GFunc) g_free, NULL);
+	g_slist_free(list);
+	cmd_params_free(free_arg);
+}
+
 static void sig_stop(void)
 {
 	signal_stop();
@@ -319,6 +435,7 @@ void fe_core_commands_init(void)
 	command_bind("cat", NULL, (SIGNAL_FUNC) cmd_cat);
 	command_bind("beep", NULL, (SIGNAL_FUNC) cmd_beep);
 	command_bind("uptime", NULL, (SIGNAL_FUNC) cmd_uptime);
+	command_bind("signalstats", NULL, (SIGNAL_FUNC) cmd_signalstats);
 	command_bind_first("nick", NULL, (SIGNAL_FUNC) cmd_nick);
 
 	signal_add("send command", (SIGNAL_FUNC) event_command);
@@ -328,6 +445,7 @@ void fe_core_commands_init(void)
 	signal_add("list subcommands", (SIGNAL_FUNC) event_list_subcommands);
 
 	command_set_options("echo", "current +level +window");
+	command_set_options("signalstats", "enable disable clear modules");
 }
 
 void fe_core_commands_deinit(void)
@@ -337,6 +455,7 @@ void fe_core_commands_deinit(void)
 	command_unbind("cat", (SIGNAL_FUNC) cmd_cat);
 	command_unbind("beep", (SIGNAL_FUNC) cmd_beep);
 	command_unbind("uptime", (SIGNAL_FUNC) cmd_uptime);
+	command_unbind("signalstats", (SIGNAL_FUNC) cmd_signalstats);
 	command_unbind("nick", (SIGNAL_FUNC) cmd_nick);
 
 	signal_remove("send command", (SIGNAL_FUNC) event_command);
@@ -27,6 +27,7 @@
 #include "levels.h"
 #include "misc.h"
 #include "log.h"
+#include "write-buffer.h"
 #include "special-vars.h"
 #include "settings.h"
 #include "lib-config/iconfig.h"
@@ -181,7 +182,7 @@ static void cmd_log_stop(const char *data)
 	LOG_REC *log;
 
 	log = log_find_from_data(data);
-	if (log == NULL || log->handle == -1)
+	if (log == NULL || (log->handle == -1 && !log->suspended))
 		printformat(NULL, NULL, MSGLEVEL_CLIENTERROR, TXT_LOG_NOT_OPEN, data);
 	else {
 		log_stop_logging(log);
@@ -231,11 +232,24 @@ static void cmd_log_list(void)
 		printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP, TXT_LOG_LIST,
 			    index, rec->fname, items != NULL ? items : "",
 			    levelstr, rec->autoopen ? " -autoopen" : "",
-			    rec->handle != -1 ? " active" : "");
+			    rec->handle != -1 || rec->suspended ?
+			    " active" : "");
 
 		g_free_not_null(items);
 		g_free(levelstr);
 	}
+
+	if (write_buffer_is_enabled()) {
+		WRITE_BUFFER_STATS_REC stats;
+
+		write_buffer_get_stats(&stats);
+		printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP,
+			    TXT_LOG_WRITE_BUFFER,
+			    (int) (stats.pending / 1024),
+			    (int) (stats.max_pending / 1024),
+			    (int) (stats.written / 1024), (int) stats.writes,
+			    stats.forced_flushes, stats.errors);
+	}
 	printformat(NULL, NULL, MSGLEVEL_CLIENTCRAP, TXT_LOG_LIST_FOOTER);
 }
 
@@ -250,18 +264,16 @@ static void cmd_log(const char *data, SERVER_REC *server, void *item)
 static LOG_REC *logs_find_item(int type, const char *item,
 			       const char *servertag, LOG_ITEM_REC **ret_item)
 {
-	LOG_ITEM_REC *logitem;
 	GSList *tmp;
 
-	for (tmp = logs; tmp != NULL; tmp = tmp->next) {
+	tmp = log_find_item_logs(type, item, servertag);
+	for (; tmp != NULL; tmp = tmp->next) {
 		LOG_REC *log = tmp->data;
 
 		if (type == LOG_ITEM_TARGET && log->temp == 0) continue;
-		logitem = log_item_find(log, type, item, servertag);
-		if (logitem != NULL) {
-			if (ret_item != NULL) *ret_item = logitem;
-			return log;
-		}
+		if (ret_item != NULL)
+			*ret_item = log_item_find(log, type, item, servertag);
+		return log;
 	}
 
 	return NULL;
@@ -544,7 +544,7 @@ static void sig_nicklist_new(CHANNEL_REC *channel, NICK_REC *nick)
 	char *nickhost, *p;
 	int n;
 
-	if (nick->host == NULL)
+	if (nick->user->host == NULL)
                 return;
 
 	firstnick = g_hash_table_lookup(channel->nicks, nick->nick);
@@ -560,8 +560,8 @@ static void sig_nicklist_new(CHANNEL_REC *channel, NICK_REC *nick)
 	}
 
 	/* identical nick already exists, have to change it somehow.. */
-	p = strchr(nick->host, '@');
-	if (p == NULL) p = nick->host; else p++;
+	p = strchr(nick->user->host, '@');
+	if (p == NULL) p = nick->user->host; else p++;
 
 	nickhost = g_strdup_printf("%s@%s", nick->nick, p);
 	p = strchr(nickhost+strlen(nick->nick), '.');
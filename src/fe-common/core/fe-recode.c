@@ -105,6 +105,7 @@ static void fe_recode_add_cmd (const char *data, SERVER_REC *server, WI_ITEM_REC
 	}
 	if (is_valid_charset(charset)) {
 		iconfig_set_str("conversions", target, charset);
+		recode_conversions_changed();
 		printformat(NULL, NULL, MSGLEVEL_CLIENTNOTICE, TXT_CONVERSION_ADDED, target, charset);
 	} else
 		signal_emit("error command", 2, GINT_TO_POINTER(CMDERR_INVALID_CHARSET), charset);
@@ -131,6 +132,7 @@ static void fe_recode_remove_cmd (const char *data, SERVER_REC *server, WI_ITEM_
 		printformat(NULL, NULL, MSGLEVEL_CLIENTNOTICE, TXT_CONVERSION_NOT_FOUND, target);
 	else {
 		iconfig_set_str("conversions", target, NULL);
+		recode_conversions_changed();
 		printformat(NULL, NULL, MSGLEVEL_CLIENTNOTICE, TXT_CONVERSION_REMOVED, target);
 	}
 
@@ -0,0 +1,283 @@
+/*
+ hilight-bench.c : time hilight_match() over a channel log
+
+    Copyright (C) 2010 The Irssi project
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Build with "make hilight-bench" in src/fe-common/core. Every printed
+   line goes through hilight_match() from the "print text" handler, this
+   does the same for generated channel traffic with a typical set of
+   hilights: own nick, a few words, -full words, -channels restricted
+   words and regexps. <extra> adds that many more plain word hilights
+   that never match, like users with long hilight lists have.
+
+   The configuration is read from a file in the temp directory that
+   doesn't exist, so your own hilights aren't loaded.
+
+   Usage: hilight-bench [<lines> [<extra hilights> ...]] */
+
+#include "module.h"
+#include "args.h"
+#include "core.h"
+#include "levels.h"
+
+#include "hilight-text.h"
+
+#define DEFAULT_LINES 200000
+#define MY_NICK "cras"
+
+typedef struct {
+	const char *text;
+	const char *channels;
+	unsigned int fullword:1;
+	unsigned int regexp:1;
+	unsigned int line:1;
+} BENCH_HILIGHT_REC;
+
+static const BENCH_HILIGHT_REC bench_hilights[] = {
+	{ MY_NICK, NULL, 0, 0, 0 },
+	{ "timo", NULL, 1, 0, 0 },
+	{ "segfault", NULL, 0, 0, 0 },
+	{ "crash", NULL, 0, 0, 0 },
+	{ "release", NULL, 0, 0, 0 },
+	{ "bug", NULL, 1, 0, 0 },
+	{ "review", "#irssi-dev", 0, 0, 0 },
+	{ "patch", "#irssi-dev,#irssi-scripts", 0, 0, 0 },
+	{ "^(" MY_NICK "|timo)[:,]", NULL, 0, 1, 1 },
+	{ "https?://[^ ]*irssi\\.org", NULL, 0, 1, 0 }
+};
+
+static const char *channels[] = {
+	"#irssi", "#irssi-dev", "#irssi-scripts", "#debian", "#linux"
+};
+
+static const char *nicks[] = {
+	"wouter", "exg", "ahf", "Bazerka", "dg", "Zed`", "shabble",
+	"coekie", "fuchs", "Cattus", "larsl", "pa", "jilles", MY_NICK
+};
+
+static const char *phrases[] = {
+	"does anyone know how to make the statusbar show the window name",
+	"try /set autolog on and restart",
+	"that's the default, check your config",
+	"irssi dies when I /quit with scripts loaded",
+	"works for me with the latest svn",
+	"which version of glib is that?",
+	"lol",
+	"ok thanks",
+	"brb",
+	"see the faq on the website",
+	"the theme is in ~/.irssi/default.theme",
+	"you need to /save after that",
+	"hmm, no idea",
+	"it was fixed in 0.8.15 I think",
+	"did you report it upstream?",
+	"can someone review the patch I sent to the list",
+	"the ssl stuff uses openssl, not gnutls",
+	"just use screen or tmux",
+	"perl scripts go in ~/.irssi/scripts/autorun",
+	"/window move 3 will do it",
+	"the nicklist script needs a fifo",
+	"debugging this would be easier with a backtrace",
+	"utf-8 everywhere and set term_charset",
+	"why would it die there",
+	"morning all",
+	"the scrollback is limited by scrollback_lines",
+	"you can bind that with /bind meta-z",
+	"does /lastlog -clear work for you",
+	"there's a new snapshot at https://irssi.org/files/snapshots",
+	"I'd rather not break the script api",
+	"ugh, netsplit again",
+	"is there a way to hide joins and parts only in big channels",
+	"/ignore #channel JOINS PARTS QUITS",
+	"my terminal shows question marks instead of umlauts",
+	"set the recode settings for that network",
+	"you probably want /set hide_server_tags on",
+	"I have the same problem on freebsd",
+	"which terminal emulator are you using",
+	"does it happen without any scripts loaded",
+	"the window numbers change when I close one",
+	"/set windows_auto_renumber off",
+	"it's in the startup-howto",
+	"thanks, that did it",
+	"anyone using it with a bouncer",
+	"the proxy module works fine for that",
+	"no, that's a perl problem",
+	"compile it with debugging symbols first",
+	"I'll have a look tonight",
+	"heh"
+};
+
+static char **lines_create(GRand *rand, int count, const char ***targets)
+{
+	GString *str;
+	char **lines;
+	int i, n, parts;
+
+	lines = g_new(char *, count+1);
+	*targets = g_new(const char *, count);
+	str = g_string_new(NULL);
+	for (i = 0; i < count; i++) {
+		g_string_truncate(str, 0);
+
+		/* some lines are addressed to someone, one in fifty
+		   of those to us */
+		if (g_rand_int_range(rand, 0, 4) == 0) {
+			n = g_rand_int_range(rand, 0, 50) == 0 ?
+				G_N_ELEMENTS(nicks)-1 :
+				g_rand_int_range(rand, 0,
+						 G_N_ELEMENTS(nicks)-1);
+			g_string_append_printf(str, "%s: ", nicks[n]);
+		}
+
+		parts = g_rand_int_range(rand, 1, 4);
+		for (n = 0; n < parts; n++) {
+			if (n > 0)
+				g_string_append(str, ", ");
+			g_string_append(str, phrases[g_rand_int_range(rand, 0,
+					G_N_ELEMENTS(phrases))]);
+		}
+
+		lines[i] = g_strdup(str->str);
+		(*targets)[i] = channels[g_rand_int_range(rand, 0,
+						G_N_ELEMENTS(channels))];
+	}
+	lines[count] = NULL;
+	g_string_free(str, TRUE);
+	return lines;
+}
+
+static void hilights_create(int extra)
+{
+	const BENCH_HILIGHT_REC *brec;
+	HILIGHT_REC *rec;
+	int i;
+
+	/* same as what /HILIGHT does */
+	for (i = 0; i < (int) G_N_ELEMENTS(bench_hilights); i++) {
+		brec = &bench_hilights[i];
+
+		rec = g_new0(HILIGHT_REC, 1);
+		rec->text = g_strdup(brec->text);
+		rec->channels = brec->channels == NULL ? NULL :
+			g_strsplit(brec->channels, ",", -1);
+		rec->nick = !brec->line;
+		rec->word = !brec->line;
+		rec->fullword = brec->fullword;
+		rec->regexp = brec->regexp;
+		hilight_create(rec);
+	}
+
+	for (i = 0; i < extra; i++) {
+		rec = g_new0(HILIGHT_REC, 1);
+		rec->text = g_strdup_printf("keyword%d", i);
+		rec->nick = TRUE;
+		rec->word = TRUE;
+		hilight_create(rec);
+	}
+}
+
+static void hilights_remove(void)
+{
+	while (hilights != NULL)
+		hilight_remove(hilights->data);
+}
+
+static void bench(char **lines, const char **targets, int extra)
+{
+	GTimer *timer;
+	double secs;
+	int i, count, matches, beg, end;
+
+	hilights_create(extra);
+
+	/* the first call compiles the hilights, don't count it */
+	hilight_match(NULL, targets[0], NULL, NULL, MSGLEVEL_PUBLIC,
+		      lines[0], &beg, &end);
+
+	timer = g_timer_new();
+	matches = 0;
+	for (i = 0; lines[i] != NULL; i++) {
+		beg = end = 0;
+		if (hilight_match(NULL, targets[i], NULL, NULL,
+				  MSGLEVEL_PUBLIC, lines[i],
+				  &beg, &end) != NULL)
+			matches++;
+	}
+	secs = g_timer_elapsed(timer, NULL);
+	count = i;
+
+	printf("%4d hilights: %.3fs, %.0f lines/s (%d/%d lines matched)\n",
+	       g_slist_length(hilights), secs,
+	       secs > 0 ? count / secs : 0.0, matches, count);
+
+	g_timer_destroy(timer);
+	hilights_remove();
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_extra[] = { 0, 20, 100 };
+	char *args[4];
+	const char **targets;
+	GRand *rand;
+	char **lines;
+	int i, count;
+
+	count = argc > 1 ? atoi(argv[1]) : DEFAULT_LINES;
+	if (count <= 0) {
+		fprintf(stderr, "usage: %s [<lines> [<extra hilights> ...]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	args[0] = argv[0];
+	args[1] = g_strconcat("--home=", g_get_tmp_dir(), NULL);
+	args[2] = g_strconcat("--config=", g_get_tmp_dir(),
+			      G_DIR_SEPARATOR_S "hilight-bench.none", NULL);
+	args[3] = NULL;
+
+	core_register_options();
+	args_execute(3, args);
+	core_preinit(argv[0]);
+
+	irssi_gui = IRSSI_GUI_NONE;
+	core_init();
+	hilight_text_init();
+
+	rand = g_rand_new_with_seed(1);
+	lines = lines_create(rand, count, &targets);
+	printf("%d lines\n", count);
+
+	if (argc > 2) {
+		for (i = 2; i < argc; i++)
+			bench(lines, targets, atoi(argv[i]));
+	} else {
+		for (i = 0; i < (int) G_N_ELEMENTS(default_extra); i++)
+			bench(lines, targets, default_extra[i]);
+	}
+
+	g_strfreev(lines);
+	g_free(targets);
+	g_rand_free(rand);
+
+	hilight_text_deinit();
+	core_deinit();
+	g_free(args[1]);
+	g_free(args[2]);
+	return 0;
+}
@@ -24,6 +24,7 @@
 #include "commands.h"
 #include "levels.h"
 #include "misc.h"
+#include "multimatch.h"
 #include "lib-config/iconfig.h"
 #include "settings.h"
 
@@ -36,10 +37,26 @@
 #include "printtext.h"
 #include "formats.h"
 
+typedef struct {
+	HILIGHT_REC *rec;
+	int pos; /* first match in the text being checked, -1 if none */
+} HILIGHT_MATCH_REC;
+
 static NICKMATCH_REC *nickmatch;
 static int never_hilight_level, default_hilight_level;
 GSList *hilights;
 
+/* The text hilights compiled for hilight_match(), rebuilt when needed
+   after hilights have been changed */
+static int hilights_changed;
+static MULTIMATCH_REC *hilight_texts;
+static HILIGHT_MATCH_REC *hilight_matches; /* one for each in `hilights' */
+static int hilight_matches_count;
+#ifdef HAVE_REGEX_H
+static regex_t hilight_regexps; /* all the regexps in one */
+static int hilight_regexps_compiled;
+#endif
+
 static void reset_level_cache(void)
 {
 	GSList *tmp;
@@ -57,6 +74,7 @@ static void reset_cache(void)
 {
 	reset_level_cache();
 	nickmatch_rebuild(nickmatch);
+	hilights_changed = TRUE;
 }
 
 static void hilight_add_config(HILIGHT_REC *rec)
@@ -114,6 +132,7 @@ static void hilights_destroy_all(void)
 	g_slist_foreach(hilights, (GFunc) hilight_destroy, NULL);
 	g_slist_free(hilights);
 	hilights = NULL;
+	hilights_changed = TRUE;
 }
 
 static void hilight_init_rec(HILIGHT_REC *rec)
@@ -136,6 +155,7 @@ void hilight_create(HILIGHT_REC *rec)
 	hilight_add_config(rec);
 
 	hilight_init_rec(rec);
+	hilights_changed = TRUE;
 
 	signal_emit("hilight created", 1, rec);
 }
@@ -146,6 +166,7 @@ void hilight_remove(HILIGHT_REC *rec)
 
 	hilight_remove_config(rec);
 	hilights = g_slist_remove(hilights, rec);
+	hilights_changed = TRUE;
 
 	signal_emit("hilight destroyed", 1, rec);
 	hilight_destroy(rec);
@@ -231,6 +252,142 @@ static int hilight_match_text(HILIGHT_REC *rec, const char *text,
 	((rec)->channels == NULL || ((channel) != NULL && \
 		strarray_find((rec)->channels, (channel)) != -1))
 
+#ifdef HAVE_REGEX_H
+/* Returns TRUE if `regexp' can be safely put inside (...) */
+static int regexp_can_combine(const char *regexp)
+{
+	int depth;
+
+	/* no back references, no unbalanced parenthesis */
+	depth = 0;
+	for (; *regexp != '\0'; regexp++) {
+		switch (*regexp) {
+		case '\\':
+			if (regexp[1] == '\0' || i_isdigit(regexp[1]))
+				return FALSE;
+			regexp++;
+			break;
+		case '[':
+			/* skip the bracket expression, ']' is literal
+			   if it comes first */
+			regexp++;
+			if (*regexp == '^') regexp++;
+			if (*regexp == ']') regexp++;
+			regexp = strchr(regexp, ']');
+			if (regexp == NULL)
+				return FALSE;
+			break;
+		case '(':
+			depth++;
+			break;
+		case ')':
+			if (--depth < 0)
+				return FALSE;
+			break;
+		}
+	}
+	return depth == 0;
+}
+
+/* Combine all the regexps into one, so most lines can be rejected with
+   a single regexec() */
+static void hilight_regexps_compile(void)
+{
+	GString *str;
+	GSList *tmp;
+	int count;
+
+	if (hilight_regexps_compiled) {
+		regfree(&hilight_regexps);
+		hilight_regexps_compiled = FALSE;
+	}
+
+	str = g_string_new(NULL);
+	count = 0;
+	for (tmp = hilights; tmp != NULL; tmp = tmp->next) {
+		HILIGHT_REC *rec = tmp->data;
+
+		if (rec->nickmask || !rec->regexp || !rec->regexp_compiled)
+			continue;
+		if (!regexp_can_combine(rec->text)) {
+			count = 0;
+			break;
+		}
+
+		if (count++ > 0)
+			g_string_append_c(str, '|');
+		g_string_append_printf(str, "(%s)", rec->text);
+	}
+
+	if (count > 1) {
+		hilight_regexps_compiled =
+			regcomp(&hilight_regexps, str->str,
+				REG_EXTENDED|REG_ICASE|REG_NOSUB) == 0;
+	}
+	g_string_free(str, TRUE);
+}
+#endif
+
+static void hilight_matches_rebuild(void)
+{
+	GSList *tmp;
+	int i;
+
+	multimatch_clear(hilight_texts);
+
+	g_free(hilight_matches);
+	hilight_matches_count = g_slist_length(hilights);
+	hilight_matches = g_new0(HILIGHT_MATCH_REC, hilight_matches_count);
+
+	for (tmp = hilights, i = 0; tmp != NULL; tmp = tmp->next, i++) {
+		HILIGHT_REC *rec = tmp->data;
+
+		hilight_matches[i].rec = rec;
+		if (!rec->nickmask && !rec->regexp)
+			multimatch_add(hilight_texts, rec->text,
+				       &hilight_matches[i]);
+	}
+
+#ifdef HAVE_REGEX_H
+	hilight_regexps_compile();
+#endif
+	hilights_changed = FALSE;
+}
+
+static int hilight_text_found(HILIGHT_MATCH_REC *match, const char *text,
+			      int pos, int len, void *user_data)
+{
+	/* matches are found in order, the first one is what we want */
+	if (match->pos != -1)
+		return FALSE;
+
+	if (match->rec->fullword) {
+		/* same as stristr_full() */
+		if (pos > 0 && !isbound(text[pos-1]))
+			return FALSE;
+		if (text[pos+len] != '\0' && !isbound(text[pos+len]))
+			return FALSE;
+	}
+
+	match->pos = pos;
+	return FALSE;
+}
+
+/* Find all the text hilights from `str' with one pass */
+static void hilight_texts_scan(const char *str)
+{
+	int i;
+
+	for (i = 0; i < hilight_matches_count; i++) {
+		/* stristr() finds empty strings from the beginning */
+		hilight_matches[i].pos =
+			*hilight_matches[i].rec->text == '\0' ? 0 : -1;
+	}
+
+	multimatch_scan(hilight_texts, str,
+			(MULTIMATCH_FUNC) hilight_text_found, NULL);
+}
+
 HILIGHT_REC *hilight_match(SERVER_REC *server, const char *channel,
 			   const char *nick, const char *address,
 			   int level, const char *str,
@@ -239,6 +396,8 @@ HILIGHT_REC *hilight_match(SERVER_REC *server, const char *channel,
 	GSList *tmp;
         CHANNEL_REC *chanrec;
 	NICK_REC *nickrec;
+	HILIGHT_MATCH_REC *match;
+	int i, texts_scanned, regexps_checked, regexps_match;
 
 	g_return_val_if_fail(str != NULL, NULL);
 
@@ -253,7 +412,7 @@ HILIGHT_REC *hilight_match(SERVER_REC *server, const char *channel,
 		if (nickrec != NULL) {
                         HILIGHT_REC *rec;
 
-			if (nickrec->host == NULL)
+			if (nickrec->user->host == NULL)
 				nicklist_set_host(chanrec, nickrec, address);
 
 			rec = nickmatch_find(nickmatch, nickrec);
@@ -262,13 +421,45 @@ HILIGHT_REC *hilight_match(SERVER_REC *server, const char *channel,
 		}
 	}
 
-	for (tmp = hilights; tmp != NULL; tmp = tmp->next) {
+	if (hilights_changed)
+		hilight_matches_rebuild();
+
+	texts_scanned = regexps_checked = FALSE;
+	regexps_match = TRUE;
+	for (tmp = hilights, i = 0; tmp != NULL; tmp = tmp->next, i++) {
 		HILIGHT_REC *rec = tmp->data;
 
-		if (!rec->nickmask && hilight_match_level(rec, level) &&
-		    hilight_match_channel(rec, channel) &&
-		    hilight_match_text(rec, str, match_beg, match_end))
+		if (rec->nickmask || !hilight_match_level(rec, level) ||
+		    !hilight_match_channel(rec, channel))
+			continue;
+
+		if (rec->regexp) {
+#ifdef HAVE_REGEX_H
+			if (!regexps_checked && hilight_regexps_compiled) {
+				regexps_match = regexec(&hilight_regexps, str,
+							0, NULL, 0) == 0;
+			}
+			regexps_checked = TRUE;
+#endif
+			if (regexps_match &&
+			    hilight_match_text(rec, str, match_beg, match_end))
+				return rec;
+			continue;
+		}
+
+		if (!texts_scanned) {
+			hilight_texts_scan(str);
+			texts_scanned = TRUE;
+		}
+
+		match = &hilight_matches[i];
+		if (match->pos != -1) {
+			if (match_beg != NULL && match_end != NULL) {
+				*match_beg = match->pos;
+				*match_end = match->pos + strlen(rec->text);
+			}
 			return rec;
+		}
 	}
 
         return NULL;
@@ -393,7 +584,8 @@ static void sig_print_text(TEXT_DEST_REC *dest, const char *text,
                 g_string_free(tmp, FALSE);
 	}
 
-	signal_emit("print text", 3, dest, newstr, stripped);
+	signal_emit_id(signal_get_const_id("print text"), 3,
+		       dest, newstr, stripped);
 
 	g_free(color);
 	g_free(newstr);
@@ -648,10 +840,10 @@ static void hilight_nick_cache(GHashTable *list, CHANNEL_REC *channel,
         char *nickmask;
 	int len, best_match;
 
-	if (nick->host == NULL)
+	if (nick->user->host == NULL)
                 return; /* don't check until host is known */
 
-	nickmask = g_strconcat(nick->nick, "!", nick->host, NULL);
+	nickmask = g_strconcat(nick->nick, "!", nick->user->host, NULL);
 
 	best_match = 0; match = NULL;
 	for (tmp = hilights; tmp != NULL; tmp = tmp->next) {
@@ -687,6 +879,14 @@ void hilight_text_init(void)
 
         read_settings();
 
+	hilight_texts = multimatch_create();
+	hilight_matches = NULL;
+	hilight_matches_count = 0;
+	hilights_changed = TRUE;
+#ifdef HAVE_REGEX_H
+	hilight_regexps_compiled = FALSE;
+#endif
+
 	nickmatch = nickmatch_init(hilight_nick_cache);
 	read_hilight_config();
 
@@ -704,6 +904,13 @@ void hilight_text_deinit(void)
 	hilights_destroy_all();
         nickmatch_deinit(nickmatch);
 
+	multimatch_destroy(hilight_texts);
+	g_free(hilight_matches);
+#ifdef HAVE_REGEX_H
+	if (hilight_regexps_compiled)
+		regfree(&hilight_regexps);
+#endif
+
 	signal_remove("print text", (SIGNAL_FUNC) sig_print_text);
         signal_remove("setup reread", (SIGNAL_FUNC) read_hilight_config);
         signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
@@ -608,12 +608,17 @@ static void sig_command(const char *data)
 {
 	const char *cmdchars;
 	char *str;
+	int old_user_input;
 
 	cmdchars = settings_get_str("cmdchars");
 	str = strchr(cmdchars, *data) != NULL ? g_strdup(data) :
 		g_strdup_printf("%c%s", *cmdchars, data);
 
+	/* key bindings are pressed by the user */
+	old_user_input = command_user_input;
+	command_user_input = TRUE;
 	signal_emit("send command", 3, str, active_win->active_server, active_win->active);
+	command_user_input = old_user_input;
 
 	g_free(str);
 }
@@ -182,6 +182,7 @@ FORMAT_REC fecommon_core_formats[] = {
 	{ "log_list_header", "%#Logs:", 0 },
 	{ "log_list", "%#$0 $1: $2 $3$4$5", 6, { 1, 0, 0, 0, 0, 0 } },
 	{ "log_list_footer", "", 0 },
+	{ "log_write_buffer", "%#Write buffer: $0kB pending (max $1kB), $2kB written with $3 writes, $4 forced flushes, $5 errors", 6, { 1, 1, 1, 1, 1, 1 } },
 	{ "windowlog_file", "Window LOGFILE set to $0", 1, { 0 } },
 	{ "windowlog_file_logging", "Can't change window's logfile while log is on", 0 },
 	{ "no_away_msgs", "No new messages in awaylog", 1, { 0 } },
@@ -153,6 +153,7 @@ enum {
 	TXT_LOG_LIST_HEADER,
 	TXT_LOG_LIST,
 	TXT_LOG_LIST_FOOTER,
+	TXT_LOG_WRITE_BUFFER,
 	TXT_WINDOWLOG_FILE,
 	TXT_WINDOWLOG_FILE_LOGGING,
 	TXT_LOG_NO_AWAY_MSGS,
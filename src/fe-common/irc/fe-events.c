@@ -49,7 +49,7 @@ static void event_privmsg(IRC_SERVER_REC *server, const char *data,
 
 	g_return_if_fail(data != NULL);
 
-	params = event_get_params(data, 2 | PARAM_FLAG_GETREST, &target, &msg);
+	params = event_get_params_shared(data, 2 | PARAM_FLAG_GETREST, &target, &msg);
 	if (nick == NULL) nick = server->real_address;
 	if (addr == NULL) addr = "";
 	if (*target == '@' && ischannel(target[1])) {
@@ -60,10 +60,11 @@ static void event_privmsg(IRC_SERVER_REC *server, const char *data,
 			    get_visible_target(server, target+1));
 	} else {
 		recoded = recode_in(SERVER(server), msg, ischannel(*target) ? target : nick);
-		signal_emit(ischannel(*target) ?
-			    "message public" : "message private", 5,
-			    server, recoded, nick, addr,
-			    get_visible_target(server, target));
+		signal_emit_id(ischannel(*target) ?
+			       signal_get_const_id("message public") :
+			       signal_get_const_id("message private"), 5,
+			       server, recoded, nick, addr,
+			       get_visible_target(server, target));
 	}
 
 	g_free(params);
@@ -91,7 +92,7 @@ static void event_notice(IRC_SERVER_REC *server, const char *data,
 
 	g_return_if_fail(data != NULL);
 
-	params = event_get_params(data, 2 | PARAM_FLAG_GETREST, &target, &msg);
+	params = event_get_params_shared(data, 2 | PARAM_FLAG_GETREST, &target, &msg);
 	recoded = recode_in(SERVER(server), msg, target);
 	if (nick == NULL) {
 		nick = server->real_address == NULL ?
@@ -99,8 +100,9 @@ static void event_notice(IRC_SERVER_REC *server, const char *data,
 			server->real_address;
 	}
 
-	signal_emit("message irc notice", 5, server, recoded, nick, addr,
-		    get_visible_target(server, target));
+	signal_emit_id(signal_get_const_id("message irc notice"), 5,
+		       server, recoded, nick, addr,
+		       get_visible_target(server, target));
 	g_free(params);
 	g_free(recoded);
 }
@@ -45,7 +45,8 @@ typedef struct {
 	IRC_SERVER_REC *server;
 	time_t last_netjoin;
 
-	GSList *netjoins;
+	GSList *netjoins; /* newest first */
+	GHashTable *nicks; /* nick => NETJOIN_REC */
 } NETJOIN_SERVER_REC;
 
 typedef struct {
@@ -97,18 +98,20 @@ static NETJOIN_REC *netjoin_add(IRC_SERVER_REC *server, const char *nick,
 	if (srec == NULL) {
 		srec = g_new0(NETJOIN_SERVER_REC, 1);
 		srec->server = server;
+		srec->nicks = g_hash_table_new((GHashFunc) g_istr_hash,
+					       (GCompareFunc) g_istr_equal);
                 joinservers = g_slist_append(joinservers, srec);
 	}
 
 	srec->last_netjoin = time(NULL);
-	srec->netjoins = g_slist_append(srec->netjoins, rec);
+	srec->netjoins = g_slist_prepend(srec->netjoins, rec);
+	g_hash_table_insert(srec->nicks, rec->nick, rec);
 	return rec;
 }
 
 static NETJOIN_REC *netjoin_find(IRC_SERVER_REC *server, const char *nick)
 {
 	NETJOIN_SERVER_REC *srec;
-	GSList *tmp;
 
 	g_return_val_if_fail(server != NULL, NULL);
 	g_return_val_if_fail(nick != NULL, NULL);
@@ -116,19 +119,13 @@ static NETJOIN_REC *netjoin_find(IRC_SERVER_REC *server, const char *nick)
 	srec = netjoin_find_server(server);
         if (srec == NULL) return NULL;
 
-	for (tmp = srec->netjoins; tmp != NULL; tmp = tmp->next) {
-		NETJOIN_REC *rec = tmp->data;
-
-		if (g_strcasecmp(rec->nick, nick) == 0)
-			return rec;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(srec->nicks, nick);
 }
 
-static void netjoin_remove(NETJOIN_SERVER_REC *server, NETJOIN_REC *rec)
+/* Destroy the netjoin, the caller removes it from server's netjoins list */
+static void netjoin_destroy(NETJOIN_SERVER_REC *server, NETJOIN_REC *rec)
 {
-	server->netjoins = g_slist_remove(server->netjoins, rec);
+	g_hash_table_remove(server->nicks, rec->nick);
 
         g_slist_foreach(rec->old_channels, (GFunc) g_free, NULL);
 	g_slist_foreach(rec->now_channels, (GFunc) g_free, NULL);
@@ -143,8 +140,12 @@ static void netjoin_server_remove(NETJOIN_SERVER_REC *server)
 {
 	joinservers = g_slist_remove(joinservers, server);
 
-	while (server->netjoins != NULL)
-		netjoin_remove(server, server->netjoins->data);
+	while (server->netjoins != NULL) {
+		netjoin_destroy(server, server->netjoins->data);
+		server->netjoins = g_slist_delete_link(server->netjoins,
+						       server->netjoins);
+	}
+	g_hash_table_destroy(server->nicks);
         g_free(server);
 }
 
@@ -168,20 +169,22 @@ static void print_netjoins(NETJOIN_SERVER_REC *server)
 {
 	TEMP_PRINT_REC *temp;
 	GHashTable *channels;
-	GSList *tmp, *next, *old;
+	GSList *list, *tmp, *old;
 
 	g_return_if_fail(server != NULL);
 
 	printing_joins = TRUE;
 
 	/* save nicks to string, clear now_channels and remove the same
-	   channels from old_channels list */
+	   channels from old_channels list. all the channels are handled
+	   in one pass through the netjoins, oldest first. */
 	channels = g_hash_table_new((GHashFunc) g_istr_hash,
 				    (GCompareFunc) g_istr_equal);
-	for (tmp = server->netjoins; tmp != NULL; tmp = next) {
+	list = g_slist_reverse(server->netjoins);
+	server->netjoins = NULL;
+	for (tmp = list; tmp != NULL; tmp = tmp->next) {
 		NETJOIN_REC *rec = tmp->data;
 
-		next = tmp->next;
 		while (rec->now_channels != NULL) {
 			char *channel = rec->now_channels->data;
 			char *realchannel = channel + 1;
@@ -220,8 +223,13 @@ static void print_netjoins(NETJOIN_SERVER_REC *server)
 		}
 
 		if (rec->old_channels == NULL)
-                        netjoin_remove(server, rec);
+                        netjoin_destroy(server, rec);
+		else {
+			server->netjoins =
+				g_slist_prepend(server->netjoins, rec);
+		}
 	}
+	g_slist_free(list);
 
 	g_hash_table_foreach(channels, (GHFunc) print_channel_netjoins,
 			     server);
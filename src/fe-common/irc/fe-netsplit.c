@@ -22,6 +22,7 @@
 #include "module-formats.h"
 #include "signals.h"
 #include "levels.h"
+#include "misc.h"
 #include "settings.h"
 
 #include "irc-servers.h"
@@ -36,6 +37,7 @@
 static int split_tag;
 static int netsplit_max_nicks, netsplit_nicks_hide_threshold;
 static int printing_splits;
+static GHashTable *unprinted_splits; /* NETSPLIT_REC => NETSPLIT_REC */
 
 static int get_last_split(IRC_SERVER_REC *server)
 {
@@ -62,6 +64,7 @@ typedef struct {
         IRC_SERVER_REC *server_rec;
 	GSList *servers; /* if many servers splitted from the same one */
 	GSList *channels;
+	GHashTable *channel_hash; /* name => TEMP_SPLIT_CHAN_REC */
 } TEMP_SPLIT_REC;
 
 static GSList *get_source_servers(const char *server, GSList **servers)
@@ -86,16 +89,7 @@ static GSList *get_source_servers(const char *server, GSList **servers)
 static TEMP_SPLIT_CHAN_REC *find_split_chan(TEMP_SPLIT_REC *rec,
 					    const char *name)
 {
-	GSList *tmp;
-
-	for (tmp = rec->channels; tmp != NULL; tmp = tmp->next) {
-		TEMP_SPLIT_CHAN_REC *chanrec = tmp->data;
-
-		if (g_strcasecmp(chanrec->name, name) == 0)
-			return chanrec;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(rec->channel_hash, name);
 }
 
 static void get_server_splits(void *key, NETSPLIT_REC *split,
@@ -123,7 +117,9 @@ static void get_server_splits(void *key, NETSPLIT_REC *split,
 			chanrec->name = splitchan->name;
 			chanrec->nicks = g_string_new(NULL);
 
-			rec->channels = g_slist_append(rec->channels, chanrec);
+			rec->channels = g_slist_prepend(rec->channels, chanrec);
+			g_hash_table_insert(rec->channel_hash,
+					    chanrec->name, chanrec);
 		}
 
 		split->server->prints++;
@@ -193,6 +189,11 @@ static void temp_split_chan_free(TEMP_SPLIT_CHAN_REC *rec)
 	g_free(rec);
 }
 
+static int split_is_printed(void *key, NETSPLIT_REC *rec)
+{
+	return rec->printed;
+}
+
 static void print_splits(IRC_SERVER_REC *server)
 {
 	TEMP_SPLIT_REC temp;
@@ -200,6 +201,8 @@ static void print_splits(IRC_SERVER_REC *server)
 
 	printing_splits = TRUE;
 
+	/* only the splits that haven't been printed yet are gone through,
+	   all of them at once */
 	servers = g_slist_copy(server->split_servers);
 	while (servers != NULL) {
 		NETSPLIT_SERVER_REC *sserver = servers->data;
@@ -209,17 +212,23 @@ static void print_splits(IRC_SERVER_REC *server)
                 temp.servers = get_source_servers(sserver->server, &servers);
                 temp.server_rec = server;
 		temp.channels = NULL;
+		temp.channel_hash = g_hash_table_new((GHashFunc) g_istr_hash,
+						     (GCompareFunc) g_istr_equal);
 
-		g_hash_table_foreach(server->splits,
+		g_hash_table_foreach(unprinted_splits,
 				     (GHFunc) get_server_splits, &temp);
+		temp.channels = g_slist_reverse(temp.channels);
 		print_server_splits(server, &temp);
 
 		g_slist_foreach(temp.channels,
 				(GFunc) temp_split_chan_free, NULL);
 		g_slist_free(temp.servers);
 		g_slist_free(temp.channels);
+		g_hash_table_destroy(temp.channel_hash);
 	}
 
+	g_hash_table_foreach_remove(unprinted_splits,
+				    (GHRFunc) split_is_printed, NULL);
 	printing_splits = FALSE;
 }
 
@@ -243,7 +252,7 @@ static void sig_print_starting(void)
 {
 	GSList *tmp;
 
-	if (printing_splits)
+	if (printing_splits || g_hash_table_size(unprinted_splits) == 0)
 		return;
 
 	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
@@ -280,8 +289,9 @@ static int sig_check_splits(void)
 	return 1;
 }
 
-static void sig_netsplit_servers(void)
+static void sig_netsplit_new(NETSPLIT_REC *rec)
 {
+	g_hash_table_insert(unprinted_splits, rec, rec);
 	if (settings_get_bool("hide_netsplit_quits") && split_tag == -1) {
 		split_tag = g_timeout_add(1000,
 					  (GSourceFunc) sig_check_splits,
@@ -290,6 +300,11 @@ static void sig_netsplit_servers(void)
 	}
 }
 
+static void sig_netsplit_remove(NETSPLIT_REC *rec)
+{
+	g_hash_table_remove(unprinted_splits, rec);
+}
+
 static int split_equal(NETSPLIT_REC *n1, NETSPLIT_REC *n2)
 {
         return g_strcasecmp(n1->nick, n2->nick);
@@ -357,8 +372,11 @@ void fe_netsplit_init(void)
 	split_tag = -1;
 	printing_splits = FALSE;
 
+	unprinted_splits = g_hash_table_new(NULL, NULL);
+
 	read_settings();
-	signal_add("netsplit new", (SIGNAL_FUNC) sig_netsplit_servers);
+	signal_add("netsplit new", (SIGNAL_FUNC) sig_netsplit_new);
+	signal_add("netsplit remove", (SIGNAL_FUNC) sig_netsplit_remove);
 	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 	command_bind_irc("netsplit", NULL, (SIGNAL_FUNC) cmd_netsplit);
 }
@@ -370,7 +388,10 @@ void fe_netsplit_deinit(void)
 		signal_remove("print starting", (SIGNAL_FUNC) sig_print_starting);
 	}
 
-	signal_remove("netsplit new", (SIGNAL_FUNC) sig_netsplit_servers);
+	g_hash_table_destroy(unprinted_splits);
+
+	signal_remove("netsplit new", (SIGNAL_FUNC) sig_netsplit_new);
+	signal_remove("netsplit remove", (SIGNAL_FUNC) sig_netsplit_remove);
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 	command_unbind("netsplit", (SIGNAL_FUNC) cmd_netsplit);
 }
@@ -23,6 +23,7 @@
 #include "signals.h"
 #include "misc.h"
 #include "settings.h"
+#include "commands.h"
 #include "special-vars.h"
 #include "levels.h"
 #include "servers.h"
@@ -426,7 +427,7 @@ static void key_send_line(void)
 {
 	HISTORY_REC *history;
 	char *str;
-	int add_history;
+	int add_history, old_user_input;
 
 	str = gui_entry_get_text(active_entry);
 
@@ -436,9 +437,12 @@ static void key_send_line(void)
 	history = command_history_current(active_win);
 
 	if (redir == NULL) {
+		old_user_input = command_user_input;
+		command_user_input = TRUE;
 		signal_emit("send command", 3, str,
 			    active_win->active_server,
 			    active_win->active);
+		command_user_input = old_user_input;
 	} else {
 		if (redir->flags & ENTRY_REDIRECT_FLAG_HIDDEN)
                         add_history = 0;
@@ -27,6 +27,7 @@
 #include "core.h"
 #include "settings.h"
 #include "session.h"
+#include "misc.h"
 
 #include "printtext.h"
 #include "fe-common-core.h"
@@ -84,6 +85,10 @@ void term_dummy_deinit(void);
 
 static int dirty, full_redraw, dummy;
 
+static int frame_interval; /* min. msecs between screen updates */
+static GTimeVal last_frame;
+static int frame_tag;
+
 static GMainLoop *main_loop;
 int quitting;
 
@@ -141,6 +146,50 @@ static void dirty_check(void)
         dirty = FALSE;
 }
 
+static int sig_frame_timeout(void)
+{
+	frame_tag = -1;
+	return 0;
+}
+
+/* Update the screen, but not more often than term_refresh_rate allows.
+   Between the updates text only goes to the buffers, the views,
+   statusbars and terminal are updated all at once. */
+static void frame_check(void)
+{
+	GTimeVal now;
+	long msecs;
+
+	if (frame_interval > 0) {
+		g_get_current_time(&now);
+		msecs = get_timeval_diff(&now, &last_frame);
+		if (msecs >= 0 && msecs < frame_interval) {
+			/* make sure we wake up when the frame is due */
+			if (frame_tag == -1) {
+				frame_tag = g_timeout_add(frame_interval-msecs,
+							  (GSourceFunc) sig_frame_timeout,
+							  NULL);
+			}
+			return;
+		}
+		last_frame = now;
+	}
+
+	dirty_check();
+	if (!dummy) {
+		term_refresh_thaw();
+		term_refresh_freeze();
+	}
+}
+
+static void read_settings(void)
+{
+	int rate;
+
+	rate = settings_get_int("term_refresh_rate");
+	frame_interval = rate <= 0 ? 0 : 1000/rate;
+}
+
 static void textui_init(void)
 {
 #ifdef SIGTRAP
@@ -184,6 +233,10 @@ static void textui_finish_init(void)
 		statusbar_init();
 		term_refresh_thaw();
 
+		settings_add_int("lookandfeel", "term_refresh_rate", 25);
+		read_settings();
+		signal_add("setup changed", (SIGNAL_FUNC) read_settings);
+
 		/* don't check settings with dummy mode */
 		settings_check();
 	}
@@ -231,6 +284,10 @@ static void textui_deinit(void)
 	if (dummy)
 		term_dummy_deinit();
 	else {
+		signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+		if (frame_tag != -1)
+			g_source_remove(frame_tag);
+
 	        lastlog_deinit();
 		statusbar_deinit();
 		gui_printtext_deinit();
@@ -355,18 +412,19 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	frame_tag = -1;
 	textui_finish_init();
 	main_loop = g_main_new(TRUE);
 
 	/* Does the same as g_main_run(main_loop), except we
-	   can call our dirty-checker after each iteration */
+	   can call our dirty-checker after each iteration. The terminal
+	   is kept frozen, frame_check() refreshes it when it's time. */
+	if (!dummy) term_refresh_freeze();
 	while (!quitting) {
 #ifdef USE_GC
 		GC_collect_a_little();
 #endif
-		if (!dummy) term_refresh_freeze();
 		g_main_iteration(TRUE);
-                if (!dummy) term_refresh_thaw();
 
 		if (reload_config) {
                         /* SIGHUP received, do /RELOAD */
@@ -374,8 +432,9 @@ int main(int argc, char **argv)
                         signal_emit("command reload", 1, "");
 		}
 
-		dirty_check();
+		frame_check();
 	}
+	if (!dummy) term_refresh_thaw();
 
 	g_main_destroy(main_loop);
 	textui_deinit();
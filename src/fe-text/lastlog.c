@@ -34,6 +34,8 @@
 #define DEFAULT_LASTLOG_BEFORE 3
 #define DEFAULT_LASTLOG_AFTER 3
 #define MAX_LINES_WITHOUT_FORCE 1000
+/* how many lines to search before letting other things run */
+#define LASTLOG_SEARCH_LINES 10000
 
 /* Only unknown keys in `optlist' should be levels.
    Returns -1 if unknown option was given. */
@@ -74,29 +76,126 @@ int cmd_options_get_level(const char *cmd, GHashTable *optlist)
 	return retlevel;
 }
 
-static void show_lastlog(const char *searchtext, GHashTable *optlist,
-			 int start, int count, FILE *fhandle)
-{
+typedef struct {
+	WINDOW_REC *window;
+	TEXT_BUFFER_SEARCH_REC *search;
+} LASTLOG_SEARCH_REC;
+
+typedef struct {
 	WINDOW_REC *window;
+	LINE_REC *line; /* NULL = separator */
+
+	/* for sorting -all results: time of the first line in the match
+	   and its context lines, and the position in results */
+	time_t time;
+	int group, order;
+} LASTLOG_LINE_REC;
+
+typedef struct {
+	WINDOW_REC *dest; /* window where the results are printed */
+	GSList *searches; /* one LASTLOG_SEARCH_REC for each window */
+	GSList *cur_search; /* the search still in progress */
+	FILE *fhandle;
+
+	int start, count;
+	int idle_tag;
+
+	unsigned int all:1; /* searching all windows */
+	unsigned int context:1; /* -before or -after */
+	unsigned int show_count:1;
+	unsigned int force:1;
+	unsigned int no_header:1;
+} LASTLOG_REC;
+
+/* the /LASTLOG that is still searching */
+static LASTLOG_REC *lastlog_running;
+
+static void lastlog_search_destroy(LASTLOG_SEARCH_REC *srec)
+{
+	textbuffer_search_destroy(srec->search);
+	g_free(srec);
+}
+
+static void lastlog_destroy(LASTLOG_REC *rec)
+{
+	if (lastlog_running == rec)
+		lastlog_running = NULL;
+
+	if (rec->idle_tag != -1)
+		g_source_remove(rec->idle_tag);
+	if (rec->fhandle != NULL) {
+		if (ferror(rec->fhandle))
+			printtext(NULL, NULL, MSGLEVEL_CLIENTERROR,
+				  "Could not write lastlog: %s", g_strerror(errno));
+		fclose(rec->fhandle);
+	}
+
+	g_slist_foreach(rec->searches, (GFunc) lastlog_search_destroy, NULL);
+	g_slist_free(rec->searches);
+	g_free(rec);
+}
+
+static LASTLOG_SEARCH_REC *
+lastlog_search_create(WINDOW_REC *window, const char *searchtext,
+		      GHashTable *optlist, int level, int before, int after)
+{
+	LASTLOG_SEARCH_REC *srec;
+	TEXT_BUFFER_SEARCH_REC *search;
         LINE_REC *startline;
-	GList *list, *tmp;
-	GString *line;
+
+	if (g_hash_table_lookup(optlist, "new") != NULL)
+		startline = textbuffer_view_get_bookmark(WINDOW_GUI(window)->view, "lastlog_last_check");
+	else if (g_hash_table_lookup(optlist, "away") != NULL)
+		startline = textbuffer_view_get_bookmark(WINDOW_GUI(window)->view, "lastlog_last_away");
+	else
+		startline = NULL;
+
+	if (startline == NULL)
+                startline = textbuffer_view_get_lines(WINDOW_GUI(window)->view);
+
+	search = textbuffer_search_new(WINDOW_GUI(window)->view->buffer,
+				       startline, level, MSGLEVEL_LASTLOG,
+				       searchtext, before, after,
+				       g_hash_table_lookup(optlist, "regexp") != NULL,
+				       g_hash_table_lookup(optlist, "word") != NULL,
+				       g_hash_table_lookup(optlist, "case") != NULL);
+	if (search == NULL)
+		return NULL;
+
+	srec = g_new0(LASTLOG_SEARCH_REC, 1);
+	srec->window = window;
+	srec->search = search;
+	return srec;
+}
+
+static LASTLOG_REC *lastlog_create(const char *searchtext, GHashTable *optlist,
+				   int start, int count, FILE *fhandle)
+{
+	LASTLOG_REC *rec;
+	LASTLOG_SEARCH_REC *srec;
+	WINDOW_REC *window;
+	GSList *tmp, *windows_list;
         char *str;
-	int level, before, after, len;
+	int level, before, after;
 
         level = cmd_options_get_level("lastlog", optlist);
-	if (level == -1) return; /* error in options */
+	if (level == -1) return NULL; /* error in options */
         if (level == 0) level = MSGLEVEL_ALL;
 
 	if (g_hash_table_lookup(optlist, "clear") != NULL) {
 		textbuffer_view_remove_lines_by_level(WINDOW_GUI(active_win)->view, MSGLEVEL_LASTLOG);
 		if (*searchtext == '\0')
-                        return;
+                        return NULL;
 	}
 
         /* which window's lastlog to look at? */
         window = active_win;
         str = g_hash_table_lookup(optlist, "window");
+	if (str != NULL && g_hash_table_lookup(optlist, "all") != NULL) {
+		printformat(NULL, NULL, MSGLEVEL_CLIENTERROR,
+			    TXT_LASTLOG_ALL_WINDOW);
+		return NULL;
+	}
 	if (str != NULL) {
 		window = is_numeric(str, '\0') ?
 			window_find_refnum(atoi(str)) :
@@ -104,20 +203,10 @@ static void show_lastlog(const char *searchtext, GHashTable *optlist,
 		if (window == NULL) {
 			printformat(NULL, NULL, MSGLEVEL_CLIENTERROR,
                                     TXT_REFNUM_NOT_FOUND, str);
-			return;
+			return NULL;
 		}
 	}
 
-	if (g_hash_table_lookup(optlist, "new") != NULL)
-		startline = textbuffer_view_get_bookmark(WINDOW_GUI(window)->view, "lastlog_last_check");
-	else if (g_hash_table_lookup(optlist, "away") != NULL)
-		startline = textbuffer_view_get_bookmark(WINDOW_GUI(window)->view, "lastlog_last_away");
-	else
-		startline = NULL;
-
-	if (startline == NULL)
-                startline = textbuffer_view_get_lines(WINDOW_GUI(window)->view);
-
 	str = g_hash_table_lookup(optlist, "#");
 	if (str != NULL) {
 		before = after = atoi(str);
@@ -132,65 +221,216 @@ static void show_lastlog(const char *searchtext, GHashTable *optlist,
 			atoi(str) : DEFAULT_LASTLOG_AFTER;
 	}
 
-	list = textbuffer_find_text(WINDOW_GUI(window)->view->buffer, startline,
-				    level, MSGLEVEL_LASTLOG,
-				    searchtext, before, after,
-				    g_hash_table_lookup(optlist, "regexp") != NULL,
-				    g_hash_table_lookup(optlist, "word") != NULL,
-				    g_hash_table_lookup(optlist, "case") != NULL);
+	rec = g_new0(LASTLOG_REC, 1);
+	rec->idle_tag = -1;
+	rec->all = g_hash_table_lookup(optlist, "all") != NULL;
+	windows_list = rec->all ? windows_get_sorted() :
+		g_slist_append(NULL, window);
+	for (tmp = windows_list; tmp != NULL; tmp = tmp->next) {
+		srec = lastlog_search_create(tmp->data, searchtext, optlist,
+					     level, before, after);
+		if (srec == NULL) {
+			/* invalid regexp */
+			g_slist_free(windows_list);
+			lastlog_destroy(rec);
+			return NULL;
+		}
+
+		if (count > 0 && start >= 0 && before == 0 && after == 0) {
+			/* only the last matches are wanted, no need to
+			   look through the whole buffer */
+			textbuffer_search_set_last(srec->search, count+start);
+		}
+		rec->searches = g_slist_prepend(rec->searches, srec);
+	}
+	g_slist_free(windows_list);
+	rec->searches = g_slist_reverse(rec->searches);
+	rec->cur_search = rec->searches;
+
+	rec->dest = active_win;
+	rec->fhandle = fhandle;
+	rec->start = start;
+	rec->count = count;
+	rec->context = before > 0 || after > 0;
+	rec->show_count = g_hash_table_lookup(optlist, "count") != NULL;
+	rec->force = g_hash_table_lookup(optlist, "force") != NULL;
+	rec->no_header = g_hash_table_lookup(optlist, "-") != NULL;
+	return rec;
+}
+
+/* Search about LASTLOG_SEARCH_LINES lines from the windows.
+   Returns TRUE if there's still more to search. */
+static int lastlog_search(LASTLOG_REC *rec)
+{
+	LASTLOG_SEARCH_REC *srec;
+	int lines;
+
+	lines = LASTLOG_SEARCH_LINES;
+	while (rec->cur_search != NULL && lines > 0) {
+		srec = rec->cur_search->data;
+		if (textbuffer_search_next(srec->search, &lines))
+			return TRUE;
+
+		/* this window is done, continue with the next one */
+		rec->cur_search = rec->cur_search->next;
+	}
+
+	return rec->cur_search != NULL;
+}
+
+static int lastlog_line_cmp(const LASTLOG_LINE_REC *l1,
+			    const LASTLOG_LINE_REC *l2)
+{
+	if (l1->time != l2->time)
+		return l1->time < l2->time ? -1 : 1;
+	return l1->order - l2->order;
+}
+
+/* Return the found lines in the order they're printed */
+static GArray *lastlog_get_lines(LASTLOG_REC *rec)
+{
+	LASTLOG_SEARCH_REC *srec;
+	LASTLOG_LINE_REC line;
+	GPtrArray *matches;
+	GArray *lines, *sorted;
+	GSList *tmp;
+	guint i;
+	int new_group;
+
+	lines = g_array_new(FALSE, FALSE, sizeof(LASTLOG_LINE_REC));
+
+	memset(&line, 0, sizeof(line));
+	for (tmp = rec->searches; tmp != NULL; tmp = tmp->next) {
+		srec = tmp->data;
+
+		line.window = srec->window;
+		new_group = TRUE;
+		matches = textbuffer_search_get_matches(srec->search);
+		for (i = 0; i < matches->len; i++) {
+			line.line = g_ptr_array_index(matches, i);
+			if (line.line == NULL) {
+				/* separators are added after sorting
+				   when searching all windows */
+				if (!rec->all)
+					g_array_append_val(lines, line);
+				line.group++;
+				new_group = TRUE;
+				continue;
+			}
+
+			/* without context lines, each line is sorted
+			   by itself */
+			if (new_group || !rec->context)
+				line.time = line.line->info.time;
+			new_group = FALSE;
+
+			line.order = lines->len;
+			g_array_append_val(lines, line);
+		}
+		line.group++;
+	}
+
+	if (!rec->all || lines->len == 0)
+		return lines;
 
-        len = g_list_length(list);
+	qsort(lines->data, lines->len, sizeof(LASTLOG_LINE_REC),
+	      (int (*)(const void *, const void *)) lastlog_line_cmp);
+	if (!rec->context)
+		return lines;
+
+	/* separate the matches */
+	sorted = g_array_new(FALSE, FALSE, sizeof(LASTLOG_LINE_REC));
+	for (i = 0; i < lines->len; i++) {
+		LASTLOG_LINE_REC *lrec =
+			&g_array_index(lines, LASTLOG_LINE_REC, i);
+
+		if (i > 0 && lrec->group !=
+		    g_array_index(lines, LASTLOG_LINE_REC, i-1).group) {
+			line.line = NULL;
+			g_array_append_val(sorted, line);
+		}
+		g_array_append_val(sorted, *lrec);
+	}
+	g_array_free(lines, TRUE);
+	return sorted;
+}
+
+/* Print the results once all the windows have been searched. They can't
+   be printed while searching, since -count, -all sorting, <count> and the
+   too many lines check all need to know every match first. */
+static void lastlog_print(LASTLOG_REC *rec)
+{
+	LASTLOG_SEARCH_REC *srec;
+	GArray *lines;
+	GString *line;
+	GSList *tmp;
+	FILE *fhandle;
+	int count, pos, len;
+
+	fhandle = rec->fhandle;
+	count = rec->count;
+
+	lines = lastlog_get_lines(rec);
+        len = lines->len;
 	if (count <= 0)
-		tmp = list;
+		pos = 0;
 	else {
-		int pos = len-count-start;
+		pos = len-count-rec->start;
 		if (pos < 0) pos = 0;
-
-		tmp = pos > len ? NULL : g_list_nth(list, pos);
-		len = g_list_length(tmp);
+		if (pos > len) pos = len;
+		len -= pos;
 	}
 
-	if (g_hash_table_lookup(optlist, "count") != NULL) {
-		printformat_window(active_win, MSGLEVEL_CLIENTNOTICE,
+	if (rec->show_count) {
+		printformat_window(rec->dest, MSGLEVEL_CLIENTNOTICE,
 				   TXT_LASTLOG_COUNT, len);
-		g_list_free(list);
+		g_array_free(lines, TRUE);
 		return;
 	}
 
-	if (len > MAX_LINES_WITHOUT_FORCE && fhandle == NULL &&
-	    g_hash_table_lookup(optlist, "force") == NULL) {
-		printformat_window(active_win,
+	if (len > MAX_LINES_WITHOUT_FORCE && fhandle == NULL && !rec->force) {
+		printformat_window(rec->dest,
 				   MSGLEVEL_CLIENTNOTICE|MSGLEVEL_LASTLOG,
 				   TXT_LASTLOG_TOO_LONG, len);
-		g_list_free(list);
+		g_array_free(lines, TRUE);
 		return;
 	}
 
-	if (fhandle == NULL && g_hash_table_lookup(optlist, "-") == NULL)
-		printformat(NULL, NULL, MSGLEVEL_LASTLOG, TXT_LASTLOG_START);
+	if (fhandle == NULL && !rec->no_header)
+		printformat_window(rec->dest, MSGLEVEL_LASTLOG,
+				   TXT_LASTLOG_START);
 
 	line = g_string_new(NULL);
-        while (tmp != NULL && (count < 0 || count > 0)) {
-		LINE_REC *rec = tmp->data;
+	for (; pos < (int)lines->len && count != 0; pos++) {
+		LASTLOG_LINE_REC *lrec =
+			&g_array_index(lines, LASTLOG_LINE_REC, pos);
 
-		if (rec == NULL) {
-			if (tmp->next == NULL)
+		if (lrec->line == NULL) {
+			if (pos+1 == (int)lines->len)
                                 break;
 			if (fhandle != NULL) {
 				fwrite("--\n", 3, 1, fhandle);
 			} else {
-				printformat_window(active_win,
+				printformat_window(rec->dest,
 						   MSGLEVEL_LASTLOG,
 						   TXT_LASTLOG_SEPARATOR);
 			}
-                        tmp = tmp->next;
 			continue;
 		}
 
                 /* get the line text */
-		textbuffer_line2text(rec, fhandle == NULL, line);
+		textbuffer_line2text(lrec->line, fhandle == NULL, line);
+		if (rec->all) {
+			const char *name = window_get_active_name(lrec->window);
+			char *prefix;
+
+			prefix = name != NULL ? g_strdup_printf("%s: ", name) :
+				g_strdup_printf("%d: ", lrec->window->refnum);
+			g_string_prepend(line, prefix);
+			g_free(prefix);
+		}
 		if (!settings_get_bool("timestamps")) {
-			struct tm *tm = localtime(&rec->info.time);
+			struct tm *tm = localtime(&lrec->line->info.time);
                         char timestamp[10];
 
 			g_snprintf(timestamp, sizeof(timestamp),
@@ -204,31 +444,51 @@ static void show_lastlog(const char *searchtext, GHashTable *optlist,
 			fwrite(line->str, line->len, 1, fhandle);
 			fputc('\n', fhandle);
 		} else {
-			printtext_window(active_win, MSGLEVEL_LASTLOG,
+			printtext_window(rec->dest, MSGLEVEL_LASTLOG,
 					 "%s", line->str);
 		}
 
 		count--;
-		tmp = tmp->next;
 	}
         g_string_free(line, TRUE);
+	g_array_free(lines, TRUE);
 
-	if (fhandle == NULL && g_hash_table_lookup(optlist, "-") == NULL)
-		printformat(NULL, NULL, MSGLEVEL_LASTLOG, TXT_LASTLOG_END);
+	if (fhandle == NULL && !rec->no_header)
+		printformat_window(rec->dest, MSGLEVEL_LASTLOG,
+				   TXT_LASTLOG_END);
 
-	textbuffer_view_set_bookmark_bottom(WINDOW_GUI(window)->view,
-					    "lastlog_last_check");
+	for (tmp = rec->searches; tmp != NULL; tmp = tmp->next) {
+		srec = tmp->data;
+		textbuffer_view_set_bookmark_bottom(WINDOW_GUI(srec->window)->view,
+						    "lastlog_last_check");
+	}
+}
 
-	g_list_free(list);
+static void lastlog_finish(LASTLOG_REC *rec)
+{
+	lastlog_print(rec);
+	lastlog_destroy(rec);
 }
 
-/* SYNTAX: LASTLOG [-] [-file <filename>] [-window <ref#|name>] [-new | -away]
+static int sig_lastlog_idle(LASTLOG_REC *rec)
+{
+	if (lastlog_search(rec))
+		return TRUE;
+
+	rec->idle_tag = -1;
+	lastlog_finish(rec);
+	return FALSE;
+}
+
+/* SYNTAX: LASTLOG [-] [-file <filename>] [-window <ref#|name> | -all]
+		   [-new | -away]
 		   [-<level> -<level...>] [-clear] [-count] [-case]
 		   [-regexp | -word] [-before [<#>]] [-after [<#>]]
 		   [-<# before+after>] [<pattern>] [<count> [<start>]] */
 static void cmd_lastlog(const char *data)
 {
 	GHashTable *optlist;
+	LASTLOG_REC *rec;
 	char *text, *countstr, *start, *fname;
 	void *free_arg;
         int count, fd;
@@ -250,6 +510,10 @@ static void cmd_lastlog(const char *data)
 	count = atoi(countstr);
 	if (count == 0) count = -1;
 
+	/* only one search at a time */
+	if (lastlog_running != NULL)
+		lastlog_destroy(lastlog_running);
+
 	/* target where to print it */
         fhandle = NULL;
 	fname = g_hash_table_lookup(optlist, "file");
@@ -269,26 +533,68 @@ static void cmd_lastlog(const char *data)
 		printtext(NULL, NULL, MSGLEVEL_CLIENTERROR,
 			  "Could not open lastlog: %s", g_strerror(errno));
 	} else {
-		show_lastlog(text, optlist, atoi(start), count, fhandle);
-		if (fhandle != NULL) {
-			if (ferror(fhandle))
-				printtext(NULL, NULL, MSGLEVEL_CLIENTERROR,
-				  	  "Could not write lastlog: %s", g_strerror(errno));
-			fclose(fhandle);
+		rec = lastlog_create(text, optlist, atoi(start), count,
+				     fhandle);
+		if (rec == NULL) {
+			if (fhandle != NULL)
+				fclose(fhandle);
+		} else if (!lastlog_search(rec)) {
+			lastlog_finish(rec);
+		} else {
+			/* search the rest when there's nothing else to do,
+			   so huge scrollbacks don't freeze the UI */
+			lastlog_running = rec;
+			rec->idle_tag = g_idle_add((GSourceFunc) sig_lastlog_idle, rec);
 		}
 	}
 
 	cmd_params_free(free_arg);
 }
 
+static void sig_window_destroyed(WINDOW_REC *window)
+{
+	LASTLOG_SEARCH_REC *srec;
+	GSList *tmp;
+
+	if (lastlog_running == NULL)
+		return;
+
+	if (lastlog_running->dest == window) {
+		lastlog_destroy(lastlog_running);
+		return;
+	}
+
+	for (tmp = lastlog_running->searches; tmp != NULL; tmp = tmp->next) {
+		srec = tmp->data;
+		if (srec->window != window)
+			continue;
+
+		if (lastlog_running->cur_search == tmp)
+			lastlog_running->cur_search = tmp->next;
+		lastlog_running->searches =
+			g_slist_remove(lastlog_running->searches, srec);
+		lastlog_search_destroy(srec);
+		break;
+	}
+
+	if (lastlog_running->searches == NULL)
+		lastlog_destroy(lastlog_running);
+}
+
 void lastlog_init(void)
 {
+	lastlog_running = NULL;
 	command_bind("lastlog", NULL, (SIGNAL_FUNC) cmd_lastlog);
+	signal_add("window destroyed", (SIGNAL_FUNC) sig_window_destroyed);
 
-	command_set_options("lastlog", "!- # force clear -file -window new away word regexp case count @a @after @before");
+	command_set_options("lastlog", "!- # force clear -file -window all new away word regexp case count @a @after @before");
 }
 
 void lastlog_deinit(void)
 {
+	if (lastlog_running != NULL)
+		lastlog_destroy(lastlog_running);
+
 	command_unbind("lastlog", (SIGNAL_FUNC) cmd_lastlog);
+	signal_remove("window destroyed", (SIGNAL_FUNC) sig_window_destroyed);
 }
@@ -10,6 +10,7 @@ enum {
 	TXT_LASTLOG_START,
 	TXT_LASTLOG_END,
 	TXT_LASTLOG_SEPARATOR,
+	TXT_LASTLOG_ALL_WINDOW,
 
 	TXT_FILL_2,
 
@@ -338,27 +338,14 @@ void statusbar_redraw(STATUSBAR_REC *bar, int force)
 
 void statusbar_item_redraw(SBAR_ITEM_REC *item)
 {
-        WINDOW_REC *old_active_win;
-
 	g_return_if_fail(item != NULL);
 
-	old_active_win = active_win;
-        if (item->bar->parent_window != NULL)
-		active_win = item->bar->parent_window->active;
-
-	item->func(item, TRUE);
-
+	/* the item may get redraw requests many times before the screen
+	   is updated - ask its size only once in statusbar_redraw_dirty() */
+	item->size_dirty = TRUE;
 	item->dirty = TRUE;
 	item->bar->dirty = TRUE;
 	irssi_set_dirty();
-
-	if (item->max_size != item->size) {
-		/* item wants a new size - we'll need to redraw
-		   the statusbar to see if this is allowed */
-		statusbar_redraw(item->bar, FALSE);
-	}
-
-	active_win = old_active_win;
 }
 
 void statusbar_items_redraw(const char *name)
@@ -989,6 +976,37 @@ static void statusbar_redraw_needed_items(STATUSBAR_REC *bar)
         active_win = old_active_win;
 }
 
+static void statusbar_check_item_sizes(STATUSBAR_REC *bar)
+{
+        WINDOW_REC *old_active_win;
+	GSList *tmp;
+	int resize;
+
+	old_active_win = active_win;
+        if (bar->parent_window != NULL)
+		active_win = bar->parent_window->active;
+
+	resize = FALSE;
+	for (tmp = bar->items; tmp != NULL; tmp = tmp->next) {
+		SBAR_ITEM_REC *rec = tmp->data;
+
+		if (rec->size_dirty) {
+			rec->size_dirty = FALSE;
+			rec->func(rec, TRUE);
+			if (rec->max_size != rec->size)
+				resize = TRUE;
+		}
+	}
+
+        active_win = old_active_win;
+
+	if (resize) {
+		/* item wants a new size - we'll need to redraw
+		   the statusbar to see if this is allowed */
+		statusbar_redraw(bar, FALSE);
+	}
+}
+
 void statusbar_redraw_dirty(void)
 {
 	GSList *tmp;
@@ -1002,6 +1020,7 @@ void statusbar_redraw_dirty(void)
 		STATUSBAR_REC *rec = tmp->data;
 
 		if (rec->dirty) {
+			statusbar_check_item_sizes(rec);
                         statusbar_redraw_needed_items(rec);
 			rec->dirty = FALSE;
 			rec->dirty_xpos = -1;
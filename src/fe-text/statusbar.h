@@ -75,6 +75,7 @@ struct SBAR_ITEM_REC {
 
         int current_size; /* item size currently in screen */
 	unsigned int dirty:1;
+	unsigned int size_dirty:1; /* size needs to be checked before drawing */
 };
 
 extern GSList *statusbar_groups;
@@ -369,6 +369,12 @@ void term_refresh(TERM_WINDOW *window)
 	}
 }
 
+void term_get_stats(TERM_STATS_REC *stats)
+{
+	/* curses does the output itself */
+	memset(stats, 0, sizeof(TERM_STATS_REC));
+}
+
 void term_stop(void)
 {
 	term_deinit_int();
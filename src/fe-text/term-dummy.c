@@ -20,6 +20,7 @@
 
 #include "module.h"
 #include "signals.h"
+#include "commands.h"
 
 #include "fe-windows.h"
 
@@ -72,8 +73,10 @@ static void readline(void)
 	p = strchr(input->str, '\n');
 	if (p != NULL) {
 		*p = '\0';
+		command_user_input = TRUE;
 		signal_emit("send command", 3, input->str,
 			    active_win->active_server, active_win->active);
+		command_user_input = FALSE;
 		*p = '\n';
 		g_string_erase(input, 0, (int) (p-input->str)+1);
 	}
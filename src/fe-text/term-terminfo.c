@@ -41,14 +41,47 @@ struct _TERM_WINDOW {
 	int width, height;
 };
 
+/* One character cell of the screen. Wide characters use two cells, the
+   second one has width 0 and no data. */
+#define TERM_CELL_MAX_BYTES 6
+
+typedef struct {
+	int col;
+	unsigned char len, width;
+	char data[TERM_CELL_MAX_BYTES];
+} TERM_CELL;
+
+/* clrtoeol() doesn't necessarily understand colors, so only lines ending
+   with blanks of default color can be cleared with it */
+#define CELL_COLOR_PLAIN(col) \
+	(((col) & (0xff | ATTR_UNDERLINE | ATTR_REVERSE)) == 0 && \
+	 ((col) & ATTR_RESET) == ATTR_RESET)
+#define CELL_IS_BLANK(cell) \
+	((cell)->len == 1 && (cell)->data[0] == ' ' && \
+	 CELL_COLOR_PLAIN((cell)->col))
+
 TERM_WINDOW *root_window;
 
-static char *term_lines_empty; /* 1 if line is entirely empty */
-static int vcmove, vcx, vcy, curs_visible;
+/* term_front has what's currently in the terminal, term_back what should
+   be there after the next term_refresh(). Drawing only touches term_back,
+   refreshing writes the cells that differ. */
+static TERM_CELL *term_front, *term_back;
+static char *term_lines_dirty; /* 1 if line in term_back was modified */
+static int vcx, vcy, curs_visible;
 static int crealx, crealy, cforcemove;
 static int curs_x, curs_y;
+static int current_col;
+static TERM_CELL *last_cell; /* for appending combining characters */
+static int last_cell_y;
+
+static int last_fg, last_bg, last_attrs, last_col;
 
-static int last_fg, last_bg, last_attrs;
+/* scrolling done to term_back that hasn't been sent to terminal yet */
+static int scroll_y, scroll_height, scroll_count;
+
+/* output statistics */
+static unsigned long frame_start_bytes, last_frame_bytes, max_frame_bytes;
+static unsigned int frame_count;
 
 static GSource *sigcont_source;
 static volatile sig_atomic_t got_sigcont;
@@ -98,6 +131,45 @@ static GSourceFuncs sigcont_funcs = {
 	.dispatch = sigcont_dispatch
 };
 
+static void term_cells_clear(TERM_CELL *cell, int count)
+{
+	for (; count > 0; count--, cell++) {
+		cell->col = ATTR_RESET;
+		cell->len = cell->width = 1;
+		cell->data[0] = ' ';
+	}
+}
+
+/* Terminal contents are unknown - make every cell differ from anything
+   that can be drawn, so the next refresh rewrites the whole screen */
+static void term_cells_invalidate(TERM_CELL *cell, int count)
+{
+	for (; count > 0; count--, cell++) {
+		cell->col = -1;
+		cell->len = 0;
+		cell->width = 1;
+	}
+}
+
+static void term_cells_alloc(void)
+{
+	int size = term_width * term_height;
+
+	g_free(term_front);
+	g_free(term_back);
+	g_free(term_lines_dirty);
+
+	term_front = g_new(TERM_CELL, size);
+	term_back = g_new(TERM_CELL, size);
+	term_lines_dirty = g_new(char, term_height);
+	last_cell = NULL;
+	scroll_count = 0;
+
+	term_cells_invalidate(term_front, size);
+	term_cells_clear(term_back, size);
+	memset(term_lines_dirty, 1, term_height);
+}
+
 int term_init(void)
 {
 	struct sigaction act;
@@ -105,8 +177,10 @@ int term_init(void)
 
 	last_fg = last_bg = -1;
 	last_attrs = 0;
+	last_col = -1;
+	current_col = ATTR_RESET;
 	vcx = vcy = 0; crealx = crealy = -1;
-	vcmove = FALSE; cforcemove = TRUE;
+	cforcemove = TRUE;
         curs_visible = TRUE;
 
 	current_term = terminfo_core_init(stdin, stdout);
@@ -132,7 +206,8 @@ int term_init(void)
 	term_height = current_term->height;
 	root_window = term_window_create(0, 0, term_width, term_height);
 
-        term_lines_empty = g_new0(char, term_height);
+	term_cells_alloc();
+	frame_start_bytes = current_term->bytes_written;
 
         term_set_input_type(TERM_TYPE_8BIT);
 	term_common_init();
@@ -150,12 +225,16 @@ void term_deinit(void)
 		term_common_deinit();
 		terminfo_core_deinit(current_term);
 		current_term = NULL;
+
+		g_free_and_null(term_front);
+		g_free_and_null(term_back);
+		g_free_and_null(term_lines_dirty);
 	}
 }
 
-static void term_move_real(void)
+static void term_move_real(int x, int y)
 {
-	if (vcx != crealx || vcy != crealy || cforcemove) {
+	if (x != crealx || y != crealy || cforcemove) {
 		if (curs_visible) {
 			terminfo_set_cursor_visible(FALSE);
 			curs_visible = FALSE;
@@ -165,22 +244,9 @@ static void term_move_real(void)
 			crealx = crealy = -1;
 			cforcemove = FALSE;
 		}
-		terminfo_move_relative(crealx, crealy, vcx, vcy);
-                crealx = vcx; crealy = vcy;
+		terminfo_move_relative(crealx, crealy, x, y);
+                crealx = x; crealy = y;
 	}
-
-        vcmove = FALSE;
-}
-
-/* Cursor position is unknown - move it immediately to known position */
-static void term_move_reset(int x, int y)
-{
-	if (x >= term_width) x = term_width-1;
-	if (y >= term_height) y = term_height-1;
-
-	vcx = x; vcy = y;
-        cforcemove = TRUE;
-        term_move_real();
 }
 
 /* Resize terminal - if width or height is negative,
@@ -197,11 +263,12 @@ void term_resize(int width, int height)
 		term_height = current_term->height = height;
 		term_window_move(root_window, 0, 0, term_width, term_height);
 
-                g_free(term_lines_empty);
-		term_lines_empty = g_new0(char, term_height);
+		term_cells_alloc();
+		if (vcx >= term_width) vcx = term_width-1;
+		if (vcy >= term_height) vcy = term_height-1;
 	}
 
-        term_move_reset(0, 0);
+        cforcemove = TRUE;
 }
 
 void term_resize_final(int width, int height)
@@ -220,14 +287,92 @@ void term_force_colors(int set)
 	terminfo_setup_colors(current_term, set);
 }
 
+/* Change the color the terminal is really using */
+static void term_set_color_real(int col)
+{
+	int set_normal;
+	int fg = col & 0x0f;
+	int bg = (col & 0xf0) >> 4;
+
+	last_col = col;
+
+        set_normal = ((col & ATTR_RESETFG) && last_fg != -1) ||
+		((col & ATTR_RESETBG) && last_bg != -1);
+	if (((last_attrs & ATTR_BOLD) && (col & ATTR_BOLD) == 0) ||
+	    ((last_attrs & ATTR_BLINK) && (col & ATTR_BLINK) == 0)) {
+		/* we'll need to get rid of bold/blink - this can only be
+		   done with setting the default color */
+		set_normal = TRUE;
+	}
+
+	if (set_normal) {
+		last_fg = last_bg = -1;
+                last_attrs = 0;
+		terminfo_set_normal();
+	}
+
+	if (!term_use_colors && (col & 0xf0) != 0)
+		col |= ATTR_REVERSE;
+
+	/* reversed text (use standout) */
+	if (col & ATTR_REVERSE) {
+		if ((last_attrs & ATTR_REVERSE) == 0)
+			terminfo_set_standout(TRUE);
+	} else if (last_attrs & ATTR_REVERSE)
+		terminfo_set_standout(FALSE);
+
+	/* set foreground color */
+	if (fg != last_fg &&
+	    (fg != 0 || (col & ATTR_RESETFG) == 0)) {
+                if (term_use_colors) {
+			last_fg = fg;
+			terminfo_set_fg(last_fg);
+		}
+	}
+
+	/* set background color */
+	if (col & 0x80 && current_term->TI_colors == 8)
+		col |= ATTR_BLINK;
+	if (col & ATTR_BLINK)
+		current_term->set_blink(current_term);
+
+	if (bg != last_bg &&
+	    (bg != 0 || (col & ATTR_RESETBG) == 0)) {
+                if (term_use_colors) {
+			last_bg = bg;
+			terminfo_set_bg(last_bg);
+		}
+	}
+
+	/* bold */
+	if (col & 0x08 && current_term->TI_colors == 8)
+		col |= ATTR_BOLD;
+	if (col & ATTR_BOLD)
+		terminfo_set_bold();
+
+	/* underline */
+	if (col & ATTR_UNDERLINE) {
+		if ((last_attrs & ATTR_UNDERLINE) == 0)
+			terminfo_set_uline(TRUE);
+	} else if (last_attrs & ATTR_UNDERLINE)
+		terminfo_set_uline(FALSE);
+
+        last_attrs = col & ~0xff;
+}
+
 /* Clear screen */
 void term_clear(void)
 {
         term_set_color(root_window, ATTR_RESET);
+	term_set_color_real(ATTR_RESET);
 	terminfo_clear();
-        term_move_reset(0, 0);
+	cforcemove = TRUE;
 
-	memset(term_lines_empty, 1, term_height);
+	term_cells_clear(term_front, term_width * term_height);
+	term_cells_clear(term_back, term_width * term_height);
+	memset(term_lines_dirty, 0, term_height);
+	last_cell = NULL;
+	scroll_count = 0;
 }
 
 /* Beep */
@@ -269,105 +414,101 @@ void term_window_clear(TERM_WINDOW *window)
 {
 	int y;
 
-        terminfo_set_normal();
         if (window->y == 0 && window->height == term_height) {
         	term_clear();
         } else {
-		for (y = 0; y < window->height; y++) {
-			term_move(window, 0, y);
-			term_clrtoeol(window);
+		for (y = window->y; y < window->y+window->height &&
+			     y < term_height; y++) {
+			term_cells_clear(term_back + y*term_width, term_width);
+			term_lines_dirty[y] = TRUE;
 		}
+		last_cell = NULL;
 	}
 }
 
-/* Scroll window up/down */
-void term_window_scroll(TERM_WINDOW *window, int count)
+static void term_cells_scroll(TERM_CELL *cells, int y, int height, int count)
 {
-	int y;
+	TERM_CELL *start;
+	int move;
 
-	terminfo_scroll(window->y, window->y+window->height-1, count);
-        term_move_reset(vcx, vcy);
+	start = cells + y*term_width;
+	move = count > 0 ? count : -count;
+	if (move >= height) {
+		term_cells_clear(start, height*term_width);
+		return;
+	}
 
-        /* set the newly scrolled area dirty */
-	for (y = 0; y < window->height; y++)
-		term_lines_empty[window->y+y] = FALSE;
+	if (count > 0) {
+		memmove(start, start + move*term_width,
+			(height-move)*term_width*sizeof(TERM_CELL));
+		term_cells_clear(start + (height-move)*term_width,
+				 move*term_width);
+	} else if (count < 0) {
+		memmove(start + move*term_width, start,
+			(height-move)*term_width*sizeof(TERM_CELL));
+		term_cells_clear(start, move*term_width);
+	}
 }
 
-/* Change active color */
-void term_set_color(TERM_WINDOW *window, int col)
+/* Scroll the terminal the way term_back has been scrolled */
+static void term_scroll_flush(void)
 {
-	int set_normal;
-	int fg = col & 0x0f;
-	int bg = (col & 0xf0) >> 4;
+	int count;
 
-        set_normal = ((col & ATTR_RESETFG) && last_fg != -1) ||
-		((col & ATTR_RESETBG) && last_bg != -1);
-	if (((last_attrs & ATTR_BOLD) && (col & ATTR_BOLD) == 0) ||
-	    ((last_attrs & ATTR_BLINK) && (col & ATTR_BLINK) == 0)) {
-		/* we'll need to get rid of bold/blink - this can only be
-		   done with setting the default color */
-		set_normal = TRUE;
-	}
-
-	if (set_normal) {
-		last_fg = last_bg = -1;
-                last_attrs = 0;
-		terminfo_set_normal();
+	count = scroll_count;
+	scroll_count = 0;
+	if (count == 0 || count >= scroll_height || -count >= scroll_height) {
+		/* everything got scrolled out, the lines need to be
+		   redrawn anyway */
+		return;
 	}
 
-	if (!term_use_colors && (col & 0xf0) != 0)
-		col |= ATTR_REVERSE;
-
-	/* reversed text (use standout) */
-	if (col & ATTR_REVERSE) {
-		if ((last_attrs & ATTR_REVERSE) == 0)
-			terminfo_set_standout(TRUE);
-	} else if (last_attrs & ATTR_REVERSE)
-		terminfo_set_standout(FALSE);
+	/* let the terminal move the lines with its scroll region, the
+	   new lines get filled with the current background color */
+	if (last_col != ATTR_RESET)
+		term_set_color_real(ATTR_RESET);
+	terminfo_scroll(scroll_y, scroll_y+scroll_height-1, count);
+	cforcemove = TRUE;
 
-	/* set foreground color */
-	if (fg != last_fg &&
-	    (fg != 0 || (col & ATTR_RESETFG) == 0)) {
-                if (term_use_colors) {
-			last_fg = fg;
-			terminfo_set_fg(last_fg);
-		}
-	}
+	term_cells_scroll(term_front, scroll_y, scroll_height, count);
+}
 
-	/* set background color */
-	if (col & 0x80 && window->term->TI_colors == 8)
-		col |= ATTR_BLINK;
-	if (col & ATTR_BLINK)
-		current_term->set_blink(current_term);
+/* Scroll window up/down */
+void term_window_scroll(TERM_WINDOW *window, int count)
+{
+	int y, height;
 
-	if (bg != last_bg &&
-	    (bg != 0 || (col & ATTR_RESETBG) == 0)) {
-                if (term_use_colors) {
-			last_bg = bg;
-			terminfo_set_bg(last_bg);
-		}
-	}
+	height = window->height;
+	if (window->y+height > term_height)
+		height = term_height-window->y;
+	if (count == 0 || height <= 0)
+		return;
 
-	/* bold */
-	if (col & 0x08 && window->term->TI_colors == 8)
-		col |= ATTR_BOLD;
-	if (col & ATTR_BOLD)
-		terminfo_set_bold();
+	/* the terminal is scrolled only with the next refresh, so several
+	   scrolls of the same window become a single one */
+	if (scroll_count != 0 &&
+	    (scroll_y != window->y || scroll_height != height))
+		term_scroll_flush();
+	scroll_y = window->y;
+	scroll_height = height;
+	scroll_count += count;
 
-	/* underline */
-	if (col & ATTR_UNDERLINE) {
-		if ((last_attrs & ATTR_UNDERLINE) == 0)
-			terminfo_set_uline(TRUE);
-	} else if (last_attrs & ATTR_UNDERLINE)
-		terminfo_set_uline(FALSE);
+	term_cells_scroll(term_back, window->y, height, count);
+	for (y = 0; y < height; y++)
+		term_lines_dirty[window->y+y] = TRUE;
+	last_cell = NULL;
+}
 
-        last_attrs = col & ~0xff;
+/* Change active color */
+void term_set_color(TERM_WINDOW *window, int col)
+{
+	current_col = col;
 }
 
 void term_move(TERM_WINDOW *window, int x, int y)
 {
+	last_cell = NULL;
 	if (x >= 0 && y >= 0) {
-	vcmove = TRUE;
 	vcx = x+window->x;
         vcy = y+window->y;
 
@@ -378,104 +519,128 @@ void term_move(TERM_WINDOW *window, int x, int y)
 	}
 }
 
-static void term_printed_text(int count)
+/* Put a character to the current position in back buffer */
+static void term_put_cell(const char *data, int len, int width)
 {
-	term_lines_empty[vcy] = FALSE;
+	TERM_CELL *line, *cell;
 
-	/* if we continued writing past the line, wrap to next line.
-	   However, next term_move() really shouldn't try to cache
-	   the move, otherwise terminals would try to combine the
-	   last word in upper line with first word in lower line. */
-	vcx += count;
-	while (vcx >= term_width) {
-		vcx -= term_width;
+	if (len > TERM_CELL_MAX_BYTES)
+		len = TERM_CELL_MAX_BYTES;
+
+	if (vcx+width > term_width) {
+		/* doesn't fit, continue from the next line like
+		   the terminal would */
+		vcx = 0;
 		if (vcy < term_height-1) vcy++;
-		if (vcx > 0) term_lines_empty[vcy] = FALSE;
 	}
 
-	crealx += count;
-	if (crealx >= term_width)
-		cforcemove = TRUE;
+	line = term_back + vcy*term_width;
+	cell = line + vcx;
+
+	/* don't leave halves of wide characters behind */
+	if (cell->width == 0 && vcx > 0)
+		term_cells_clear(cell-1, 1);
+	if (cell[width-1].width == 2 && vcx+width < term_width)
+		term_cells_clear(cell+width, 1);
+
+	cell->col = current_col;
+	cell->len = len;
+	cell->width = width;
+	memcpy(cell->data, data, len);
+	if (width == 2) {
+		cell[1].col = current_col;
+		cell[1].len = cell[1].width = 0;
+	}
+	term_lines_dirty[vcy] = TRUE;
+	last_cell = cell;
+	last_cell_y = vcy;
+
+	vcx += width;
+	if (vcx >= term_width) {
+		vcx = 0;
+		if (vcy < term_height-1) vcy++;
+	}
 }
 
-void term_addch(TERM_WINDOW *window, char chr)
+/* Append zero width data (combining characters, UTF-8 continuation
+   bytes) to the previously written character */
+static void term_append_cell(const char *data, int len)
 {
-	if (vcmove) term_move_real();
+	if (last_cell != NULL &&
+	    last_cell->len+len <= TERM_CELL_MAX_BYTES) {
+		memcpy(last_cell->data + last_cell->len, data, len);
+		last_cell->len += len;
+		term_lines_dirty[last_cell_y] = TRUE;
+	}
+}
 
+void term_addch(TERM_WINDOW *window, char chr)
+{
 	/* With UTF-8, move cursor only if this char is either
 	   single-byte (8. bit off) or beginning of multibyte
 	   (7. bit off) */
 	if (term_type != TERM_TYPE_UTF8 ||
-	    (chr & 0x80) == 0 || (chr & 0x40) == 0) {
-		term_printed_text(1);
-	}
-
-	putc(chr, window->term->out);
-}
-
-static void term_addch_utf8(TERM_WINDOW *window, unichar chr)
-{
-	char buf[10];
-	int i, len;
-
-	len = g_unichar_to_utf8(chr, buf);
-	for (i = 0;  i < len; i++)
-                putc(buf[i], window->term->out);
+	    (chr & 0x80) == 0 || (chr & 0x40) != 0)
+		term_put_cell(&chr, 1, 1);
+	else
+		term_append_cell(&chr, 1);
 }
 
 void term_add_unichar(TERM_WINDOW *window, unichar chr)
 {
-	if (vcmove) term_move_real();
+	char buf[10];
+	int len, width;
 
 	switch (term_type) {
 	case TERM_TYPE_UTF8:
-	  	term_printed_text(unichar_isprint(chr) ? mk_wcwidth(chr) : 1);
-                term_addch_utf8(window, chr);
+		len = g_unichar_to_utf8(chr, buf);
+		width = unichar_isprint(chr) ? mk_wcwidth(chr) : 1;
+		if (width == 0)
+			term_append_cell(buf, len);
+		else
+			term_put_cell(buf, len, width < 0 ? 1 : width);
 		break;
 	case TERM_TYPE_BIG5:
 		if (chr > 0xff) {
-			term_printed_text(2);
-			putc((chr >> 8) & 0xff, window->term->out);
+			buf[0] = (chr >> 8) & 0xff;
+			buf[1] = chr & 0xff;
+			term_put_cell(buf, 2, 2);
 		} else {
-			term_printed_text(1);
+			buf[0] = chr & 0xff;
+			term_put_cell(buf, 1, 1);
 		}
-		putc((chr & 0xff), window->term->out);
                 break;
 	default:
-		term_printed_text(1);
-		putc(chr, window->term->out);
+		buf[0] = chr & 0xff;
+		term_put_cell(buf, 1, 1);
                 break;
 	}
 }
 
 void term_addstr(TERM_WINDOW *window, const char *str)
 {
-	int len;
-
-	if (vcmove) term_move_real();
-	len = strlen(str); /* FIXME utf8 or big5 */
-        term_printed_text(len);
-
-	fwrite(str, 1, len, window->term->out);
+	/* FIXME utf8 or big5 */
+	while (*str != '\0')
+		term_addch(window, *str++);
 }
 
 void term_clrtoeol(TERM_WINDOW *window)
 {
-	/* clrtoeol() doesn't necessarily understand colors */
-	if (last_fg == -1 && last_bg == -1 &&
-	    (last_attrs & (ATTR_UNDERLINE|ATTR_REVERSE)) == 0) {
-		if (!term_lines_empty[vcy]) {
-			if (vcmove) term_move_real();
-			terminfo_clrtoeol();
-			if (vcx == 0) term_lines_empty[vcy] = TRUE;
-		}
-	} else if (vcx < term_width) {
-		/* we'll need to fill the line ourself. */
-		if (vcmove) term_move_real();
-		terminfo_repeat(' ', term_width-vcx);
-		terminfo_move(vcx, vcy);
-                term_lines_empty[vcy] = FALSE;
+	TERM_CELL *cell;
+	int x;
+
+	cell = term_back + vcy*term_width + vcx;
+	if (cell->width == 0 && vcx > 0)
+		term_cells_clear(cell-1, 1);
+
+	term_cells_clear(cell, term_width-vcx);
+	if (!CELL_COLOR_PLAIN(current_col)) {
+		/* the blanks need to be drawn with the current color */
+		for (x = vcx; x < term_width; x++, cell++)
+			cell->col = current_col;
 	}
+	term_lines_dirty[vcy] = TRUE;
+	last_cell = NULL;
 }
 
 void term_move_cursor(int x, int y)
@@ -484,21 +649,111 @@ void term_move_cursor(int x, int y)
         curs_y = y;
 }
 
+static int term_cell_equal(const TERM_CELL *c1, const TERM_CELL *c2)
+{
+	if (CELL_IS_BLANK(c1))
+		return CELL_IS_BLANK(c2);
+
+	return c1->col == c2->col && c1->width == c2->width &&
+		c1->len == c2->len && memcmp(c1->data, c2->data, c1->len) == 0;
+}
+
+/* Returns the position after the last non-blank cell in line */
+static int term_line_end(const TERM_CELL *line)
+{
+	int x;
+
+	for (x = term_width; x > 0; x--) {
+		if (!CELL_IS_BLANK(&line[x-1]))
+			break;
+	}
+	return x;
+}
+
+/* Write the changed cells of line to terminal */
+static void term_flush_line(int y)
+{
+	TERM_CELL *back, *front;
+	int x, end;
+
+	back = term_back + y*term_width;
+	front = term_front + y*term_width;
+	end = term_line_end(back);
+
+	for (x = 0; x < end; x++) {
+		/* right halves of wide characters get written with
+		   the left half */
+		if (back[x].width == 0)
+			continue;
+
+		if (term_cell_equal(&back[x], &front[x]) &&
+		    (back[x].width != 2 ||
+		     term_cell_equal(&back[x+1], &front[x+1])))
+			continue;
+
+		term_move_real(x, y);
+		if (back[x].col != last_col)
+			term_set_color_real(back[x].col);
+
+		fwrite(back[x].data, 1, back[x].len, current_term->out);
+		current_term->bytes_written += back[x].len;
+
+		/* if we continued writing past the line, next move
+		   shouldn't be cached, otherwise terminals would try to
+		   combine the last word in upper line with first word
+		   in lower line. */
+		crealx += back[x].width;
+		if (crealx >= term_width)
+			cforcemove = TRUE;
+	}
+
+	if (term_line_end(front) > end) {
+		/* rest of the line is blank */
+		term_move_real(end, y);
+		if (!CELL_COLOR_PLAIN(last_col))
+			term_set_color_real(ATTR_RESET);
+		terminfo_clrtoeol();
+	}
+
+	memcpy(front, back, term_width*sizeof(TERM_CELL));
+}
+
 void term_refresh(TERM_WINDOW *window)
 {
+	unsigned long bytes;
+	int y;
+
 	if (freeze_counter > 0)
 		return;
 
-	term_move(root_window, curs_x, curs_y);
-	term_move_real();
+	term_scroll_flush();
+	for (y = 0; y < term_height; y++) {
+		if (term_lines_dirty[y]) {
+			term_flush_line(y);
+			term_lines_dirty[y] = FALSE;
+		}
+	}
+
+	term_move_real(curs_x < term_width ? curs_x : term_width-1,
+		       curs_y < term_height ? curs_y : term_height-1);
 
 	if (!curs_visible) {
 		terminfo_set_cursor_visible(TRUE);
                 curs_visible = TRUE;
 	}
 
-	term_set_color(window, ATTR_RESET);
+	if (last_col != ATTR_RESET)
+		term_set_color_real(ATTR_RESET);
 	fflush(window != NULL ? window->term->out : current_term->out);
+
+	bytes = current_term->bytes_written - frame_start_bytes;
+	frame_start_bytes = current_term->bytes_written;
+	if (bytes > 0) {
+		frame_count++;
+		last_frame_bytes = bytes;
+		if (bytes > max_frame_bytes)
+			max_frame_bytes = bytes;
+	}
 }
 
 void term_refresh_freeze(void)
@@ -512,6 +767,14 @@ void term_refresh_thaw(void)
                 term_refresh(NULL);
 }
 
+void term_get_stats(TERM_STATS_REC *stats)
+{
+	stats->frames = frame_count;
+	stats->last_frame_bytes = last_frame_bytes;
+	stats->max_frame_bytes = max_frame_bytes;
+	stats->total_bytes = current_term->bytes_written;
+}
+
 void term_stop(void)
 {
 	terminfo_stop(current_term);
@@ -22,6 +22,8 @@
 #include "signals.h"
 #include "commands.h"
 #include "settings.h"
+#include "levels.h"
+#include "printtext.h"
 
 #include "term.h"
 #include "mainwindows.h"
@@ -106,6 +108,20 @@ static void cmd_redraw(void)
 	irssi_redraw();
 }
 
+/* SYNTAX: TERMSTATS */
+static void cmd_termstats(void)
+{
+	TERM_STATS_REC stats;
+
+	term_get_stats(&stats);
+	printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP,
+		  "Terminal output: %lu bytes in %u screen updates",
+		  stats.total_bytes, stats.frames);
+	printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP,
+		  "Last update: %lu bytes, largest update: %lu bytes",
+		  stats.last_frame_bytes, stats.max_frame_bytes);
+}
+
 static void read_settings(void)
 {
         const char *str;
@@ -160,6 +176,7 @@ void term_common_init(void)
 	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 	command_bind("resize", NULL, (SIGNAL_FUNC) cmd_resize);
 	command_bind("redraw", NULL, (SIGNAL_FUNC) cmd_redraw);
+	command_bind("termstats", NULL, (SIGNAL_FUNC) cmd_termstats);
 
 #ifdef SIGWINCH
 	sigemptyset (&act.sa_mask);
@@ -173,6 +190,7 @@ void term_common_deinit(void)
 {
 	command_unbind("resize", (SIGNAL_FUNC) cmd_resize);
 	command_unbind("redraw", (SIGNAL_FUNC) cmd_redraw);
+	command_unbind("termstats", (SIGNAL_FUNC) cmd_termstats);
 	signal_remove("beep", (SIGNAL_FUNC) term_beep);
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 }
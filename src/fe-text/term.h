@@ -22,6 +22,12 @@ typedef struct _TERM_WINDOW TERM_WINDOW;
 
 typedef guint32 unichar;
 
+typedef struct {
+	unsigned int frames; /* screen updates that wrote something */
+	unsigned long last_frame_bytes, max_frame_bytes;
+	unsigned long total_bytes;
+} TERM_STATS_REC;
+
 extern TERM_WINDOW *root_window;
 extern int term_width, term_height;
 extern int term_use_colors, term_type;
@@ -79,6 +85,9 @@ void term_refresh(TERM_WINDOW *window);
 
 void term_stop(void);
 
+/* Get statistics of the data written to terminal */
+void term_get_stats(TERM_STATS_REC *stats);
+
 /* keyboard input handling */
 void term_set_input_type(int type);
 void term_gets(GArray *buffer, int *line_count);
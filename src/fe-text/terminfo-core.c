@@ -9,6 +9,7 @@
 #define tput(s) tputs(s, 0, term_putchar)
 inline static int term_putchar(int c)
 {
+        current_term->bytes_written++;
         return fputc(c, current_term->out);
 }
 
@@ -296,6 +297,7 @@ static void _repeat(TERM_REC *term, char chr, int count)
 /* Repeat character (manual) */
 static void _repeat_manual(TERM_REC *term, char chr, int count)
 {
+	term->bytes_written += count;
 	while (count > 0) {
 		putc(chr, term->out);
 		count--;
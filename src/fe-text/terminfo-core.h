@@ -48,6 +48,9 @@ struct _TERM_REC {
 	FILE *in, *out;
 	struct termios tio, old_tio;
 
+	/* Number of bytes written to out */
+	unsigned long bytes_written;
+
         /* Terminal size */
         int width, height;
 
@@ -0,0 +1,121 @@
+/*
+ textbuffer-bench.c : time appending and trimming scrollback lines
+
+    Copyright (C) 2010 The Irssi project
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Build with "make textbuffer-bench" in src/fe-text. Appends lines to a
+   buffer and removes the oldest one once the scrollback is full, like
+   gui-printtext.c does with scrollback_lines. The memory used by the
+   buffer is printed after the run, and again after the scrollback is
+   cut to a tenth, like when scrollback_lines is lowered.
+
+   Usage: textbuffer-bench [<lines> [<scrollback lines>]] */
+
+#include "module.h"
+#include "textbuffer.h"
+
+#define DEFAULT_LINES 1000000
+#define DEFAULT_SCROLLBACK 100000
+
+static unsigned char *line_text(int *len)
+{
+	static const char text[] =
+		"<nick> some text that is about as long as "
+		"an average line on a busy channel";
+	unsigned char *data;
+
+	*len = sizeof(text)-1 + 2;
+	data = g_malloc(*len);
+	memcpy(data, text, sizeof(text)-1);
+	data[*len-2] = 0;
+	data[*len-1] = LINE_CMD_EOL;
+	return data;
+}
+
+static void print_memory(TEXT_BUFFER_REC *buffer, const char *when)
+{
+	size_t used, uncompressed;
+
+	textbuffer_get_memory(buffer, &used, &uncompressed);
+	printf("  %s: %d lines, %luk used\n", when, buffer->lines_count,
+	       (unsigned long) used / 1024);
+}
+
+static double bench(int lines, int scrollback, int compress)
+{
+	TEXT_BUFFER_REC *buffer;
+	LINE_INFO_REC info;
+	GTimer *timer;
+	unsigned char *data;
+	double secs;
+	int i, len;
+
+	data = line_text(&len);
+	info.level = 0;
+	info.time = time(NULL);
+
+	buffer = textbuffer_create();
+	timer = g_timer_new();
+	for (i = 0; i < lines; i++) {
+		textbuffer_append(buffer, data, len, &info);
+		if (scrollback > 0 && buffer->lines_count > scrollback)
+			textbuffer_remove(buffer, buffer->first_line);
+
+		/* compress everything except the chunk being written to,
+		   so trimming has to free compressed chunks */
+		if (compress && i % 10000 == 0)
+			textbuffer_compress(buffer, time(NULL)+1);
+	}
+	secs = g_timer_elapsed(timer, NULL);
+
+	print_memory(buffer, "full");
+	while (buffer->lines_count > 0 &&
+	       buffer->lines_count > (scrollback > 0 ? scrollback : lines)/10)
+		textbuffer_remove(buffer, buffer->first_line);
+	print_memory(buffer, "cut to a tenth");
+	textbuffer_destroy(buffer);
+
+	g_timer_destroy(timer);
+	g_free(data);
+	return secs;
+}
+
+int main(int argc, char **argv)
+{
+	int lines, scrollback;
+
+	lines = argc > 1 ? atoi(argv[1]) : DEFAULT_LINES;
+	scrollback = argc > 2 ? atoi(argv[2]) : DEFAULT_SCROLLBACK;
+	if (lines <= 0) {
+		fprintf(stderr, "usage: %s [<lines> [<scrollback lines>]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	textbuffer_init();
+	printf("%d lines, no trimming:\n", lines);
+	printf("  %.3fs\n", bench(lines, 0, FALSE));
+	printf("%d lines, scrollback %d:\n", lines, scrollback);
+	printf("  %.3fs\n", bench(lines, scrollback, FALSE));
+#ifdef HAVE_ZLIB
+	printf("%d lines, scrollback %d, compressed:\n", lines, scrollback);
+	printf("  %.3fs\n", bench(lines, scrollback, TRUE));
+#endif
+	textbuffer_deinit();
+	return 0;
+}
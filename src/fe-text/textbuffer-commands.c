@@ -313,30 +313,30 @@ static void cmd_scrollback_status(void)
 {
 	GSList *tmp;
         int total_lines;
-	size_t window_mem, total_mem;
+	size_t window_mem, window_full, total_mem, total_full;
 
-        total_lines = 0; total_mem = 0;
+        total_lines = 0; total_mem = total_full = 0;
 	for (tmp = windows; tmp != NULL; tmp = tmp->next) {
 		WINDOW_REC *window = tmp->data;
 		TEXT_BUFFER_VIEW_REC *view;
 
 		view = WINDOW_GUI(window)->view;
 
-		window_mem = sizeof(TEXT_BUFFER_REC);
-		window_mem += g_slist_length(view->buffer->text_chunks) *
-			sizeof(TEXT_CHUNK_REC);
-		window_mem += view->buffer->lines_count * sizeof(LINE_REC);
+		textbuffer_get_memory(view->buffer, &window_mem, &window_full);
 		total_lines += view->buffer->lines_count;
                 total_mem += window_mem;
+		total_full += window_full;
 		printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP,
-			  "Window %d: %d lines, %dkB of data",
+			  "Window %d: %d lines, %dkB of data "
+			  "(%dkB uncompressed)",
 			  window->refnum, view->buffer->lines_count,
-			  (int)(window_mem / 1024));
+			  (int)(window_mem / 1024), (int)(window_full / 1024));
 	}
 
 	printtext(NULL, NULL, MSGLEVEL_CLIENTCRAP,
-		  "Total: %d lines, %dkB of data",
-		  total_lines, (int)(total_mem / 1024));
+		  "Total: %d lines, %dkB of data (%dkB uncompressed)",
+		  total_lines, (int)(total_mem / 1024),
+		  (int)(total_full / 1024));
 }
 
 static void sig_away_changed(SERVER_REC *server)
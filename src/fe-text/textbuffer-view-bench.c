@@ -0,0 +1,119 @@
+/*
+ textbuffer-view-bench.c : time re-wrapping lines after view resizes
+
+    Copyright (C) 2010 The Irssi project
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Build with "make textbuffer-view-bench" in src/fe-text. Switches a
+   view between two widths, like toggling a split window does, and gets
+   the line cache of every line after each switch. The first two rounds
+   wrap all the lines, after that the spare caches should be reused.
+
+   Usage: textbuffer-view-bench [<lines> [<rounds>]] */
+
+#include "module.h"
+#include "settings.h"
+#include "textbuffer-view.h"
+
+#define DEFAULT_LINES 100000
+#define DEFAULT_ROUNDS 6
+#define WIDTH1 80
+#define WIDTH2 60
+
+/* the view isn't drawn anywhere, so the terminal and settings functions
+   it uses don't need to do anything */
+int term_width = WIDTH1;
+int term_type = TERM_TYPE_8BIT;
+
+void term_window_scroll(TERM_WINDOW *window, int count) {}
+void term_set_color(TERM_WINDOW *window, int col) {}
+void term_move(TERM_WINDOW *window, int x, int y) {}
+void term_addch(TERM_WINDOW *window, char chr) {}
+void term_add_unichar(TERM_WINDOW *window, unichar chr) {}
+void term_clrtoeol(TERM_WINDOW *window) {}
+void term_refresh(TERM_WINDOW *window) {}
+void term_refresh_freeze(void) {}
+void term_refresh_thaw(void) {}
+
+void settings_add_time_module(const char *module, const char *section,
+			      const char *key, const char *def) {}
+int settings_get_time(const char *key) { return 0; }
+
+static void buffer_fill(TEXT_BUFFER_REC *buffer, int lines)
+{
+	LINE_INFO_REC info;
+	GString *str;
+	int i;
+
+	/* long enough to wrap to a few lines in both widths */
+	str = g_string_new(NULL);
+	for (i = 0; i < 20; i++)
+		g_string_append(str, "word and ");
+	g_string_append_c(str, '\0');
+	g_string_append_c(str, (char) LINE_CMD_EOL);
+
+	info.level = 0;
+	info.time = time(NULL);
+	for (i = 0; i < lines; i++) {
+		textbuffer_append(buffer, (unsigned char *) str->str,
+				  str->len, &info);
+	}
+	g_string_free(str, TRUE);
+}
+
+int main(int argc, char **argv)
+{
+	TEXT_BUFFER_REC *buffer;
+	TEXT_BUFFER_VIEW_REC *view;
+	LINE_REC *line;
+	GTimer *timer;
+	int i, lines, rounds, width;
+
+	lines = argc > 1 ? atoi(argv[1]) : DEFAULT_LINES;
+	rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+	if (lines <= 0 || rounds <= 0) {
+		fprintf(stderr, "usage: %s [<lines> [<rounds>]]\n", argv[0]);
+		return 1;
+	}
+
+	textbuffer_init();
+	textbuffer_view_init();
+
+	buffer = textbuffer_create();
+	buffer_fill(buffer, lines);
+	view = textbuffer_view_create(buffer, WIDTH1, 50, TRUE, FALSE);
+
+	timer = g_timer_new();
+	for (i = 0; i < rounds; i++) {
+		width = i % 2 == 0 ? WIDTH1 : WIDTH2;
+
+		g_timer_start(timer);
+		textbuffer_view_resize(view, width, 50);
+		for (line = textbuffer_view_get_lines(view); line != NULL;
+		     line = line->next)
+			textbuffer_view_get_line_cache(view, line);
+		printf("round %d, width %d: %.3fs\n", i+1, width,
+		       g_timer_elapsed(timer, NULL));
+	}
+	g_timer_destroy(timer);
+
+	/* destroys the buffer too */
+	textbuffer_view_destroy(view);
+	textbuffer_view_deinit();
+	textbuffer_deinit();
+	return 0;
+}
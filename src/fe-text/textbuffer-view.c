@@ -21,6 +21,8 @@
 #define	G_LOG_DOMAIN "TextBufferView"
 
 #include "module.h"
+#include "settings.h"
+
 #include "textbuffer-view.h"
 #include "utf8.h"
 
@@ -34,8 +36,15 @@ typedef struct {
 /* how long to keep line cache in memory (seconds) */
 #define LINE_CACHE_KEEP_TIME (10*60)
 
+/* how many unused caches to keep for each buffer */
+#define MAX_SPARE_CACHES 2
+
 static int linecache_tag;
 static GSList *views;
+/* caches of other widths not used by any view now, kept so switching back
+   to the old width doesn't need to wrap all the lines again */
+static GSList *spare_caches;
+static GArray *line_cache_subs;
 
 #define view_is_bottom(view) \
         ((view)->ypos >= -1 && (view)->ypos < (view)->height)
@@ -59,24 +68,56 @@ static GSList *textbuffer_get_views(TEXT_BUFFER_REC *buffer)
         return NULL;
 }
 
+static int line_cache_destroy(void *key, LINE_CACHE_REC *cache)
+{
+	g_free(cache);
+	return TRUE;
+}
+
+static void textbuffer_cache_destroy(TEXT_BUFFER_CACHE_REC *cache)
+{
+	g_hash_table_foreach(cache->line_cache,
+			     (GHFunc) line_cache_destroy, NULL);
+	g_hash_table_destroy(cache->line_cache);
+        g_free(cache);
+}
+
 static TEXT_BUFFER_CACHE_REC *
-textbuffer_cache_get(GSList *views, int width)
+textbuffer_cache_get(TEXT_BUFFER_REC *buffer, GSList *views, int width)
 {
 	TEXT_BUFFER_CACHE_REC *cache;
+	GSList *tmp;
 
         /* check if there's existing cache with correct width */
-	while (views != NULL) {
-		TEXT_BUFFER_VIEW_REC *view = views->data;
+	for (tmp = views; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_VIEW_REC *view = tmp->data;
 
 		if (view->width == width) {
 			view->cache->refcount++;
 			return view->cache;
 		}
-                views = views->next;
+	}
+
+	for (tmp = spare_caches; tmp != NULL; tmp = tmp->next) {
+		cache = tmp->data;
+
+		if (cache->buffer == buffer && cache->width == width) {
+			spare_caches = g_slist_remove(spare_caches, cache);
+			cache->refcount = 1;
+			if (views != NULL) {
+				TEXT_BUFFER_VIEW_REC *view = views->data;
+
+				/* the counter may have changed meanwhile */
+				cache->update_counter =
+					view->cache->update_counter;
+			}
+			return cache;
+		}
 	}
 
         /* create new cache */
 	cache = g_new0(TEXT_BUFFER_CACHE_REC, 1);
+	cache->buffer = buffer;
 	cache->refcount = 1;
         cache->width = width;
 	cache->line_cache = g_hash_table_new((GHashFunc) g_direct_hash,
@@ -84,24 +125,64 @@ textbuffer_cache_get(GSList *views, int width)
         return cache;
 }
 
-static int line_cache_destroy(void *key, LINE_CACHE_REC *cache)
+static void textbuffer_cache_unref(TEXT_BUFFER_CACHE_REC *cache)
 {
-	g_free(cache);
-	return TRUE;
+	GSList *tmp, *next;
+	int count;
+
+	if (--cache->refcount > 0)
+		return;
+
+	/* keep it for a while, dropping the oldest spare of the buffer */
+	spare_caches = g_slist_prepend(spare_caches, cache);
+
+	count = 0;
+	for (tmp = spare_caches; tmp != NULL; tmp = next) {
+		TEXT_BUFFER_CACHE_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (rec->buffer == cache->buffer &&
+		    ++count > MAX_SPARE_CACHES) {
+			spare_caches = g_slist_remove(spare_caches, rec);
+			textbuffer_cache_destroy(rec);
+		}
+	}
 }
 
-static void textbuffer_cache_destroy(TEXT_BUFFER_CACHE_REC *cache)
+/* Destroy the unused caches of buffer, they've become invalid */
+static void spare_caches_destroy(TEXT_BUFFER_REC *buffer)
 {
-	g_hash_table_foreach(cache->line_cache,
-			     (GHFunc) line_cache_destroy, NULL);
-	g_hash_table_destroy(cache->line_cache);
-        g_free(cache);
+	GSList *tmp, *next;
+
+	for (tmp = spare_caches; tmp != NULL; tmp = next) {
+		TEXT_BUFFER_CACHE_REC *rec = tmp->data;
+
+		next = tmp->next;
+		if (rec->buffer == buffer) {
+			spare_caches = g_slist_remove(spare_caches, rec);
+			textbuffer_cache_destroy(rec);
+		}
+	}
 }
 
-static void textbuffer_cache_unref(TEXT_BUFFER_CACHE_REC *cache)
+/* The line was changed or removed, remove it from unused caches */
+static void spare_caches_remove_line(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 {
-	if (--cache->refcount == 0)
-                textbuffer_cache_destroy(cache);
+	LINE_CACHE_REC *cache;
+	GSList *tmp;
+
+	for (tmp = spare_caches; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_CACHE_REC *rec = tmp->data;
+
+		if (rec->buffer != buffer)
+			continue;
+
+		cache = g_hash_table_lookup(rec->line_cache, line);
+		if (cache != NULL) {
+			g_free(cache);
+			g_hash_table_remove(rec->line_cache, line);
+		}
+	}
 }
 
 #define FGATTR (ATTR_NOCOLORS | ATTR_RESETFG | 0x0f)
@@ -167,13 +248,12 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
         INDENT_FUNC indent_func;
 	LINE_CACHE_REC *rec;
 	LINE_CACHE_SUB_REC *sub;
-	GSList *lines;
         unsigned char cmd;
 	const unsigned char *ptr, *next_ptr, *last_space_ptr;
-	int xpos, pos, indent_pos, last_space, last_color, color, linecount;
+	int xpos, indent_pos, last_space, last_color, color, linecount;
 	int char_width;
 
-	g_return_val_if_fail(line->text != NULL, NULL);
+	g_return_val_if_fail(line != NULL, NULL);
 
 	color = ATTR_RESETFG | ATTR_RESETBG;
 	xpos = 0; indent_pos = view->default_indent;
@@ -181,8 +261,8 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
 
         indent_func = view->default_indent_func;
         linecount = 1;
-	lines = NULL;
-	for (ptr = line->text;;) {
+	g_array_set_size(line_cache_subs, 0);
+	for (ptr = textbuffer_line_text(line);;) {
 		if (*ptr == '\0') {
 			/* command */
 			ptr++;
@@ -193,10 +273,7 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
 				break;
 
 			if (cmd == LINE_CMD_CONTINUE) {
-				unsigned char *tmp;
-
-				memcpy(&tmp, ptr, sizeof(char *));
-				ptr = tmp;
+				ptr = textbuffer_text_continue(ptr);
 				continue;
 			}
 
@@ -233,7 +310,14 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
 			xpos = indent_func == NULL ? indent_pos :
 				indent_func(view, line, -1);
 
-			sub = g_new0(LINE_CACHE_SUB_REC, 1);
+			/* sub-lines are collected to a reused array, so
+			   only the final cache record is allocated */
+			g_array_set_size(line_cache_subs,
+					 line_cache_subs->len+1);
+			sub = &g_array_index(line_cache_subs,
+					     LINE_CACHE_SUB_REC,
+					     line_cache_subs->len-1);
+			memset(sub, 0, sizeof(LINE_CACHE_SUB_REC));
 			if (last_space > indent_pos && last_space > 10) {
                                 /* go back to last space */
                                 color = last_color;
@@ -250,7 +334,6 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
                         sub->indent_func = indent_func;
 			sub->color = color;
 
-			lines = g_slist_append(lines, sub);
 			linecount++;
 
 			last_space = 0;
@@ -277,15 +360,8 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
 	rec->count = linecount;
 
 	if (rec->count > 1) {
-		for (pos = 0; lines != NULL; pos++) {
-			void *data = lines->data;
-
-			memcpy(&rec->lines[pos], data,
-			       sizeof(LINE_CACHE_SUB_REC));
-
-			lines = g_slist_remove(lines, data);
-			g_free(data);
-		}
+		memcpy(rec->lines, line_cache_subs->data,
+		       sizeof(LINE_CACHE_SUB_REC) * (linecount-1));
 	}
 
 	g_hash_table_insert(view->cache->line_cache, line, rec);
@@ -325,12 +401,15 @@ static void view_reset_cache(TEXT_BUFFER_VIEW_REC *view)
 	   unrefs + cache_get()s or it will keep using the old caches */
 	textbuffer_cache_unref(view->cache);
         g_slist_foreach(view->siblings, (GFunc) textbuffer_cache_unref, NULL);
+	spare_caches_destroy(view->buffer);
 
-	view->cache = textbuffer_cache_get(view->siblings, view->width);
+	view->cache = textbuffer_cache_get(view->buffer, view->siblings,
+					   view->width);
 	for (tmp = view->siblings; tmp != NULL; tmp = tmp->next) {
 		TEXT_BUFFER_VIEW_REC *rec = tmp->data;
 
-		rec->cache = textbuffer_cache_get(rec->siblings, rec->width);
+		rec->cache = textbuffer_cache_get(rec->buffer, rec->siblings,
+						  rec->width);
 	}
 }
 
@@ -340,7 +419,6 @@ static int view_line_draw(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line,
         INDENT_FUNC indent_func;
 	LINE_CACHE_REC *cache;
         const unsigned char *text, *end, *text_newline;
-	unsigned char *tmp;
 	unichar chr;
 	int xpos, color, drawcount, first, need_move, need_clrtoeol, char_width;
 
@@ -355,7 +433,8 @@ static int view_line_draw(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line,
         need_move = TRUE; need_clrtoeol = FALSE;
 	xpos = drawcount = 0; first = TRUE;
 	text_newline = text =
-		subline == 0 ? line->text : cache->lines[subline-1].start;
+		subline == 0 ? textbuffer_line_text(line) :
+		cache->lines[subline-1].start;
 	for (;;) {
 		if (text == text_newline) {
 			if (need_clrtoeol && xpos < term_width) {
@@ -419,8 +498,7 @@ static int view_line_draw(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line,
 
 			if (*text == LINE_CMD_CONTINUE) {
                                 /* jump to next block */
-				memcpy(&tmp, text+1, sizeof(unsigned char *));
-				text = tmp;
+				text = textbuffer_text_continue(text+1);
 				continue;
 			} else {
 				update_cmd_color(*text, &color);
@@ -540,7 +618,7 @@ TEXT_BUFFER_VIEW_REC *textbuffer_view_create(TEXT_BUFFER_REC *buffer,
 	view->scroll = scroll;
         view->utf8 = utf8;
 
-	view->cache = textbuffer_cache_get(view->siblings, width);
+	view->cache = textbuffer_cache_get(buffer, view->siblings, width);
 	textbuffer_view_init_bottom(view);
 
 	view->startline = view->bottom_startline;
@@ -582,6 +660,8 @@ void textbuffer_view_destroy(TEXT_BUFFER_VIEW_REC *view)
 	g_hash_table_destroy(view->bookmarks);
 
         textbuffer_cache_unref(view->cache);
+	if (view->siblings == NULL)
+		spare_caches_destroy(view->buffer);
 	g_free(view);
 }
 
@@ -608,7 +688,8 @@ static void view_unregister_indent_func(TEXT_BUFFER_VIEW_REC *view,
 	/* recreate cache so it won't contain references
 	   to the indent function */
 	view_reset_cache(view);
-	view->cache = textbuffer_cache_get(view->siblings, view->width);
+	view->cache = textbuffer_cache_get(view->buffer, view->siblings,
+					   view->width);
 }
 
 void textbuffer_views_unregister_indent_func(INDENT_FUNC indent_func)
@@ -780,7 +861,8 @@ void textbuffer_view_resize(TEXT_BUFFER_VIEW_REC *view, int width, int height)
 	if (view->width != width) {
                 /* line cache needs to be recreated */
 		textbuffer_cache_unref(view->cache);
-		view->cache = textbuffer_cache_get(view->siblings, width);
+		view->cache = textbuffer_cache_get(view->buffer,
+						   view->siblings, width);
 	}
 
 	view->width = width > 10 ? width : 10;
@@ -983,6 +1065,7 @@ void textbuffer_view_insert_line(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
                 return;
 
         update_counter = view->cache->update_counter+1;
+	spare_caches_remove_line(view->buffer, line);
 	view_update_cache(view, line, update_counter);
         view_insert_line(view, line);
 
@@ -1146,6 +1229,7 @@ void textbuffer_view_remove_line(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
 
         view_remove_line(view, line, linecount);
 	view_remove_cache(view, line, update_counter);
+	spare_caches_remove_line(view->buffer, line);
 
 	for (tmp = view->siblings; tmp != NULL; tmp = tmp->next) {
 		TEXT_BUFFER_VIEW_REC *rec = tmp->data;
@@ -1275,10 +1359,45 @@ static int line_cache_check_remove(void *key, LINE_CACHE_REC *cache,
 	return TRUE;
 }
 
+/* Compress the scrollback that hasn't been accessed since `last_access' */
+static void views_compress(time_t last_access)
+{
+	GSList *tmp, *buffers, *compressed;
+
+	buffers = compressed = NULL;
+	for (tmp = views; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_VIEW_REC *rec = tmp->data;
+
+		if (g_slist_find(buffers, rec->buffer) != NULL)
+			continue;
+
+		buffers = g_slist_prepend(buffers, rec->buffer);
+		if (textbuffer_compress(rec->buffer, last_access) > 0) {
+			compressed = g_slist_prepend(compressed, rec->buffer);
+			spare_caches_destroy(rec->buffer);
+		}
+	}
+
+	/* the caches of every view of the compressed buffers point to
+	   the uncompressed text */
+	for (tmp = views; tmp != NULL && compressed != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_VIEW_REC *rec = tmp->data;
+
+		if (g_slist_find(compressed, rec->buffer) != NULL) {
+			g_hash_table_foreach_remove(rec->cache->line_cache,
+						    (GHRFunc) line_cache_destroy,
+						    NULL);
+		}
+	}
+
+	g_slist_free(buffers);
+	g_slist_free(compressed);
+}
+
 static int sig_check_linecache(void)
 {
 	GSList *tmp, *caches;
-        time_t now;
+        time_t now, compress_time;
 
         now = time(NULL); caches = NULL;
 	for (tmp = views; tmp != NULL; tmp = tmp->next) {
@@ -1294,15 +1413,37 @@ static int sig_check_linecache(void)
 	}
 
         g_slist_free(caches);
+
+	for (tmp = spare_caches; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_CACHE_REC *rec = tmp->data;
+
+		g_hash_table_foreach_remove(rec->line_cache,
+					    (GHRFunc) line_cache_check_remove,
+					    &now);
+	}
+
+	compress_time = settings_get_time("scrollback_compress_time")/1000;
+	if (compress_time > 0)
+		views_compress(now-compress_time);
 	return 1;
 }
 
 void textbuffer_view_init(void)
 {
+	settings_add_time("history", "scrollback_compress_time", "1h");
+
+	spare_caches = NULL;
+	line_cache_subs = g_array_new(FALSE, FALSE,
+				      sizeof(LINE_CACHE_SUB_REC));
+
 	linecache_tag = g_timeout_add(LINE_CACHE_CHECK_TIME, (GSourceFunc) sig_check_linecache, NULL);
 }
 
 void textbuffer_view_deinit(void)
 {
+	g_slist_foreach(spare_caches, (GFunc) textbuffer_cache_destroy, NULL);
+	g_slist_free(spare_caches);
+	g_array_free(line_cache_subs, TRUE);
+
 	g_source_remove(linecache_tag);
 }
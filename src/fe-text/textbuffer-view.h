@@ -32,6 +32,7 @@ typedef struct {
 } LINE_CACHE_REC;
 
 typedef struct {
+	TEXT_BUFFER_REC *buffer;
 	int refcount;
 	int width;
 
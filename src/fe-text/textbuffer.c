@@ -30,13 +30,69 @@
 #  include <regex.h>
 #endif
 
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
 #define TEXT_CHUNK_USABLE_SIZE (LINE_TEXT_CHUNK_SIZE-2-(int)sizeof(char*))
 
+/* LINE_RECs are allocated in blocks of this many lines, doubled for each
+   new block up to the max. */
+#define LINE_BLOCK_MIN_SIZE 32
+#define LINE_BLOCK_MAX_SIZE 1024
+
+struct _TEXT_BUFFER_SEARCH_REC {
+	TEXT_BUFFER_REC *buffer; /* NULL if buffer was destroyed */
+
+	GPtrArray *matches;
+	GHashTable *match_lines; /* lines in matches */
+	LINE_REC *last_added;
+
+	LINE_REC *line; /* next line to check, NULL when finished */
+	LINE_REC *first, *last; /* the range of lines being searched */
+
+	int level, nolevel;
+	char *text;
+	int before, after, match_after;
+	int max_matches, match_count;
+
+	unsigned int backwards:1;
+	unsigned int regexp:1;
+	unsigned int finished:1;
+#ifdef HAVE_REGEX_H
+	regex_t preg;
+#endif
+	char *(*match_func)(const char *, const char *);
+
+	GString *str;
+};
+
+typedef struct _LINE_BLOCK_REC LINE_BLOCK_REC;
+
+typedef struct {
+	LINE_REC line; /* must be first */
+	LINE_BLOCK_REC *block; /* block the line was allocated from */
+	TEXT_CHUNK_REC *chunk; /* chunk where the line's text begins */
+	int offset; /* position of the text in chunk */
+	int chunks; /* number of chunks the text spans */
+} TEXT_LINE_REC;
+
+struct _LINE_BLOCK_REC {
+	LINE_BLOCK_REC *prev, *next;
+	int size, used;
+	TEXT_LINE_REC lines[1];
+};
+
+/* text of the lines whose chunk couldn't be uncompressed */
+static unsigned char lost_text[] = { 0, LINE_CMD_EOL };
+
 TEXT_BUFFER_REC *textbuffer_create(void)
 {
 	TEXT_BUFFER_REC *buffer;
 
 	buffer = g_slice_new0(TEXT_BUFFER_REC);
+	buffer->text_chunks = g_ptr_array_new();
+	buffer->line_block_size = LINE_BLOCK_MIN_SIZE;
 	buffer->last_eol = TRUE;
 	buffer->last_fg = LINE_COLOR_DEFAULT;
 	buffer->last_bg = LINE_COLOR_DEFAULT | LINE_COLOR_BG;
@@ -45,26 +101,104 @@ TEXT_BUFFER_REC *textbuffer_create(void)
 
 void textbuffer_destroy(TEXT_BUFFER_REC *buffer)
 {
+	GSList *tmp;
+
 	g_return_if_fail(buffer != NULL);
 
 	textbuffer_remove_all_lines(buffer);
+	g_ptr_array_free(buffer->text_chunks, TRUE);
+
+	for (tmp = buffer->searches; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_SEARCH_REC *search = tmp->data;
+
+		search->buffer = NULL;
+	}
+	g_slist_free(buffer->searches);
         g_slice_free(TEXT_BUFFER_REC, buffer);
 }
 
-static TEXT_CHUNK_REC *text_chunk_find(TEXT_BUFFER_REC *buffer,
-				       const unsigned char *data)
+static void free_line_push(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 {
-	GSList *tmp;
+	line->prev = NULL;
+	line->next = buffer->free_lines;
+	if (line->next != NULL)
+		line->next->prev = line;
+	buffer->free_lines = line;
+}
 
-	for (tmp = buffer->text_chunks; tmp != NULL; tmp = tmp->next) {
-		TEXT_CHUNK_REC *rec = tmp->data;
+static void free_line_unlink(TEXT_BUFFER_REC *buffer, LINE_REC *line)
+{
+	if (line->prev != NULL)
+		line->prev->next = line->next;
+	else
+		buffer->free_lines = line->next;
+	if (line->next != NULL)
+		line->next->prev = line->prev;
+}
+
+static LINE_REC *line_alloc(TEXT_BUFFER_REC *buffer)
+{
+	LINE_BLOCK_REC *block;
+	LINE_REC *line;
+	int i, size;
+
+	if (buffer->free_lines == NULL) {
+		/* allocate a new block, and put all of its lines to
+		   free list */
+		size = buffer->line_block_size;
+		if (size < LINE_BLOCK_MAX_SIZE)
+			buffer->line_block_size *= 2;
+
+		block = g_malloc(sizeof(LINE_BLOCK_REC) +
+				 (size-1) * sizeof(TEXT_LINE_REC));
+		block->size = size;
+		block->used = 0;
+		block->prev = NULL;
+		block->next = buffer->line_blocks;
+		if (block->next != NULL)
+			block->next->prev = block;
+		buffer->line_blocks = block;
+
+		for (i = size-1; i >= 0; i--) {
+			block->lines[i].block = block;
+			free_line_push(buffer, &block->lines[i].line);
+		}
+	}
 
-		if (data >= rec->buffer &&
-		    data < rec->buffer+sizeof(rec->buffer))
-                        return rec;
+	line = buffer->free_lines;
+	free_line_unlink(buffer, line);
+	((TEXT_LINE_REC *) line)->block->used++;
+	return line;
+}
+
+static void line_free(TEXT_BUFFER_REC *buffer, LINE_REC *line)
+{
+	LINE_BLOCK_REC *block;
+	int i;
+
+	block = ((TEXT_LINE_REC *) line)->block;
+	if (--block->used > 0) {
+		free_line_push(buffer, line);
+		return;
+	}
+
+	/* last line of the block was removed, the rest of its lines are
+	   in the free list */
+	for (i = 0; i < block->size; i++) {
+		if (&block->lines[i].line != line)
+			free_line_unlink(buffer, &block->lines[i].line);
 	}
 
-	return NULL;
+	if (block->prev != NULL)
+		block->prev->next = block->next;
+	else
+		buffer->line_blocks = block->next;
+	if (block->next != NULL)
+		block->next->prev = block->prev;
+	g_free(block);
+
+	if (buffer->line_blocks == NULL)
+		buffer->line_block_size = LINE_BLOCK_MIN_SIZE;
 }
 
 #define mark_temp_eol(chunk) G_STMT_START { \
@@ -72,77 +206,144 @@ static TEXT_CHUNK_REC *text_chunk_find(TEXT_BUFFER_REC *buffer,
 	(chunk)->buffer[(chunk)->pos+1] = LINE_CMD_EOL; \
 	} G_STMT_END
 
+static void text_chunk_free(TEXT_CHUNK_REC *chunk)
+{
+	g_free(chunk->buffer);
+	g_free(chunk->cold_data);
+	g_slice_free(TEXT_CHUNK_REC, chunk);
+}
+
+#ifdef HAVE_ZLIB
+static int text_chunk_compress(TEXT_CHUNK_REC *chunk)
+{
+	static unsigned char *cold_buf = NULL;
+	static uLongf cold_buf_size = 0;
+	uLongf size;
+
+	if (cold_buf == NULL) {
+		cold_buf_size = compressBound(LINE_TEXT_CHUNK_SIZE);
+		cold_buf = g_malloc(cold_buf_size);
+	}
+
+	/* compress the text and the following LINE_CMD_CONTINUE */
+	size = cold_buf_size;
+	if (compress2(cold_buf, &size, chunk->buffer,
+		      chunk->pos + 2 + sizeof(TEXT_CHUNK_REC *),
+		      Z_DEFAULT_COMPRESSION) != Z_OK ||
+	    size >= LINE_TEXT_CHUNK_SIZE/2) {
+		/* doesn't compress well, don't try again for a while */
+		chunk->last_access = time(NULL);
+		return FALSE;
+	}
+
+	chunk->cold_data = g_memdup(cold_buf, size);
+	chunk->cold_size = size;
+	g_free(chunk->buffer);
+	chunk->buffer = NULL;
+	return TRUE;
+}
+
+static void text_chunk_uncompress(TEXT_CHUNK_REC *chunk)
+{
+	uLongf size;
+
+	chunk->buffer = g_malloc(LINE_TEXT_CHUNK_SIZE);
+	size = LINE_TEXT_CHUNK_SIZE;
+	if (uncompress(chunk->buffer, &size, chunk->cold_data,
+		       chunk->cold_size) != Z_OK) {
+		/* the lines' text is gone, they're shown empty from now on */
+		g_warning("Couldn't uncompress text buffer, "
+			  "dropping %d lines", chunk->refcount);
+		g_free(chunk->buffer);
+		chunk->buffer = NULL;
+	}
+
+	g_free(chunk->cold_data);
+	chunk->cold_data = NULL;
+	chunk->cold_size = 0;
+}
+#else
+#define text_chunk_uncompress(chunk)
+#endif
+
+/* Return the text of the chunk, uncompressing it if needed.
+   Returns NULL if the text was lost. */
+static unsigned char *text_chunk_get_buffer(TEXT_CHUNK_REC *chunk)
+{
+	if (chunk->buffer == NULL && chunk->cold_data != NULL)
+		text_chunk_uncompress(chunk);
+	chunk->last_access = time(NULL);
+	return chunk->buffer;
+}
+
 static TEXT_CHUNK_REC *text_chunk_create(TEXT_BUFFER_REC *buffer)
 {
-	TEXT_CHUNK_REC *rec;
-	unsigned char *buf, *ptr, **pptr;
+	TEXT_CHUNK_REC *rec, *ptr, **pptr;
+	unsigned char *buf;
 
-	rec = g_slice_new(TEXT_CHUNK_REC);
-	rec->pos = 0;
-	rec->refcount = 0;
+	rec = g_slice_new0(TEXT_CHUNK_REC);
+	rec->buffer = g_malloc(LINE_TEXT_CHUNK_SIZE);
+	rec->last_access = time(NULL);
 
 	if (buffer->cur_line != NULL && buffer->cur_line->text != NULL) {
 		/* create a link to new block from the old block */
 		buf = buffer->cur_text->buffer + buffer->cur_text->pos;
 		*buf++ = 0; *buf++ = (char) LINE_CMD_CONTINUE;
 
-		/* we want to store pointer to beginning of the new text
-		   block to char* buffer. this probably isn't ANSI-C
-		   compatible, and trying this without the pptr variable
-		   breaks at least NetBSD/Alpha, so don't go "optimize"
-		   it :) */
-		ptr = rec->buffer; pptr = &ptr;
-		memcpy(buf, pptr, sizeof(unsigned char *));
+		/* we want to store pointer to the new text block to
+		   char* buffer. this probably isn't ANSI-C compatible,
+		   and trying this without the pptr variable breaks at
+		   least NetBSD/Alpha, so don't go "optimize" it :) */
+		ptr = rec; pptr = &ptr;
+		memcpy(buf, pptr, sizeof(TEXT_CHUNK_REC *));
+		buffer->cur_text->next = rec;
 	} else {
 		/* just to be safe */
 		mark_temp_eol(rec);
 	}
 
 	buffer->cur_text = rec;
-	buffer->text_chunks = g_slist_append(buffer->text_chunks, rec);
+	rec->index = buffer->text_chunks->len;
+	g_ptr_array_add(buffer->text_chunks, rec);
 	return rec;
 }
 
 static void text_chunk_destroy(TEXT_BUFFER_REC *buffer, TEXT_CHUNK_REC *chunk)
 {
-	buffer->text_chunks = g_slist_remove(buffer->text_chunks, chunk);
-	g_slice_free(TEXT_CHUNK_REC, chunk);
+	TEXT_CHUNK_REC *last;
+
+	/* move the last chunk to the removed one's place */
+	last = g_ptr_array_index(buffer->text_chunks,
+				 buffer->text_chunks->len-1);
+	last->index = chunk->index;
+	g_ptr_array_remove_index_fast(buffer->text_chunks, chunk->index);
+
+	text_chunk_free(chunk);
 }
 
 static void text_chunk_line_free(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 {
-	TEXT_CHUNK_REC *chunk;
-	const unsigned char *text;
-        unsigned char cmd, *tmp = NULL;
-
-	for (text = line->text;; text++) {
-		if (*text != '\0')
-                        continue;
-
-		text++;
-		cmd = *text;
-		if (cmd == LINE_CMD_CONTINUE || cmd == LINE_CMD_EOL) {
-			if (cmd == LINE_CMD_CONTINUE)
-				memcpy(&tmp, text+1, sizeof(char *));
-
-			/* free the previous block */
-			chunk = text_chunk_find(buffer, text);
-			if (--chunk->refcount == 0) {
-				if (buffer->cur_text == chunk)
-					chunk->pos = 0;
-				else
-					text_chunk_destroy(buffer, chunk);
-			}
-
-			if (cmd == LINE_CMD_EOL)
-				break;
-
-			text = tmp-1;
+	TEXT_LINE_REC *rec = (TEXT_LINE_REC *) line;
+	TEXT_CHUNK_REC *chunk, *next;
+	int i;
+
+	/* the text begins from the chunk where the line was created and
+	   continues in the following ones. this doesn't need the text, so
+	   compressed chunks are freed without uncompressing them. */
+	chunk = rec->chunk;
+	for (i = 0; i < rec->chunks; i++) {
+		next = chunk->next;
+		if (--chunk->refcount == 0) {
+			if (buffer->cur_text == chunk)
+				chunk->pos = 0;
+			else
+				text_chunk_destroy(buffer, chunk);
 		}
+		chunk = next;
 	}
 }
 
-static void text_chunk_append(TEXT_BUFFER_REC *buffer,
+static void text_chunk_append(TEXT_BUFFER_REC *buffer, LINE_REC *line,
 			      const unsigned char *data, int len)
 {
         TEXT_CHUNK_REC *chunk;
@@ -162,6 +363,7 @@ static void text_chunk_append(TEXT_BUFFER_REC *buffer,
 
 		chunk = text_chunk_create(buffer);
 		chunk->refcount++;
+		((TEXT_LINE_REC *) line)->chunks++;
 		len -= left; data += left;
 	}
 
@@ -178,8 +380,11 @@ static LINE_REC *textbuffer_line_create(TEXT_BUFFER_REC *buffer)
 	if (buffer->cur_text == NULL)
                 text_chunk_create(buffer);
 
-	rec = g_slice_new(LINE_REC);
+	rec = line_alloc(buffer);
 	rec->text = buffer->cur_text->buffer + buffer->cur_text->pos;
+	((TEXT_LINE_REC *) rec)->chunk = buffer->cur_text;
+	((TEXT_LINE_REC *) rec)->offset = buffer->cur_text->pos;
+	((TEXT_LINE_REC *) rec)->chunks = 1;
 
 	buffer->cur_text->refcount++;
         return rec;
@@ -300,7 +505,7 @@ LINE_REC *textbuffer_insert(TEXT_BUFFER_REC *buffer, LINE_REC *insert_after,
 	if (info != NULL)
 		memcpy(&line->info, info, sizeof(line->info));
 
-	text_chunk_append(buffer, data, len);
+	text_chunk_append(buffer, line, data, len);
 
 	buffer->last_eol = len >= 2 &&
 		data[len-2] == 0 && data[len-1] == LINE_CMD_EOL;
@@ -314,11 +519,58 @@ LINE_REC *textbuffer_insert(TEXT_BUFFER_REC *buffer, LINE_REC *insert_after,
         return line;
 }
 
+#define search_step(search, line) \
+	((line) == ((search)->backwards ? (search)->first : (search)->last) ? \
+	 NULL : (search)->backwards ? (line)->prev : (line)->next)
+
+static void search_line_removed(TEXT_BUFFER_SEARCH_REC *search,
+				LINE_REC *line)
+{
+	guint i;
+
+	if (search->line == line)
+		search->line = search_step(search, line);
+	if (search->first == line)
+		search->first = line->next;
+	if (search->last == line)
+		search->last = line->prev;
+	if (search->last_added == line)
+		search->last_added = line->prev;
+
+	if (g_hash_table_lookup(search->match_lines, line) == NULL)
+		return;
+	g_hash_table_remove(search->match_lines, line);
+
+	/* old lines are removed first, so this is usually found fast */
+	for (i = 0; i < search->matches->len; i++) {
+		if (g_ptr_array_index(search->matches, i) == line) {
+			g_ptr_array_remove_index(search->matches, i);
+			break;
+		}
+	}
+}
+
+static void search_clear(TEXT_BUFFER_SEARCH_REC *search)
+{
+	search->line = search->first = search->last = NULL;
+	search->last_added = NULL;
+
+	g_ptr_array_set_size(search->matches, 0);
+	g_hash_table_destroy(search->match_lines);
+	search->match_lines = g_hash_table_new((GHashFunc) g_direct_hash,
+					       (GCompareFunc) g_direct_equal);
+}
+
 void textbuffer_remove(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 {
+	GSList *tmp;
+
 	g_return_if_fail(buffer != NULL);
 	g_return_if_fail(line != NULL);
 
+	for (tmp = buffer->searches; tmp != NULL; tmp = tmp->next)
+		search_line_removed(tmp->data, line);
+
 	if (buffer->first_line == line)
 		buffer->first_line = line->next;
 	if (line->prev != NULL)
@@ -334,35 +586,112 @@ void textbuffer_remove(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 
 	buffer->lines_count--;
         text_chunk_line_free(buffer, line);
-	g_slice_free(LINE_REC, line);
+	line_free(buffer, line);
 }
 
 /* Removes all lines from buffer */
 void textbuffer_remove_all_lines(TEXT_BUFFER_REC *buffer)
 {
-	GSList *tmp;
-        LINE_REC *line;
+	guint i;
 
 	g_return_if_fail(buffer != NULL);
 
-	for (tmp = buffer->text_chunks; tmp != NULL; tmp = tmp->next)
-                g_slice_free(TEXT_CHUNK_REC, tmp->data);
-	g_slist_free(buffer->text_chunks);
-	buffer->text_chunks = NULL;
+	for (i = 0; i < buffer->text_chunks->len; i++)
+		text_chunk_free(g_ptr_array_index(buffer->text_chunks, i));
+	g_ptr_array_set_size(buffer->text_chunks, 0);
+
+	/* the lines are freed with the blocks */
+	while (buffer->line_blocks != NULL) {
+		LINE_BLOCK_REC *block = buffer->line_blocks;
 
-	while (buffer->first_line != NULL) {
-		line = buffer->first_line->next;
-		g_slice_free(LINE_REC, buffer->first_line);
-                buffer->first_line = line;
+		buffer->line_blocks = block->next;
+		g_free(block);
 	}
+	buffer->free_lines = NULL;
+	buffer->line_block_size = LINE_BLOCK_MIN_SIZE;
+
+	buffer->first_line = NULL;
 	buffer->lines_count = 0;
 
+	/* nothing left to search */
+	g_slist_foreach(buffer->searches, (GFunc) search_clear, NULL);
+
         buffer->cur_line = NULL;
         buffer->cur_text = NULL;
 
 	buffer->last_eol = TRUE;
 }
 
+unsigned char *textbuffer_line_text(LINE_REC *line)
+{
+	TEXT_LINE_REC *rec = (TEXT_LINE_REC *) line;
+	unsigned char *text;
+
+	g_return_val_if_fail(line != NULL, NULL);
+
+	text = text_chunk_get_buffer(rec->chunk);
+	line->text = text == NULL ? lost_text : text + rec->offset;
+	return line->text;
+}
+
+unsigned char *textbuffer_text_continue(const unsigned char *ptr)
+{
+	TEXT_CHUNK_REC *chunk;
+	unsigned char *text;
+
+	memcpy(&chunk, ptr, sizeof(TEXT_CHUNK_REC *));
+	text = text_chunk_get_buffer(chunk);
+	return text == NULL ? lost_text : text;
+}
+
+int textbuffer_compress(TEXT_BUFFER_REC *buffer, time_t last_access)
+{
+	int count = 0;
+#ifdef HAVE_ZLIB
+	guint i;
+
+	g_return_val_if_fail(buffer != NULL, 0);
+
+	for (i = 0; i < buffer->text_chunks->len; i++) {
+		TEXT_CHUNK_REC *chunk =
+			g_ptr_array_index(buffer->text_chunks, i);
+
+		/* the current chunk is still being written to */
+		if (chunk->buffer != NULL && chunk != buffer->cur_text &&
+		    chunk->last_access < last_access &&
+		    text_chunk_compress(chunk))
+			count++;
+	}
+#endif
+	return count;
+}
+
+void textbuffer_get_memory(TEXT_BUFFER_REC *buffer,
+			   size_t *used, size_t *uncompressed)
+{
+	LINE_BLOCK_REC *block;
+	size_t lines_mem;
+	guint i;
+
+	g_return_if_fail(buffer != NULL);
+
+	lines_mem = 0;
+	for (block = buffer->line_blocks; block != NULL; block = block->next) {
+		lines_mem += sizeof(LINE_BLOCK_REC) +
+			(block->size-1) * sizeof(TEXT_LINE_REC);
+	}
+
+	*used = *uncompressed = sizeof(TEXT_BUFFER_REC) + lines_mem;
+	for (i = 0; i < buffer->text_chunks->len; i++) {
+		TEXT_CHUNK_REC *chunk =
+			g_ptr_array_index(buffer->text_chunks, i);
+
+		*used += sizeof(TEXT_CHUNK_REC) + (chunk->buffer != NULL ?
+			LINE_TEXT_CHUNK_SIZE : chunk->cold_size);
+		*uncompressed += sizeof(TEXT_CHUNK_REC) + LINE_TEXT_CHUNK_SIZE;
+	}
+}
+
 static void set_color(GString *str, int cmd)
 {
 	int color = -1;
@@ -383,14 +712,14 @@ static void set_color(GString *str, int cmd)
 
 void textbuffer_line2text(LINE_REC *line, int coloring, GString *str)
 {
-        unsigned char cmd, *ptr, *tmp;
+        unsigned char cmd, *ptr;
 
 	g_return_if_fail(line != NULL);
 	g_return_if_fail(str != NULL);
 
         g_string_truncate(str, 0);
 
-	for (ptr = line->text;;) {
+	for (ptr = textbuffer_line_text(line);;) {
 		if (*ptr != 0) {
 			g_string_append_c(str, (char) *ptr);
                         ptr++;
@@ -408,8 +737,7 @@ void textbuffer_line2text(LINE_REC *line, int coloring, GString *str)
 
 		if (cmd == LINE_CMD_CONTINUE) {
                         /* line continues in another address.. */
-			memcpy(&tmp, ptr, sizeof(unsigned char *));
-			ptr = tmp;
+			ptr = textbuffer_text_continue(ptr);
                         continue;
 		}
 
@@ -448,88 +776,237 @@ void textbuffer_line2text(LINE_REC *line, int coloring, GString *str)
 	}
 }
 
-GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
-			    int level, int nolevel, const char *text,
-			    int before, int after,
-			    int regexp, int fullword, int case_sensitive)
+TEXT_BUFFER_SEARCH_REC *
+textbuffer_search_new(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
+		      int level, int nolevel, const char *text,
+		      int before, int after,
+		      int regexp, int fullword, int case_sensitive)
 {
-#ifdef HAVE_REGEX_H
-	regex_t preg;
-#endif
-        LINE_REC *line, *pre_line;
-	GList *matches;
-	GString *str;
-        int i, match_after, line_matched;
-	char * (*match_func)(const char *, const char *);
+	TEXT_BUFFER_SEARCH_REC *search;
 
 	g_return_val_if_fail(buffer != NULL, NULL);
 	g_return_val_if_fail(text != NULL, NULL);
 
+	search = g_new0(TEXT_BUFFER_SEARCH_REC, 1);
 	if (regexp) {
 #ifdef HAVE_REGEX_H
 		int flags = REG_EXTENDED | REG_NOSUB |
 			(case_sensitive ? 0 : REG_ICASE);
-		if (regcomp(&preg, text, flags) != 0)
+		if (regcomp(&search->preg, text, flags) != 0) {
+			g_free(search);
 			return NULL;
+		}
 #else
+		g_free(search);
 		return NULL;
 #endif
 	}
 
-	matches = NULL; match_after = 0;
-        str = g_string_new(NULL);
-
-	line = startline != NULL ? startline : buffer->first_line;
-
 	if (fullword)
-		match_func = case_sensitive ? strstr_full : stristr_full;
+		search->match_func = case_sensitive ? strstr_full : stristr_full;
 	else
-		match_func = case_sensitive ? strstr : stristr;
+		search->match_func = case_sensitive ? strstr : stristr;
+
+	search->buffer = buffer;
+	search->matches = g_ptr_array_new();
+	search->match_lines = g_hash_table_new((GHashFunc) g_direct_hash,
+					       (GCompareFunc) g_direct_equal);
+	search->first = startline != NULL ? startline : buffer->first_line;
+	search->last = buffer->cur_line;
+	search->line = search->last == NULL ? NULL : search->first;
+
+	search->level = level;
+	search->nolevel = nolevel;
+	search->text = g_strdup(text);
+	search->before = before;
+	search->after = after;
+	search->regexp = regexp;
+	search->str = g_string_new(NULL);
+
+	buffer->searches = g_slist_prepend(buffer->searches, search);
+	return search;
+}
 
-	for (; line != NULL; line = line->next) {
-		line_matched = (line->info.level & level) != 0 &&
-			(line->info.level & nolevel) == 0;
+void textbuffer_search_destroy(TEXT_BUFFER_SEARCH_REC *search)
+{
+	g_return_if_fail(search != NULL);
 
-		if (*text != '\0') {
-			textbuffer_line2text(line, FALSE, str);
+	if (search->buffer != NULL) {
+		search->buffer->searches =
+			g_slist_remove(search->buffer->searches, search);
+	}
 
-			if (line_matched)
-			line_matched =
 #ifdef HAVE_REGEX_H
-			regexp ? regexec(&preg, str->str, 0, NULL, 0) == 0 :
+	if (search->regexp) regfree(&search->preg);
 #endif
-			match_func(str->str, text) != NULL;
+	g_ptr_array_free(search->matches, TRUE);
+	g_hash_table_destroy(search->match_lines);
+	g_string_free(search->str, TRUE);
+	g_free(search->text);
+	g_free(search);
+}
+
+void textbuffer_search_set_last(TEXT_BUFFER_SEARCH_REC *search, int count)
+{
+	g_return_if_fail(search != NULL);
+	g_return_if_fail(search->before == 0 && search->after == 0);
+
+	search->backwards = TRUE;
+	search->max_matches = count;
+	if (search->line != NULL)
+		search->line = search->last;
+}
+
+/* Get the text of line without colors to search->str. Copies the text
+   between the commands with one append each instead of char by char. */
+static void search_get_text(TEXT_BUFFER_SEARCH_REC *search, LINE_REC *line)
+{
+	const unsigned char *ptr;
+	int len;
+
+	g_string_truncate(search->str, 0);
+
+	ptr = textbuffer_line_text(line);
+	for (;;) {
+		len = strlen((const char *) ptr);
+		g_string_append_len(search->str, (const char *) ptr, len);
+
+		ptr += len+1;
+		if (*ptr == LINE_CMD_EOL)
+			break;
+
+		if (*ptr == LINE_CMD_CONTINUE)
+			ptr = textbuffer_text_continue(ptr+1);
+		else
+			ptr++;
+	}
+}
+
+static int search_line_match(TEXT_BUFFER_SEARCH_REC *search, LINE_REC *line)
+{
+	if ((line->info.level & search->level) == 0 ||
+	    (line->info.level & search->nolevel) != 0)
+		return FALSE;
+
+	if (*search->text == '\0')
+		return TRUE;
+
+	search_get_text(search, line);
+#ifdef HAVE_REGEX_H
+	if (search->regexp)
+		return regexec(&search->preg, search->str->str, 0, NULL, 0) == 0;
+#endif
+	return search->match_func(search->str->str, search->text) != NULL;
+}
+
+static void search_add(TEXT_BUFFER_SEARCH_REC *search, LINE_REC *line)
+{
+	g_ptr_array_add(search->matches, line);
+	g_hash_table_insert(search->match_lines, line, line);
+	search->last_added = line;
+}
+
+static void search_finish(TEXT_BUFFER_SEARCH_REC *search)
+{
+	gpointer *data, tmp;
+	int i, len;
+
+	if (search->backwards) {
+		/* the matches were found in reverse order */
+		data = search->matches->pdata;
+		len = search->matches->len;
+		for (i = 0; i < len/2; i++) {
+			tmp = data[i];
+			data[i] = data[len-1-i];
+			data[len-1-i] = tmp;
 		}
+	}
+	search->finished = TRUE;
+}
+
+int textbuffer_search_next(TEXT_BUFFER_SEARCH_REC *search, int *max_lines)
+{
+	LINE_REC *line, *pre_line;
+	int i, line_matched;
+
+	g_return_val_if_fail(search != NULL, FALSE);
+	g_return_val_if_fail(max_lines != NULL, FALSE);
+
+	for (; search->line != NULL && *max_lines > 0; (*max_lines)--) {
+		line = search->line;
+		search->line = search_step(search, line);
 
+		line_matched = search_line_match(search, line);
 		if (line_matched) {
                         /* add the -before lines */
 			pre_line = line;
-			for (i = 0; i < before; i++) {
+			for (i = 0; i < search->before; i++) {
 				if (pre_line->prev == NULL ||
-				    g_list_find(matches, pre_line->prev) != NULL)
+				    pre_line->prev == search->last_added)
 					break;
                                 pre_line = pre_line->prev;
 			}
 
 			for (; pre_line != line; pre_line = pre_line->next)
-				matches = g_list_append(matches, pre_line);
+				search_add(search, pre_line);
 
-			match_after = after;
+			search->match_after = search->after;
+			search->match_count++;
 		}
 
-		if (line_matched || match_after > 0) {
+		if (line_matched || search->match_after > 0) {
 			/* matched */
-			matches = g_list_append(matches, line);
+			search_add(search, line);
 
-			if ((!line_matched && --match_after == 0) ||
-			    (line_matched && match_after == 0 && before > 0))
-				matches = g_list_append(matches, NULL);
+			if ((!line_matched && --search->match_after == 0) ||
+			    (line_matched && search->match_after == 0 &&
+			     search->before > 0))
+				g_ptr_array_add(search->matches, NULL);
 		}
+
+		if (search->max_matches > 0 && search->match_after == 0 &&
+		    search->match_count >= search->max_matches)
+			search->line = NULL;
 	}
-#ifdef HAVE_REGEX_H
-	if (regexp) regfree(&preg);
-#endif
-        g_string_free(str, TRUE);
+
+	if (search->line == NULL && !search->finished)
+		search_finish(search);
+	return search->line != NULL;
+}
+
+GPtrArray *textbuffer_search_get_matches(TEXT_BUFFER_SEARCH_REC *search)
+{
+	g_return_val_if_fail(search != NULL, NULL);
+
+	return search->matches;
+}
+
+GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
+			    int level, int nolevel, const char *text,
+			    int before, int after,
+			    int regexp, int fullword, int case_sensitive)
+{
+	TEXT_BUFFER_SEARCH_REC *search;
+	GList *matches;
+	int i, lines;
+
+	g_return_val_if_fail(buffer != NULL, NULL);
+	g_return_val_if_fail(text != NULL, NULL);
+
+	search = textbuffer_search_new(buffer, startline, level, nolevel,
+				       text, before, after,
+				       regexp, fullword, case_sensitive);
+	if (search == NULL)
+		return NULL;
+
+	lines = G_MAXINT;
+	while (textbuffer_search_next(search, &lines)) ;
+
+	matches = NULL;
+	for (i = search->matches->len; i > 0; i--)
+		matches = g_list_prepend(matches, search->matches->pdata[i-1]);
+
+	textbuffer_search_destroy(search);
 	return matches;
 }
 
@@ -1,8 +1,8 @@
 #ifndef __TEXTBUFFER_H
 #define __TEXTBUFFER_H
 
-/* Make sure TEXT_CHUNK_REC is not slightly more than a page, as that
-   wastes a lot of memory. */
+/* Make sure the text block of a chunk is not slightly more than a page,
+   as that wastes a lot of memory. */
 #define LINE_TEXT_CHUNK_SIZE (16384 - 16)
 
 #define LINE_COLOR_BG		0x20
@@ -10,7 +10,8 @@
 
 enum {
 	LINE_CMD_EOL=0x80,	/* line ends here */
-	LINE_CMD_CONTINUE,	/* line continues in next block */
+	LINE_CMD_CONTINUE,	/* line continues in next block, followed by
+				   TEXT_CHUNK_REC* of the block */
 	LINE_CMD_COLOR0,	/* change to black, would be same as \0\0 but it breaks things.. */
 	LINE_CMD_UNDERLINE,	/* enable/disable underlining */
 	LINE_CMD_REVERSE,	/* enable/disable reversed text */
@@ -44,26 +45,47 @@ typedef struct _LINE_REC {
         LINE_INFO_REC info;
 } LINE_REC;
 
-typedef struct {
-	unsigned char buffer[LINE_TEXT_CHUNK_SIZE];
+typedef struct _TEXT_CHUNK_REC {
+	/* LINE_TEXT_CHUNK_SIZE bytes, or NULL if the chunk is compressed */
+	unsigned char *buffer;
 	int pos;
 	int refcount;
+	int index; /* position in text_chunks */
+
+	/* the chunk where the text continues after this one, same as
+	   the pointer after LINE_CMD_CONTINUE */
+	struct _TEXT_CHUNK_REC *next;
+
+	/* the compressed buffer, when it's not accessed for a while */
+	unsigned char *cold_data;
+	int cold_size;
+	time_t last_access;
 } TEXT_CHUNK_REC;
 
 typedef struct {
-	GSList *text_chunks;
+	GPtrArray *text_chunks;
         LINE_REC *first_line;
         int lines_count;
 
+	/* LINE_RECs are allocated from blocks owned by the buffer, a block
+	   is freed when its last line is removed */
+	struct _LINE_BLOCK_REC *line_blocks;
+	LINE_REC *free_lines; /* doubly linked */
+	int line_block_size;
+
 	LINE_REC *cur_line;
 	TEXT_CHUNK_REC *cur_text;
 
+	GSList *searches; /* TEXT_BUFFER_SEARCH_RECs in progress */
+
 	unsigned int last_eol:1;
 	int last_fg;
 	int last_bg;
 	int last_flags;
 } TEXT_BUFFER_REC;
 
+typedef struct _TEXT_BUFFER_SEARCH_REC TEXT_BUFFER_SEARCH_REC;
+
 /* Create new buffer */
 TEXT_BUFFER_REC *textbuffer_create(void);
 /* Destroy the buffer */
@@ -89,12 +111,50 @@ void textbuffer_remove(TEXT_BUFFER_REC *buffer, LINE_REC *line);
 /* Removes all lines from buffer, ignoring reference counters */
 void textbuffer_remove_all_lines(TEXT_BUFFER_REC *buffer);
 
+/* Return the text of the line, uncompressing it if needed. Use this
+   instead of line->text, which is invalid while the text is compressed. */
+unsigned char *textbuffer_line_text(LINE_REC *line);
+/* Return the text where LINE_CMD_CONTINUE continues, `ptr' points to
+   the data after the command. */
+unsigned char *textbuffer_text_continue(const unsigned char *ptr);
+
+/* Compress text chunks that haven't been accessed since `last_access'.
+   Returns the number of chunks compressed, any pointers to their text
+   (eg. view line caches) are invalid after this. */
+int textbuffer_compress(TEXT_BUFFER_REC *buffer, time_t last_access);
+/* Get the memory used by the buffer, and how much it would use without
+   compression */
+void textbuffer_get_memory(TEXT_BUFFER_REC *buffer,
+			   size_t *used, size_t *uncompressed);
+
 void textbuffer_line2text(LINE_REC *line, int coloring, GString *str);
 GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
 			    int level, int nolevel, const char *text,
 			    int before, int after,
 			    int regexp, int fullword, int case_sensitive);
 
+/* Start searching text from lines between `startline' and the current
+   last line. The search is done in parts with textbuffer_search_next(),
+   lines removed from the buffer meanwhile are removed from the search.
+   Returns NULL if regexp is invalid. */
+TEXT_BUFFER_SEARCH_REC *
+textbuffer_search_new(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
+		      int level, int nolevel, const char *text,
+		      int before, int after,
+		      int regexp, int fullword, int case_sensitive);
+void textbuffer_search_destroy(TEXT_BUFFER_SEARCH_REC *search);
+/* Find only the last `count' matching lines by searching backwards from
+   the end. Can't be used with before/after context lines. */
+void textbuffer_search_set_last(TEXT_BUFFER_SEARCH_REC *search, int count);
+/* Search at most `*max_lines' lines, `*max_lines' is decreased by the
+   number of lines searched. Returns TRUE if there's still more to
+   search. */
+int textbuffer_search_next(TEXT_BUFFER_SEARCH_REC *search, int *max_lines);
+/* Return the found lines and their context lines in buffer order. NULL
+   separates non-continuous parts when context lines are used. The array
+   is complete only after textbuffer_search_next() has returned FALSE. */
+GPtrArray *textbuffer_search_get_matches(TEXT_BUFFER_SEARCH_REC *search);
+
 void textbuffer_init(void);
 void textbuffer_deinit(void);
 
@@ -52,7 +52,7 @@ char *ban_get_mask(IRC_CHANNEL_REC *channel, const char *nick, int ban_type)
 
 	rec = nicklist_find(CHANNEL(channel), nick);
 	if (rec == NULL) return NULL;
-	if (rec->host == NULL) {
+	if (rec->user->host == NULL) {
 		g_warning("channel %s is not synced, using nick ban for %s", channel->name, nick);
 		return g_strdup_printf("%s!*@*", nick);
 	}
@@ -60,7 +60,7 @@ char *ban_get_mask(IRC_CHANNEL_REC *channel, const char *nick, int ban_type)
 	if (ban_type <= 0)
 		ban_type = default_ban_type;
 
-	str = irc_get_mask(nick, rec->host, ban_type);
+	str = irc_get_mask(nick, rec->user->host, ban_type);
 
 	/* there's a limit of 10 characters in user mask. so, banning
 	   someone with user mask of 10 characters gives us "*1234567890",
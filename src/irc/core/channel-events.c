@@ -51,13 +51,20 @@ static void check_join_failure(IRC_SERVER_REC *server, const char *channel)
 	}
 }
 
-static void irc_server_event(IRC_SERVER_REC *server, const char *line)
+static void irc_server_event(IRC_SERVER_REC *server, const char *line,
+			     const char *nick, const char *address,
+			     IRC_MESSAGE_REC *msg)
 {
 	char *params, *numeric, *channel;
 
 	/* We'll be checking "4xx <your nick> <channel>" for channels
 	   which we haven't joined yet. 4xx are error codes and should
 	   indicate that the join failed. */
+	if (msg != NULL && msg->event != NULL ?
+	    msg->event->numeric < 400 || msg->event->numeric > 499 :
+	    *line != '4')
+		return;
+
 	params = event_get_params(line, 3, &numeric, NULL, &channel);
 
 	if (numeric[0] == '4')
@@ -440,7 +440,7 @@ static void event_end_of_who(IRC_SERVER_REC *server, const char *data)
 		if (strarray_find(channels, chanrec->name) == -1)
 			continue;
 
-		if (chanrec->ownnick->host == NULL && multiple &&
+		if (chanrec->ownnick->user->host == NULL && multiple &&
 		    !server->one_endofwho) {
 			/* we should receive our own host for each channel.
 			   However, some servers really are stupid enough
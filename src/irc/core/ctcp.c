@@ -274,10 +274,14 @@ static void event_privmsg(IRC_SERVER_REC *server, const char *data,
 
 	g_return_if_fail(data != NULL);
 
-	params = event_get_params(data, 2, &target, &msg);
+	params = event_get_params_shared(data, 2, &target, &msg);
 
 	/* handle only ctcp messages.. */
 	if (*msg == 1) {
+		/* get a copy we can modify */
+		g_free(params);
+		params = event_get_params(data, 2, &target, &msg);
+
 		/* remove the \001 at beginning and end */
 		msg++;
 		len = strlen(msg);
@@ -298,10 +302,14 @@ static void event_notice(IRC_SERVER_REC *server, const char *data,
 
 	g_return_if_fail(data != NULL);
 
-	params = event_get_params(data, 2, &target, &msg);
+	params = event_get_params_shared(data, 2, &target, &msg);
 
 	/* handle only ctcp replies */
 	if (*msg == 1) {
+		/* get a copy we can modify */
+		g_free(params);
+		params = event_get_params(data, 2, &target, &msg);
+
 		ptr = strrchr(++msg, 1);
 		if (ptr != NULL) *ptr = '\0';
 
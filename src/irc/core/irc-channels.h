@@ -20,6 +20,8 @@ struct _IRC_CHANNEL_REC {
 	time_t massjoin_start; /* Massjoin start time */
 	int massjoins; /* Number of nicks waiting for massjoin signal.. */
 	int last_massjoins; /* Massjoins when last checked in timeout function */
+	GSList *massjoin_nicks; /* Nicks waiting for massjoin signal, newest first */
+	int massjoin_tag; /* Timeout checking the massjoins, or -1 */
 };
 
 void irc_channels_init(void);
@@ -0,0 +1,320 @@
+/*
+ irc-cmdqueue.c : irssi
+
+    Copyright (C) 2010 The Irssi project
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "module.h"
+#include "misc.h"
+
+#include "irc-cmdqueue.h"
+#include "servers-redirect.h"
+
+struct _IRC_CMDQUEUE_REC {
+	GQueue classes[IRC_CMD_CLASSES];
+	GHashTable *targets; /* target => GQueue of IRC_CMD_RECs */
+	GQueue barriers; /* queued JOIN, PART, QUIT and NICK commands */
+	unsigned long next_seq;
+	int count;
+};
+
+static int cmd_get_class(const char *cmd, int immediate, int interactive)
+{
+	if (immediate || g_ascii_strncasecmp(cmd, "PONG ", 5) == 0)
+		return IRC_CMD_CLASS_IMMEDIATE;
+	if (g_ascii_strncasecmp(cmd, "PRIVMSG ", 8) == 0 ||
+	    g_ascii_strncasecmp(cmd, "NOTICE ", 7) == 0) {
+		/* scripts and pastes can send lots of these */
+		return interactive ? IRC_CMD_CLASS_INTERACTIVE :
+			IRC_CMD_CLASS_BULK;
+	}
+	if (g_ascii_strncasecmp(cmd, "MODE ", 5) == 0 ||
+	    g_ascii_strncasecmp(cmd, "KICK ", 5) == 0)
+		return IRC_CMD_CLASS_MODE;
+	return IRC_CMD_CLASS_INTERACTIVE;
+}
+
+/* commands that change our channel or nick state, nothing may be sent
+   past them in either direction */
+static int cmd_is_barrier(const char *cmd)
+{
+	return g_ascii_strncasecmp(cmd, "JOIN ", 5) == 0 ||
+		g_ascii_strncasecmp(cmd, "PART ", 5) == 0 ||
+		g_ascii_strncasecmp(cmd, "QUIT", 4) == 0 ||
+		g_ascii_strncasecmp(cmd, "NICK ", 5) == 0;
+}
+
+/* just assume the command is in form "<command> <target> <data>" */
+static char *cmd_get_target(const char *cmd)
+{
+	const char *start, *end;
+
+	start = strchr(cmd, ' ');
+	if (start == NULL)
+		return NULL;
+	start++;
+
+	for (end = start; *end != ' ' && *end != '\0'; end++) {
+		if (*end == '\r' || *end == '\n')
+			break;
+	}
+	return end == start || *end != ' ' ? NULL :
+		g_strndup(start, (int) (end-start));
+}
+
+IRC_CMDQUEUE_REC *irc_cmdqueue_create(void)
+{
+	IRC_CMDQUEUE_REC *queue;
+
+	queue = g_new0(IRC_CMDQUEUE_REC, 1);
+	queue->targets = g_hash_table_new((GHashFunc) g_istr_hash,
+					  (GCompareFunc) g_istr_equal);
+	return queue;
+}
+
+static void cmd_unlink(IRC_CMDQUEUE_REC *queue, IRC_CMD_REC *rec)
+{
+	GQueue *target_queue;
+	char *key;
+
+	g_queue_delete_link(&queue->classes[rec->class], rec->link);
+	rec->link = NULL;
+
+	if (rec->barrier_link != NULL) {
+		g_queue_delete_link(&queue->barriers, rec->barrier_link);
+		rec->barrier_link = NULL;
+	}
+
+	if (rec->target_link != NULL) {
+		g_hash_table_lookup_extended(queue->targets, rec->target,
+					     (void **) &key,
+					     (void **) &target_queue);
+		g_queue_delete_link(target_queue, rec->target_link);
+		rec->target_link = NULL;
+
+		if (g_queue_is_empty(target_queue)) {
+			g_hash_table_remove(queue->targets, key);
+			g_queue_free(target_queue);
+			g_free(key);
+		}
+	}
+
+	queue->count--;
+}
+
+void irc_cmd_free(IRC_CMD_REC *rec)
+{
+	g_return_if_fail(rec != NULL);
+
+	g_free(rec->target);
+	g_free(rec->cmd);
+	g_free(rec);
+}
+
+static void cmd_destroy(IRC_CMD_REC *rec)
+{
+	if (rec->redirect != NULL)
+		server_redirect_destroy(rec->redirect);
+	irc_cmd_free(rec);
+}
+
+void irc_cmdqueue_destroy(IRC_CMDQUEUE_REC *queue)
+{
+	IRC_CMD_REC *rec;
+
+	g_return_if_fail(queue != NULL);
+
+	while ((rec = irc_cmdqueue_pop(queue)) != NULL)
+		cmd_destroy(rec);
+
+	g_hash_table_destroy(queue->targets);
+	g_free(queue);
+}
+
+void irc_cmdqueue_add(IRC_CMDQUEUE_REC *queue, const char *cmd,
+		      REDIRECT_REC *redirect, int immediate, int interactive)
+{
+	IRC_CMD_REC *rec;
+	GQueue *target_queue;
+
+	g_return_if_fail(queue != NULL);
+	g_return_if_fail(cmd != NULL);
+
+	rec = g_new0(IRC_CMD_REC, 1);
+	rec->cmd = g_strdup(cmd);
+	rec->redirect = redirect;
+	rec->class = cmd_get_class(cmd, immediate, interactive);
+	rec->seq = queue->next_seq++;
+	g_get_current_time(&rec->queued);
+	rec->no_purge = g_ascii_strncasecmp(cmd, "PONG ", 5) == 0;
+
+	if (immediate) {
+		g_queue_push_head(&queue->classes[rec->class], rec);
+		rec->link = queue->classes[rec->class].head;
+	} else {
+		g_queue_push_tail(&queue->classes[rec->class], rec);
+		rec->link = queue->classes[rec->class].tail;
+	}
+
+	if (rec->class != IRC_CMD_CLASS_IMMEDIATE && cmd_is_barrier(cmd)) {
+		g_queue_push_tail(&queue->barriers, rec);
+		rec->barrier_link = queue->barriers.tail;
+	}
+
+	if (!rec->no_purge)
+		rec->target = cmd_get_target(cmd);
+	if (rec->target != NULL) {
+		target_queue = g_hash_table_lookup(queue->targets, rec->target);
+		if (target_queue == NULL) {
+			target_queue = g_queue_new();
+			g_hash_table_insert(queue->targets,
+					    g_strdup(rec->target), target_queue);
+		}
+		if (immediate) {
+			g_queue_push_head(target_queue, rec);
+			rec->target_link = target_queue->head;
+		} else {
+			g_queue_push_tail(target_queue, rec);
+			rec->target_link = target_queue->tail;
+		}
+	}
+
+	queue->count++;
+}
+
+/* Can `rec' be sent before the commands that were queued earlier? */
+static int cmd_can_send(IRC_CMDQUEUE_REC *queue, IRC_CMD_REC *rec,
+			unsigned long first_seq)
+{
+	IRC_CMD_REC *barrier;
+	GQueue *target_queue;
+
+	if (rec->class == IRC_CMD_CLASS_IMMEDIATE)
+		return TRUE;
+
+	/* commands to the same target are sent in the queued order */
+	if (rec->target != NULL) {
+		target_queue = g_hash_table_lookup(queue->targets, rec->target);
+		if (target_queue->head != rec->target_link)
+			return FALSE;
+	}
+
+	/* nothing goes past a JOIN/PART/QUIT/NICK */
+	barrier = g_queue_peek_head(&queue->barriers);
+	if (barrier != NULL && barrier->seq < rec->seq)
+		return FALSE;
+
+	/* and they wait for everything queued before them */
+	return rec->barrier_link == NULL || rec->seq == first_seq;
+}
+
+IRC_CMD_REC *irc_cmdqueue_peek(IRC_CMDQUEUE_REC *queue)
+{
+	IRC_CMD_REC *rec, *first;
+	int i;
+
+	if (queue == NULL)
+		return NULL;
+
+	/* the oldest command that's not in the immediate class. it can
+	   always be sent, so the loop below always finds something. */
+	first = NULL;
+	for (i = IRC_CMD_CLASS_IMMEDIATE+1; i < IRC_CMD_CLASSES; i++) {
+		rec = g_queue_peek_head(&queue->classes[i]);
+		if (rec != NULL && (first == NULL || rec->seq < first->seq))
+			first = rec;
+	}
+
+	for (i = 0; i < IRC_CMD_CLASSES; i++) {
+		rec = g_queue_peek_head(&queue->classes[i]);
+		if (rec != NULL &&
+		    cmd_can_send(queue, rec, first == NULL ? 0 : first->seq))
+			return rec;
+	}
+	return first;
+}
+
+IRC_CMD_REC *irc_cmdqueue_pop(IRC_CMDQUEUE_REC *queue)
+{
+	IRC_CMD_REC *rec;
+
+	g_return_val_if_fail(queue != NULL, NULL);
+
+	rec = irc_cmdqueue_peek(queue);
+	if (rec != NULL)
+		cmd_unlink(queue, rec);
+	return rec;
+}
+
+int irc_cmdqueue_purge(IRC_CMDQUEUE_REC *queue, const char *target)
+{
+	IRC_CMD_REC *rec;
+	GQueue *target_queue;
+	GList *tmp, *next;
+	int i, count;
+
+	g_return_val_if_fail(queue != NULL, 0);
+
+	count = 0;
+	if (target != NULL) {
+		target_queue = g_hash_table_lookup(queue->targets, target);
+		while (target_queue != NULL && !g_queue_is_empty(target_queue)) {
+			rec = g_queue_peek_head(target_queue);
+			/* the last unlink frees target_queue */
+			if (target_queue->length == 1)
+				target_queue = NULL;
+			cmd_unlink(queue, rec);
+			cmd_destroy(rec);
+			count++;
+		}
+		return count;
+	}
+
+	for (i = 0; i < IRC_CMD_CLASSES; i++) {
+		for (tmp = queue->classes[i].head; tmp != NULL; tmp = next) {
+			rec = tmp->data;
+			next = tmp->next;
+
+			if (!rec->no_purge) {
+				cmd_unlink(queue, rec);
+				cmd_destroy(rec);
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+void irc_cmdqueue_foreach(IRC_CMDQUEUE_REC *queue, IRC_CMD_FOREACH_FUNC func,
+			  void *user_data)
+{
+	GList *tmp;
+	int i;
+
+	g_return_if_fail(queue != NULL);
+	g_return_if_fail(func != NULL);
+
+	for (i = 0; i < IRC_CMD_CLASSES; i++) {
+		for (tmp = queue->classes[i].head; tmp != NULL; tmp = tmp->next)
+			func(tmp->data, user_data);
+	}
+}
+
+int irc_cmdqueue_length(IRC_CMDQUEUE_REC *queue)
+{
+	return queue == NULL ? 0 : queue->count;
+}
@@ -0,0 +1,65 @@
+#ifndef __IRC_CMDQUEUE_H
+#define __IRC_CMDQUEUE_H
+
+/* Commands are sent from the lowest class first. Within one class they're
+   sent in the order they were queued. Except for the immediate class, a
+   command never overtakes an earlier one to the same target, and JOIN,
+   PART, QUIT and NICK never overtake or get overtaken by anything. */
+enum {
+	IRC_CMD_CLASS_IMMEDIATE, /* PONG and irc_send_cmd_first() */
+	IRC_CMD_CLASS_INTERACTIVE, /* everything not listed below */
+	IRC_CMD_CLASS_MODE, /* MODE and KICK */
+	IRC_CMD_CLASS_BULK, /* PRIVMSG and NOTICE not typed by the user */
+
+	IRC_CMD_CLASSES
+};
+
+typedef struct {
+	char *cmd; /* with CR+LF */
+	char *target; /* first argument of the command, NULL if none */
+	REDIRECT_REC *redirect;
+	GTimeVal queued; /* when the command was added to queue */
+
+	int class;
+	unsigned long seq; /* order in which the commands were queued */
+	unsigned int no_purge:1; /* never removed by irc_cmdqueue_purge() */
+
+	GList *link; /* our link in the class list */
+	GList *target_link; /* our link in the target index */
+	GList *barrier_link; /* our link in the JOIN/PART/QUIT/NICK list */
+} IRC_CMD_REC;
+
+typedef void (*IRC_CMD_FOREACH_FUNC) (IRC_CMD_REC *rec, void *user_data);
+
+IRC_CMDQUEUE_REC *irc_cmdqueue_create(void);
+/* Destroy the queue with all the commands and redirections in it */
+void irc_cmdqueue_destroy(IRC_CMDQUEUE_REC *queue);
+
+/* Add command to queue. `cmd' is copied, `redirect' is owned by the queue
+   after this. If `immediate' is TRUE, the command is sent before anything
+   else that's in the queue. If `interactive' is TRUE, the user typed the
+   command and PRIVMSG and NOTICE aren't put in the bulk class. */
+void irc_cmdqueue_add(IRC_CMDQUEUE_REC *queue, const char *cmd,
+		      REDIRECT_REC *redirect, int immediate, int interactive);
+
+/* Remove the next command to be sent from queue and return it, or NULL if
+   the queue is empty. Free the record with irc_cmd_free(). */
+IRC_CMD_REC *irc_cmdqueue_pop(IRC_CMDQUEUE_REC *queue);
+/* Return the next command to be sent without removing it */
+IRC_CMD_REC *irc_cmdqueue_peek(IRC_CMDQUEUE_REC *queue);
+/* Free a record returned by irc_cmdqueue_pop(). The redirection isn't
+   destroyed - it's expected to be given to server_redirect_command(). */
+void irc_cmd_free(IRC_CMD_REC *rec);
+
+/* Remove all commands sent to `target', or all commands if `target' is NULL.
+   PONGs are never removed. Returns the number of commands removed. */
+int irc_cmdqueue_purge(IRC_CMDQUEUE_REC *queue, const char *target);
+
+/* Call `func' for each command, class by class */
+void irc_cmdqueue_foreach(IRC_CMDQUEUE_REC *queue, IRC_CMD_FOREACH_FUNC func,
+			  void *user_data);
+
+/* Number of commands in queue */
+int irc_cmdqueue_length(IRC_CMDQUEUE_REC *queue);
+
+#endif
@@ -606,6 +606,7 @@ static void cmd_wait(const char *data, IRC_SERVER_REC *server)
 			server->wait_cmd.tv_sec++;
 			server->wait_cmd.tv_usec -= 1000;
 		}
+		irc_server_start_cmd_timeout(server);
 	}
 	cmd_params_free(free_arg);
 }
@@ -224,14 +224,14 @@ static void event_who(SERVER_REC *server, const char *data)
 	nickrec = chanrec == NULL ? NULL :
 		nicklist_find(chanrec, nick);
 	if (nickrec != NULL) {
-		if (nickrec->host == NULL) {
+		if (nickrec->user->host == NULL) {
                         char *str = g_strdup_printf("%s@%s", user, host);
 			nicklist_set_host(chanrec, nickrec, str);
                         g_free(str);
 		}
-		if (nickrec->realname == NULL)
-			nickrec->realname = g_strdup(realname);
-		sscanf(hops, "%d", &nickrec->hops);
+		if (nickrec->user->realname == NULL)
+			nicklist_set_realname(chanrec, nickrec, realname);
+		sscanf(hops, "%d", &nickrec->user->hops);
 	}
 
 	nicklist_update_flags(server, nick,
@@ -258,8 +258,8 @@ static void event_whois(IRC_SERVER_REC *server, const char *data)
 	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
 		rec = tmp->next->data;
 
-		if (rec->realname == NULL)
-			rec->realname = g_strdup(realname);
+		if (rec->user->realname == NULL)
+			nicklist_set_realname(tmp->data, rec, realname);
 	}
 	g_slist_free(nicks);
 
@@ -32,6 +32,7 @@
 #include "irc-queries.h"
 #include "irc-servers-setup.h"
 #include "irc-servers.h"
+#include "irc-cmdqueue.h"
 #include "channel-rejoin.h"
 #include "servers-idle.h"
 #include "servers-reconnect.h"
@@ -49,12 +50,21 @@
 #define DEFAULT_USER_MODE "+i"
 #define DEFAULT_CMD_QUEUE_SPEED "2200msec"
 #define DEFAULT_CMDS_MAX_AT_ONCE 5
+#define DEFAULT_CMD_QUEUE_PENALTIES "join:2 kick:2 list:3 mode:2 names:2 who:2 whois:2"
+#define DEFAULT_CMD_QUEUE_BYTE_PENALTY "10msec"
+
+/* commands shorter than this don't pay the byte penalty */
+#define LONG_CMD_BYTES 100
+
+/* cmd_tokens needed for sending one command */
+#define CMD_TOKENS 1000
 #define DEFAULT_MAX_QUERY_CHANS 1 /* more and more IRC networks are using stupid ircds.. */
 
 void irc_servers_reconnect_init(void);
 void irc_servers_reconnect_deinit(void);
 
-static int cmd_tag;
+static GHashTable *cmd_penalties; /* "COMMAND" => cost in cmd_tokens */
+static int cmd_byte_penalty; /* msecs per byte in long commands */
 
 static int isnickflag_func(SERVER_REC *server, char flag)
 {
@@ -171,6 +181,9 @@ static void server_init(IRC_SERVER_REC *server)
 
 	server->cmdcount = 0;
 
+	g_get_current_time(&server->cmd_tokens_time);
+	server->cmd_tokens = server->max_cmds_at_once * CMD_TOKENS;
+
 	/* prevent the queue from sending too early, we have a max cut off of 120 secs */
 	/* this will reset to 1 sec after we get the 001 event */
 	g_get_current_time(&now);
@@ -189,6 +202,7 @@ SERVER_REC *irc_server_init_connect(SERVER_CONNECT_REC *conn)
 
 	server = g_new0(IRC_SERVER_REC, 1);
 	server->chat_type = IRC_PROTOCOL;
+	server->cmd_tag = -1;
 
 	ircconn = (IRC_SERVER_CONNECT_REC *) conn;
 	server->connrec = ircconn;
@@ -203,6 +217,8 @@ SERVER_REC *irc_server_init_connect(SERVER_CONNECT_REC *conn)
 		ircconn->cmd_queue_speed : settings_get_time("cmd_queue_speed");
 	server->max_cmds_at_once = ircconn->max_cmds_at_once > 0 ?
 		ircconn->max_cmds_at_once : settings_get_int("cmds_max_at_once");
+	if (server->max_cmds_at_once <= 0)
+		server->max_cmds_at_once = 1;
 	server->max_query_chans = ircconn->max_query_chans > 0 ?
 		ircconn->max_query_chans : DEFAULT_MAX_QUERY_CHANS;
 
@@ -230,53 +246,15 @@ void irc_server_connect(SERVER_REC *server)
 	}
 }
 
-/* Returns TRUE if `command' is sent to `target' */
-static int command_has_target(const char *cmd, const char *target)
-{
-	const char *p;
-        int len;
-
-        /* just assume the command is in form "<command> <target> <data>" */
-        p = strchr(cmd, ' ');
-	if (p == NULL) return FALSE;
-	p++;
-
-        len = strlen(target);
-	return strncmp(p, target, len) == 0 && p[len] == ' ';
-}
-
 /* Purge server output, either all or for specified target */
 void irc_server_purge_output(IRC_SERVER_REC *server, const char *target)
 {
-	GSList *tmp, *next, *link;
-        REDIRECT_REC *redirect;
-	char *cmd;
-
 	if (target != NULL && *target == '\0')
                 target = NULL;
 
-	for (tmp = server->cmdqueue; tmp != NULL; tmp = next) {
-		next = tmp->next->next;
-		cmd = tmp->data;
-                redirect = tmp->next->data;
-
-		if ((target == NULL || command_has_target(cmd, target)) &&
-		    g_ascii_strncasecmp(cmd, "PONG ", 5) != 0) {
-                        /* remove the redirection */
-                        link = tmp->next;
-			server->cmdqueue =
-				g_slist_remove_link(server->cmdqueue, link);
-                        g_slist_free_1(link);
-
-			if (redirect != NULL)
-                                server_redirect_destroy(redirect);
-
-                        /* remove the command */
-			server->cmdqueue =
-				g_slist_remove(server->cmdqueue, cmd);
-                        g_free(cmd);
-                        server->cmdcount--;
-		}
+	if (server->cmdqueue != NULL) {
+		server->cmdcount -=
+			irc_cmdqueue_purge(server->cmdqueue, target);
 	}
 }
 
@@ -307,18 +285,18 @@ static void isupport_destroy_hash(void *key, void *value)
 
 static void sig_disconnected(IRC_SERVER_REC *server)
 {
-	GSList *tmp;
-
 	if (!IS_IRC_SERVER(server))
 		return;
 
-	for (tmp = server->cmdqueue; tmp != NULL; tmp = tmp->next->next) {
-		g_free(tmp->data);
-		if (tmp->next->data != NULL)
-                        server_redirect_destroy(tmp->next->data);
+	if (server->cmd_tag != -1) {
+		g_source_remove(server->cmd_tag);
+		server->cmd_tag = -1;
+	}
+
+	if (server->cmdqueue != NULL) {
+		irc_cmdqueue_destroy(server->cmdqueue);
+		server->cmdqueue = NULL;
 	}
-	g_slist_free(server->cmdqueue);
-        server->cmdqueue = NULL;
 
 	/* these are dynamically allocated only if isupport was sent */
 	g_hash_table_foreach(server->isupport,
@@ -376,6 +354,97 @@ void irc_server_send_away(IRC_SERVER_REC *server, const char *reason)
 	g_free(recoded);
 }
 
+/* Returns the cost of sending `cmd' of `len' bytes in cmd_tokens */
+static int server_cmd_cost(IRC_SERVER_REC *server, const char *cmd, int len)
+{
+	char name[16];
+	int i, cost;
+
+	for (i = 0; i < (int) sizeof(name)-1; i++) {
+		if (cmd[i] == ' ' || cmd[i] == '\r' || cmd[i] == '\0')
+			break;
+		name[i] = i_toupper(cmd[i]);
+	}
+	name[i] = '\0';
+
+	cost = GPOINTER_TO_INT(g_hash_table_lookup(cmd_penalties, name));
+	if (cost <= 0)
+		cost = CMD_TOKENS;
+
+	/* Long lines fill the server's input buffer, which can be as
+	   small as 1000 bytes. In ircnet there actually is 1sec / 100
+	   bytes penalty, so charge the time of each byte as tokens. */
+	if (len >= LONG_CMD_BYTES && cmd_byte_penalty > 0 &&
+	    server->cmd_queue_speed > 0) {
+		cost += (int) ((long) len * cmd_byte_penalty * CMD_TOKENS /
+			       server->cmd_queue_speed);
+	}
+	return cost;
+}
+
+static void server_cmd_tokens_refill(IRC_SERVER_REC *server,
+				     const GTimeVal *now)
+{
+	long msecs, max;
+
+	max = (long) server->max_cmds_at_once * CMD_TOKENS;
+	if (now->tv_sec - server->cmd_tokens_time.tv_sec > 1000) {
+		/* long enough, and avoid overflows below */
+		msecs = -1;
+	} else {
+		msecs = get_timeval_diff(now, &server->cmd_tokens_time);
+		if (msecs <= 0)
+			return;
+	}
+
+	if (server->cmd_queue_speed <= 0 || msecs < 0)
+		server->cmd_tokens = max;
+	else {
+		msecs = msecs * CMD_TOKENS / server->cmd_queue_speed;
+		if (msecs == 0) {
+			/* don't lose the time we've been waiting */
+			return;
+		}
+		server->cmd_tokens = MIN(server->cmd_tokens + msecs, max);
+	}
+	memcpy(&server->cmd_tokens_time, now, sizeof(GTimeVal));
+}
+
+/* Returns how many msecs to wait until `cmd' can be sent */
+static long server_cmd_get_wait(IRC_SERVER_REC *server, const char *cmd,
+				int len, const GTimeVal *now)
+{
+	long wait, need;
+
+	wait = g_timeval_cmp(now, &server->wait_cmd) >= 0 ? 0 :
+		get_timeval_diff(&server->wait_cmd, now);
+
+	if (server->cmd_queue_speed > 0) {
+		server_cmd_tokens_refill(server, now);
+
+		/* never require more than the full bucket, or the
+		   command could never be sent */
+		need = MIN(server_cmd_cost(server, cmd, len),
+			   server->max_cmds_at_once * CMD_TOKENS);
+		need -= server->cmd_tokens;
+		if (need > 0) {
+			need = (need * server->cmd_queue_speed +
+				CMD_TOKENS-1) / CMD_TOKENS;
+			wait = MAX(wait, need);
+		}
+	}
+	return wait;
+}
+
+int irc_server_cmd_can_send(IRC_SERVER_REC *server, const char *cmd, int len,
+			    const GTimeVal *now)
+{
+	g_return_val_if_fail(server != NULL, FALSE);
+	g_return_val_if_fail(cmd != NULL, FALSE);
+
+	return server_cmd_get_wait(server, cmd, len, now) == 0;
+}
+
 void irc_server_send_data(IRC_SERVER_REC *server, const char *data, int len)
 {
 	if (net_sendbuffer_send(server->handle, data, len) == -1) {
@@ -385,93 +454,89 @@ void irc_server_send_data(IRC_SERVER_REC *server, const char *data, int len)
 	}
 
 	g_get_current_time(&server->last_cmd);
-
-	/* A bit kludgy way to do the flood protection. In ircnet, there
-	   actually is 1sec / 100 bytes penalty, but we rather want to deal
-	   with the max. 1000 bytes input buffer problem. If we send more
-	   than that with the burst, we'll get excess flooded. */
-	if (len < 100 || server->cmd_queue_speed <= 10)
-		server->wait_cmd.tv_sec = 0;
-	else {
-		memcpy(&server->wait_cmd, &server->last_cmd, sizeof(GTimeVal));
-		server->wait_cmd.tv_sec += 2 + len/100;
+	server->cmds_sent++;
+
+	/* Token bucket flood protection, modelled after the ircd's penalty
+	   timer. Commands sent with irc_send_cmd_now() bypass the check,
+	   but they still use up the tokens, so the commands after them
+	   wait longer. */
+	if (server->cmd_queue_speed > 0) {
+		server_cmd_tokens_refill(server, &server->last_cmd);
+		server->cmd_tokens -= server_cmd_cost(server, data, len);
 	}
 }
 
-static int server_cmd_timeout(IRC_SERVER_REC *server, GTimeVal *now)
+static int server_cmd_timeout(IRC_SERVER_REC *server)
 {
-	REDIRECT_REC *redirect;
-        GSList *link;
-	long usecs;
+	IRC_CMD_REC *rec;
+	GTimeVal now;
+	long wait;
 	char *cmd;
 	int len;
 
-	if (!IS_IRC_SERVER(server))
-		return 0;
-
-	if (server->cmdcount == 0 && server->cmdqueue == NULL)
-		return 0;
+	server->cmd_tag = -1;
+	g_get_current_time(&now);
 
-	if (g_timeval_cmp(now, &server->wait_cmd) == -1)
-		return 1;
+	while (!server->connection_lost &&
+	       (rec = irc_cmdqueue_peek(server->cmdqueue)) != NULL) {
+		cmd = rec->cmd;
+		len = strlen(cmd);
+		if (!irc_server_cmd_can_send(server, cmd, len, &now))
+			break;
 
-	usecs = get_timeval_diff(now, &server->last_cmd);
-	if (usecs < server->cmd_queue_speed)
-		return 1;
+		irc_cmdqueue_pop(server->cmdqueue);
+		server->cmdcount--;
 
-	server->cmdcount--;
-	if (server->cmdqueue == NULL) return 1;
+		wait = get_timeval_diff(&now, &rec->queued);
+		server->cmd_wait_total += wait;
+		if (wait > server->cmd_wait_max)
+			server->cmd_wait_max = wait;
 
-        /* get command */
-	cmd = server->cmdqueue->data;
-        redirect = server->cmdqueue->next->data;
+		/* send command */
+		irc_server_send_data(server, cmd, len);
 
-	/* send command */
-	len = strlen(cmd);
-	irc_server_send_data(server, cmd, len);
+		/* add to rawlog without [CR+]LF */
+		if (len > 2 && cmd[len-2] == '\r')
+			cmd[len-2] = '\0';
+		else if (cmd[len-1] == '\n')
+			cmd[len-1] = '\0';
+		rawlog_output(server->rawlog, cmd);
+		server_redirect_command(server, cmd, rec->redirect);
 
-	/* add to rawlog without [CR+]LF */
-        if (len > 2 && cmd[len-2] == '\r')
-		cmd[len-2] = '\0';
-        else if (cmd[len-1] == '\n')
-		cmd[len-1] = '\0';
-	rawlog_output(server->rawlog, cmd);
-	server_redirect_command(server, cmd, redirect);
+		irc_cmd_free(rec);
+	}
 
-	/* remove from queue */
-	server->cmdqueue = g_slist_remove(server->cmdqueue, cmd);
-	g_free(cmd);
+	/* send the commands that were let through together */
+	if (!server->connection_lost &&
+	    net_sendbuffer_flush(server->handle) == -1)
+		server->connection_lost = TRUE;
 
-        link = server->cmdqueue;
-	server->cmdqueue = g_slist_remove_link(server->cmdqueue, link);
-        g_slist_free_1(link);
-	return 1;
+	irc_server_start_cmd_timeout(server);
+	return 0;
 }
 
-/* check every now and then if there's data to be sent in command buffer */
-static int servers_cmd_timeout(void)
+void irc_server_start_cmd_timeout(IRC_SERVER_REC *server)
 {
+	IRC_CMD_REC *rec;
 	GTimeVal now;
-	GSList *tmp;
-	int keep = 0;
+	long wait;
 
-	g_get_current_time(&now);
-	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
-		keep |= server_cmd_timeout(tmp->data, &now);
-	}
-	if (keep)
-		return 1;
-	else {
-		cmd_tag = -1;
-		return 0;
+	g_return_if_fail(server != NULL);
+
+	if (server->cmd_tag != -1) {
+		g_source_remove(server->cmd_tag);
+		server->cmd_tag = -1;
 	}
-}
 
-/* Start the timeout for sending data later and decreasing cmdcount again */
-void irc_servers_start_cmd_timeout(void)
-{
-	if (cmd_tag == -1)
-		cmd_tag = g_timeout_add(500, (GSourceFunc) servers_cmd_timeout, NULL);
+	rec = irc_cmdqueue_peek(server->cmdqueue);
+	if (rec == NULL || server->connection_lost)
+		return;
+
+	g_get_current_time(&now);
+	wait = server_cmd_get_wait(server, rec->cmd, strlen(rec->cmd), &now);
+	server->cmd_tag = g_timeout_add(MAX(wait, 1),
+					(GSourceFunc) server_cmd_timeout,
+					server);
 }
 
 /* Return a string of all channels (and keys, if any have them) in server,
@@ -551,6 +616,7 @@ static void event_connected(IRC_SERVER_REC *server, const char *data, const char
 	/* let the queue send now that we are identified */
 	g_get_current_time(&now);
 	memcpy(&server->wait_cmd, &now, sizeof(GTimeVal));
+	irc_server_start_cmd_timeout(server);
 
 	if (server->connrec->usermode != NULL) {
 		/* Send the user mode, before the autosendcmd.
@@ -862,13 +928,47 @@ void irc_server_init_isupport(IRC_SERVER_REC *server)
 	}
 }
 
+static void read_settings(void)
+{
+	char **list, **tmp, *p;
+	int cost;
+
+	if (cmd_penalties != NULL)
+		g_hash_table_destroy(cmd_penalties);
+	cmd_penalties = g_hash_table_new_full((GHashFunc) g_str_hash,
+					      (GEqualFunc) g_str_equal,
+					      (GDestroyNotify) g_free, NULL);
+
+	/* "command:cost command:cost ..." */
+	list = g_strsplit(settings_get_str("cmd_queue_penalties"), " ", -1);
+	for (tmp = list; *tmp != NULL; tmp++) {
+		p = strchr(*tmp, ':');
+		if (p == NULL || p == *tmp)
+			continue;
+		*p++ = '\0';
+
+		cost = (int) (g_ascii_strtod(p, NULL) * CMD_TOKENS);
+		if (cost > 0) {
+			g_hash_table_insert(cmd_penalties, g_ascii_strup(*tmp, -1),
+					    GINT_TO_POINTER(cost));
+		}
+	}
+	g_strfreev(list);
+
+	cmd_byte_penalty = settings_get_time("cmd_queue_byte_penalty");
+}
+
 void irc_servers_init(void)
 {
 	settings_add_str("misc", "usermode", DEFAULT_USER_MODE);
 	settings_add_time("flood", "cmd_queue_speed", DEFAULT_CMD_QUEUE_SPEED);
 	settings_add_int("flood", "cmds_max_at_once", DEFAULT_CMDS_MAX_AT_ONCE);
+	settings_add_str("flood", "cmd_queue_penalties", DEFAULT_CMD_QUEUE_PENALTIES);
+	settings_add_time("flood", "cmd_queue_byte_penalty", DEFAULT_CMD_QUEUE_BYTE_PENALTY);
 
-	cmd_tag = -1;
+	cmd_penalties = NULL;
+	read_settings();
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 
 	signal_add_first("server connected", (SIGNAL_FUNC) sig_connected);
 	signal_add_last("server disconnected", (SIGNAL_FUNC) sig_disconnected);
@@ -894,8 +994,8 @@ void irc_servers_init(void)
 
 void irc_servers_deinit(void)
 {
-	if (cmd_tag != -1)
-		g_source_remove(cmd_tag);
+	g_hash_table_destroy(cmd_penalties);
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 
 	signal_remove("server connected", (SIGNAL_FUNC) sig_connected);
 	signal_remove("server disconnected", (SIGNAL_FUNC) sig_disconnected);
@@ -70,19 +70,34 @@ struct _IRC_SERVER_REC {
 	int max_msgs_in_cmd; /* max. number of targets in one /MSG */
 
 	/* Command sending queue */
-	int cmdcount; /* number of commands in `cmdqueue'. Can be more than
-	                 there actually is, to make flood control remember
-			 how many messages can be sent before starting the
-			 flood control */
-	GSList *cmdqueue; /* command, redirection, ... */
+	int cmdcount; /* number of commands in `cmdqueue' */
+	IRC_CMDQUEUE_REC *cmdqueue; /* see irc-cmdqueue.h */
 	GTimeVal wait_cmd; /* don't send anything to server before this */
 	GTimeVal last_cmd; /* last time command was sent to server */
+	int cmd_tag; /* timeout for sending the next queued command */
+
+	/* flood control token bucket, one command costs 1000 tokens
+	   (more for commands with a penalty). Can go negative. */
+	int cmd_tokens;
+	GTimeVal cmd_tokens_time; /* when cmd_tokens were last refilled */
 
 	int max_cmds_at_once; /* How many messages can be sent immediately before timeouting starts */
-	int cmd_queue_speed; /* Timeout between sending commands */
+	int cmd_queue_speed; /* Time to get back tokens for one command */
+
+	unsigned long cmds_sent; /* commands sent to server */
+	unsigned long cmds_queued; /* commands that had to wait in queue */
+	unsigned long cmd_wait_total; /* msecs the queued commands waited */
+	long cmd_wait_max; /* longest msecs a command waited in queue */
+	int cmdqueue_max; /* most commands in queue at once */
 	int max_query_chans; /* when syncing, max. number of channels to
 				put in one MODE/WHO command */
 
+	/* Incoming data statistics */
+	unsigned long incoming_lines, incoming_bytes; /* total received */
+	int incoming_lines_sec, incoming_bytes_sec; /* rate during the last period */
+	time_t incoming_stat_time; /* when the current period started */
+	int incoming_stat_lines, incoming_stat_bytes; /* received during the current period */
+
 	GSList *idles; /* Idle queue - send these commands to server
 	                  if there's nothing else to do */
 
@@ -93,6 +108,7 @@ struct _IRC_SERVER_REC {
 
 	GHashTable *splits; /* For keeping track of netsplits */
 	GSList *split_servers; /* Servers that are currently in split */
+	time_t split_next_destroy; /* Earliest time a netsplit record expires */
 
 	GSList *rejoin_channels; /* try to join to these channels after a while -
 	                            channels go here if they're "temporarily unavailable"
@@ -122,7 +138,12 @@ void irc_server_send_away(IRC_SERVER_REC *server, const char *reason);
 void irc_server_send_data(IRC_SERVER_REC *server, const char *data, int len);
 void irc_server_init_isupport(IRC_SERVER_REC *server);
 
-void irc_servers_start_cmd_timeout(void);
+/* Returns TRUE if `cmd' (`len' bytes with CR+LF) can be sent to server
+   without exceeding the flood control */
+int irc_server_cmd_can_send(IRC_SERVER_REC *server, const char *cmd, int len,
+			    const GTimeVal *now);
+/* (Re)start the timeout for sending the next command in queue */
+void irc_server_start_cmd_timeout(IRC_SERVER_REC *server);
 
 void irc_servers_init(void);
 void irc_servers_deinit(void);
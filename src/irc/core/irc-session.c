@@ -25,6 +25,7 @@
 #include "misc.h"
 
 #include "irc-servers.h"
+#include "irc-cmdqueue.h"
 #include "irc-channels.h"
 #include "irc-nicklist.h"
 
@@ -35,28 +36,40 @@ static void session_isupport_foreach(char *key, char *value, struct _isupport_da
         config_node_set_str(data->config, data->node, key, value);
 }
 
+struct _session_send_data {
+	IRC_SERVER_REC *server;
+	int failed;
+};
+
+static void session_send_cmd(IRC_CMD_REC *rec,
+			     struct _session_send_data *data)
+{
+	if (rec->redirect == NULL && !data->failed) {
+		if (net_sendbuffer_send(data->server->handle, rec->cmd,
+					strlen(rec->cmd)) == -1)
+			data->failed = TRUE;
+	}
+}
+
 static void sig_session_save_server(IRC_SERVER_REC *server, CONFIG_REC *config,
 				    CONFIG_NODE *node)
 {
-        GSList *tmp;
 	CONFIG_NODE *isupport;
 	struct _isupport_data isupport_data;
+	struct _session_send_data send_data;
 
 	if (!IS_IRC_SERVER(server))
 		return;
 
         /* send all non-redirected commands to server immediately */
-	for (tmp = server->cmdqueue; tmp != NULL; tmp = tmp->next->next) {
-		const char *cmd = tmp->data;
-                void *redirect = tmp->next->data;
-
-		if (redirect == NULL) {
-			if (net_sendbuffer_send(server->handle, cmd,
-						strlen(cmd)) == -1)
-				break;
-		}
+	if (server->cmdqueue != NULL) {
+		send_data.server = server;
+		send_data.failed = FALSE;
+		irc_cmdqueue_foreach(server->cmdqueue,
+				     (IRC_CMD_FOREACH_FUNC) session_send_cmd,
+				     &send_data);
 	}
-        net_sendbuffer_flush(server->handle);
+        net_sendbuffer_flush_sync(server->handle);
 
 	config_node_set_str(config, node, "real_address", server->real_address);
 	config_node_set_str(config, node, "userhost", server->userhost);
@@ -24,20 +24,26 @@
 #include "net-sendbuffer.h"
 #include "rawlog.h"
 #include "misc.h"
+#include "settings.h"
+#include "commands.h"
 
 #include "irc-servers.h"
+#include "irc-cmdqueue.h"
 #include "irc-channels.h"
 #include "servers-redirect.h"
 
 char *current_server_event;
+IRC_MESSAGE_REC *current_server_message;
 static int signal_default_event;
 static int signal_server_event;
 static int signal_server_incoming;
 
+static int read_time_budget, read_size_budget;
+
 #ifdef BLOCKING_SOCKETS
 #  define MAX_SOCKET_READS 1
 #else
-#  define MAX_SOCKET_READS 5
+#  define MAX_SOCKET_READS 64
 #endif
 
 /* The core of the irc_send_cmd* functions. If `raw' is TRUE, the `cmd'
@@ -56,9 +62,6 @@ void irc_send_cmd_full(IRC_SERVER_REC *server, const char *cmd,
 		return;
 
 	len = strlen(cmd);
-	if (server->cmdcount == 0)
-		irc_servers_start_cmd_timeout();
-	server->cmdcount++;
 
 	if (!raw) {
 		/* check that we don't send any longer commands
@@ -87,17 +90,19 @@ void irc_send_cmd_full(IRC_SERVER_REC *server, const char *cmd,
 	} else {
 
 		/* add to queue */
-		if (immediate) {
-			server->cmdqueue = g_slist_prepend(server->cmdqueue,
-							   server->redirect_next);
-			server->cmdqueue = g_slist_prepend(server->cmdqueue,
-							   g_strdup(cmd));
-		} else {
-			server->cmdqueue = g_slist_append(server->cmdqueue,
-							  g_strdup(cmd));
-			server->cmdqueue = g_slist_append(server->cmdqueue,
-							  server->redirect_next);
-		}
+		if (server->cmdqueue == NULL)
+			server->cmdqueue = irc_cmdqueue_create();
+		irc_cmdqueue_add(server->cmdqueue, cmd,
+				 server->redirect_next, immediate,
+				 command_user_input);
+
+		server->cmds_queued++;
+		server->cmdcount++;
+		if (server->cmdcount > server->cmdqueue_max)
+			server->cmdqueue_max = server->cmdcount;
+
+		if (server->cmd_tag == -1 || immediate)
+			irc_server_start_cmd_timeout(server);
 	}
         server->redirect_next = NULL;
 }
@@ -109,9 +114,8 @@ void irc_send_cmd(IRC_SERVER_REC *server, const char *cmd)
 	int send_now;
 
         g_get_current_time(&now);
-	send_now = g_timeval_cmp(&now, &server->wait_cmd) >= 0 &&
-		(server->cmdcount < server->max_cmds_at_once ||
-		 server->cmd_queue_speed <= 0);
+	send_now = server->cmdcount == 0 &&
+		irc_server_cmd_can_send(server, cmd, strlen(cmd)+2, &now);
 
         irc_send_cmd_full(server, cmd, send_now, FALSE, FALSE);
 }
@@ -247,16 +251,11 @@ char *event_get_param(char **data)
 	return pos;
 }
 
-/* Get count parameters from data */
-char *event_get_params(const char *data, int count, ...)
+static char *event_get_params_va(const char *data, int count, va_list args)
 {
 	char **str, *tmp, *duprec, *datad;
 	gboolean rest;
-	va_list args;
-
-	g_return_val_if_fail(data != NULL, NULL);
 
-	va_start(args, count);
 	duprec = datad = g_strdup(data);
 
 	rest = count & PARAM_FLAG_GETREST;
@@ -272,40 +271,250 @@ char *event_get_params(const char *data, int count, ...)
 		}
 		if (str != NULL) *str = tmp;
 	}
-	va_end(args);
 
 	return duprec;
 }
 
+/* Get count parameters from data */
+char *event_get_params(const char *data, int count, ...)
+{
+	char *ret;
+	va_list args;
+
+	g_return_val_if_fail(data != NULL, NULL);
+
+	va_start(args, count);
+	ret = event_get_params_va(data, count, args);
+	va_end(args);
+
+	return ret;
+}
+
+/* Split the message parameters the same way as event_get_param() does */
+static void irc_message_split_params(IRC_MESSAGE_REC *msg)
+{
+	char *buf, *pos;
+	int len;
+
+	msg->params_split = TRUE;
+
+	len = strlen(msg->args);
+	buf = len < (int) sizeof(msg->static_buf) ?
+		msg->static_buf : g_malloc(len+1);
+	memcpy(buf, msg->args, len+1);
+	msg->params_buf = buf;
+
+	for (msg->params_count = 0; msg->params_count < IRC_MAX_PARAMS;
+	     msg->params_count++) {
+		if (*buf == '\0')
+			break;
+
+		pos = event_get_param(&buf);
+		msg->param_strs[msg->params_count] = pos;
+		msg->params[msg->params_count].offset =
+			(int) (pos - msg->params_buf);
+		msg->params[msg->params_count].len = strlen(pos);
+	}
+
+	msg->params_truncated = *buf != '\0';
+}
+
+/* Like event_get_params(), but doesn't allocate memory if `data' is the
+   arguments of the server event currently being handled - its parameters
+   were split already and are shared between all the handlers, so they
+   must not be modified. The return value may be NULL, free it with
+   g_free() anyway in case the parameters had to be copied. */
+char *event_get_params_shared(const char *data, int count, ...)
+{
+	IRC_MESSAGE_REC *msg;
+	char **str, *tmp, *ret;
+	int i, rest;
+	va_list args;
+
+	g_return_val_if_fail(data != NULL, NULL);
+
+	msg = current_server_message;
+	if (msg != NULL && msg->args == data && !msg->params_split)
+		irc_message_split_params(msg);
+
+	va_start(args, count);
+	rest = count & PARAM_FLAG_GETREST;
+	count = PARAM_WITHOUT_FLAGS(count);
+
+	if (msg == NULL || msg->args != data ||
+	    (count > msg->params_count && msg->params_truncated)) {
+		/* not the current message, or the parameters
+		   didn't fit to it */
+		ret = event_get_params_va(data, rest | count, args);
+	} else {
+		for (i = 0; i < count; i++) {
+			str = (char **) va_arg(args, char **);
+			if (i >= msg->params_count)
+				tmp = "";
+			else if (i == count-1 && rest) {
+				/* put the rest to last parameter */
+				tmp = (char *) msg->args +
+					msg->params[i].offset;
+			} else {
+				tmp = msg->param_strs[i];
+			}
+			if (str != NULL) *str = tmp;
+		}
+		ret = NULL;
+	}
+	va_end(args);
+
+	return ret;
+}
+
+/* numeric replies are looked up directly from this table,
+   other commands from the hash table. a server could send any number of
+   different commands, so only this many of them are kept. */
+#define MAX_NAMED_EVENTS 500
+
+static IRC_EVENT_REC *numeric_events[1000];
+static GHashTable *named_events;
+
+static IRC_EVENT_REC *irc_event_create(const char *cmd, int numeric)
+{
+	IRC_EVENT_REC *rec;
+
+	rec = g_new0(IRC_EVENT_REC, 1);
+	rec->numeric = numeric;
+	rec->name = g_strconcat("event ", cmd, NULL);
+	rec->signal = signal_get_uniq_id(rec->name);
+	return rec;
+}
+
+/* Return the event for the command in the beginning of `line'. */
+IRC_EVENT_REC *irc_event_lookup(const char *line)
+{
+	IRC_EVENT_REC *rec;
+	char cmdbuf[64], *cmd;
+	int len, numeric;
+
+	g_return_val_if_fail(line != NULL, NULL);
+
+	for (len = 0; line[len] != '\0' && line[len] != ' '; len++) ;
+
+	if (len == 3 && i_isdigit(line[0]) &&
+	    i_isdigit(line[1]) && i_isdigit(line[2])) {
+		numeric = (line[0]-'0')*100 + (line[1]-'0')*10 + (line[2]-'0');
+		if (numeric_events[numeric] == NULL) {
+			memcpy(cmdbuf, line, 3); cmdbuf[3] = '\0';
+			numeric_events[numeric] =
+				irc_event_create(cmdbuf, numeric);
+		}
+		return numeric_events[numeric];
+	}
+
+	/* commands are short, don't allocate memory for the lookup */
+	cmd = len < (int) sizeof(cmdbuf) ? cmdbuf : g_malloc(len+1);
+	memcpy(cmd, line, len); cmd[len] = '\0';
+	ascii_strdown(cmd);
+
+	rec = g_hash_table_lookup(named_events, cmd);
+	if (rec == NULL) {
+		rec = irc_event_create(cmd, -1);
+		if (g_hash_table_size(named_events) < MAX_NAMED_EVENTS)
+			g_hash_table_insert(named_events, rec->name+6, rec);
+		else
+			rec->temp = TRUE;
+	}
+
+	if (cmd != cmdbuf) g_free(cmd);
+	return rec;
+}
+
+/* Return the arguments after the command in `line' */
+const char *irc_event_get_args(const char *line)
+{
+	g_return_val_if_fail(line != NULL, NULL);
+
+	while (*line != '\0' && *line != ' ') line++;
+	while (*line == ' ') line++;
+	return line;
+}
+
+static void irc_event_free(IRC_EVENT_REC *rec)
+{
+	g_free(rec->name);
+	g_free(rec);
+}
+
+void irc_event_release(IRC_EVENT_REC *rec)
+{
+	if (rec != NULL && rec->temp)
+		irc_event_free(rec);
+}
+
+static void irc_event_free_hash(void *key, IRC_EVENT_REC *rec)
+{
+	irc_event_free(rec);
+}
+
+static void irc_events_deinit(void)
+{
+	int i;
+
+	for (i = 0; i < (int) G_N_ELEMENTS(numeric_events); i++) {
+		if (numeric_events[i] != NULL) {
+			irc_event_free(numeric_events[i]);
+			numeric_events[i] = NULL;
+		}
+	}
+
+	g_hash_table_foreach(named_events, (GHFunc) irc_event_free_hash, NULL);
+	g_hash_table_destroy(named_events);
+}
+
+static void irc_message_deinit(IRC_MESSAGE_REC *msg)
+{
+	if (msg->params_buf != msg->static_buf)
+		g_free(msg->params_buf);
+	irc_event_release(msg->event);
+}
+
 static void irc_server_event(IRC_SERVER_REC *server, const char *line,
-			     const char *nick, const char *address)
+			     const char *nick, const char *address,
+			     IRC_MESSAGE_REC *msg)
 {
-        const char *signal;
-	char *event, *args;
+	IRC_MESSAGE_REC tmpmsg, *prev_message;
+        const char *signal, *args;
+	IRC_EVENT_REC *event;
 
 	g_return_if_fail(line != NULL);
 
-	/* split event / args */
-	event = g_strconcat("event ", line, NULL);
-	args = strchr(event+6, ' ');
-	if (args != NULL) *args++ = '\0'; else args = "";
-	while (*args == ' ') args++;
-	ascii_strdown(event);
+	if (msg == NULL || msg->event == NULL) {
+		/* emitted by someone else than us, parse it now */
+		memset(&tmpmsg, 0, sizeof(tmpmsg));
+		tmpmsg.nick = nick;
+		tmpmsg.address = address;
+		tmpmsg.event = irc_event_lookup(line);
+		tmpmsg.args = irc_event_get_args(line);
+		msg = &tmpmsg;
+	}
+	event = msg->event;
+	args = msg->args;
 
         /* check if event needs to be redirected */
-	signal = server_redirect_get_signal(server, nick, event, args);
-	if (signal == NULL)
-		signal = event;
-        else
+	signal = server_redirect_get_signal(server, nick, event->name, args);
+	if (signal != NULL)
 		rawlog_redirect(server->rawlog, signal);
 
         /* emit it */
-	current_server_event = event+6;
-	if (!signal_emit(signal, 4, server, args, nick, address))
+	prev_message = current_server_message;
+	current_server_message = msg;
+	current_server_event = event->name+6;
+	if (signal != NULL ?
+	    !signal_emit(signal, 4, server, args, nick, address) :
+	    !signal_emit_id(event->signal, 4, server, args, nick, address))
 		signal_emit_id(signal_default_event, 4, server, line, nick, address);
 	current_server_event = NULL;
+	current_server_message = prev_message;
 
-	g_free(event);
+	if (msg == &tmpmsg)
+		irc_message_deinit(&tmpmsg);
 }
 
 static char *irc_parse_prefix(char *line, char **nick, char **address)
@@ -345,52 +554,175 @@ static char *irc_parse_prefix(char *line, char **nick, char **address)
 	return line;
 }
 
+/* Parse IRCv3 tags and the prefix from the beginning of `line', and
+   return the rest. */
+static char *irc_message_parse(IRC_MESSAGE_REC *msg, char *line)
+{
+	char *nick, *address;
+
+	memset(msg, 0, sizeof(IRC_MESSAGE_REC));
+
+	if (*line == '@') {
+		/* @tag1=value;tag2 SPACE */
+		msg->tags = ++line;
+		while (*line != '\0' && *line != ' ') line++;
+		if (*line == ' ') {
+			*line++ = '\0';
+			while (*line == ' ') line++;
+		}
+	}
+
+	line = irc_parse_prefix(line, &nick, &address);
+	msg->nick = nick;
+	msg->address = address;
+	if (address != NULL) {
+		msg->host = strchr(address, '@');
+		if (msg->host != NULL) msg->host++;
+	}
+
+	if (*line != '\0') {
+		msg->event = irc_event_lookup(line);
+		msg->args = irc_event_get_args(line);
+	}
+	return line;
+}
+
 /* Parse command line sent by server */
 static void irc_parse_incoming_line(IRC_SERVER_REC *server, char *line)
 {
-	char *nick, *address;
+	IRC_MESSAGE_REC msg;
 
 	g_return_if_fail(server != NULL);
 	g_return_if_fail(line != NULL);
 
-	line = irc_parse_prefix(line, &nick, &address);
-	if (*line != '\0')
-		signal_emit_id(signal_server_event, 4, server, line, nick, address);
+	line = irc_message_parse(&msg, line);
+	if (*line != '\0') {
+		/* the parsed message is passed as an extra parameter
+		   that isn't visible to perl */
+		signal_emit_id(signal_server_event, 5, server, line,
+			       msg.nick, msg.address, &msg);
+	}
+	irc_message_deinit(&msg);
 }
 
-/* input function: handle incoming server messages */
-static void irc_parse_incoming(SERVER_REC *server)
+void irc_server_incoming_stats(IRC_SERVER_REC *server, int lines, int bytes)
 {
-	char *str;
-	int count;
-	int ret;
+	time_t now;
+	int secs;
 
 	g_return_if_fail(server != NULL);
 
-	/* Some commands can send huge replies and irssi might handle them
-	   too slowly, so read only a few times from the socket before
-	   letting other tasks to run. */
-	count = 0;
+	server->incoming_lines += lines;
+	server->incoming_bytes += bytes;
+
+	now = time(NULL);
+	if (server->incoming_stat_time == 0)
+		server->incoming_stat_time = now;
+
+	secs = (int) (now - server->incoming_stat_time);
+	if (secs > 0) {
+		/* period is over, calculate the rate for it */
+		server->incoming_lines_sec = server->incoming_stat_lines / secs;
+		server->incoming_bytes_sec = server->incoming_stat_bytes / secs;
+		server->incoming_stat_lines = 0;
+		server->incoming_stat_bytes = 0;
+		server->incoming_stat_time = now;
+	}
+
+	server->incoming_stat_lines += lines;
+	server->incoming_stat_bytes += bytes;
+}
+
+void irc_server_get_incoming_rates(IRC_SERVER_REC *server,
+				   int *lines_sec, int *bytes_sec)
+{
+	int secs;
+
+	g_return_if_fail(server != NULL);
+
+	/* if the current period is already over, its rate is what the
+	   next update would calculate */
+	secs = server->incoming_stat_time == 0 ? 0 :
+		(int) (time(NULL) - server->incoming_stat_time);
+	if (secs > 0) {
+		*lines_sec = server->incoming_stat_lines / secs;
+		*bytes_sec = server->incoming_stat_bytes / secs;
+	} else {
+		*lines_sec = server->incoming_lines_sec;
+		*bytes_sec = server->incoming_bytes_sec;
+	}
+}
+
+/* Handle all the complete lines that have already been received, and
+   read more from socket as long as the read budget for this call isn't
+   used up. */
+static void irc_parse_incoming_batch(SERVER_REC *server)
+{
+	GTimeVal start, now;
+	char *str;
+	int reads, lines, bytes;
+	int ret;
+
+	g_get_current_time(&start);
+	reads = lines = bytes = 0;
 	ret = 0;
+
 	server_ref(server);
-	while (!server->disconnected &&
-	       (ret = net_sendbuffer_receive_line(server->handle, &str, count < MAX_SOCKET_READS)) > 0) {
+	while (!server->disconnected) {
+		ret = net_sendbuffer_receive_line(server->handle, &str, FALSE);
+		if (ret == 0) {
+			/* buffer is empty, see if we can still afford to
+			   read more before letting other tasks to run */
+			g_get_current_time(&now);
+			if (reads >= MAX_SOCKET_READS ||
+			    bytes >= read_size_budget ||
+			    get_timeval_diff(&now, &start) >= read_time_budget)
+				break;
+
+			ret = net_sendbuffer_receive_line(server->handle,
+							  &str, TRUE);
+			reads++;
+		}
+		if (ret <= 0)
+			break;
+
+		lines++;
+		bytes += strlen(str)+2;
+
 		rawlog_input(server->rawlog, str);
 		signal_emit_id(signal_server_incoming, 2, server, str);
 
 		if (server->connection_lost)
 			server_disconnect(server);
-
-		count++;
 	}
+
+	if (IS_IRC_SERVER(server) && lines > 0)
+		irc_server_incoming_stats(IRC_SERVER(server), lines, bytes);
+
 	if (ret == -1) {
 		/* connection lost */
 		server->connection_lost = TRUE;
 		server_disconnect(server);
 	}
+
+	/* send the replies and what was passed on to the proxy clients
+	   while handling this batch */
+	net_sendbuffer_flush_all();
 	server_unref(server);
 }
 
+/* input function: handle incoming server messages */
+static void irc_parse_incoming(SERVER_REC *server)
+{
+	g_return_if_fail(server != NULL);
+
+	/* Some commands can send huge replies and irssi might handle them
+	   too slowly, so read from the socket only until the time or size
+	   budget is used, but always handle every line already read
+	   before letting other tasks to run. */
+	irc_parse_incoming_batch(server);
+}
+
 static void irc_init_server(IRC_SERVER_REC *server)
 {
 	g_return_if_fail(server != NULL);
@@ -404,13 +736,30 @@ static void irc_init_server(IRC_SERVER_REC *server)
 			    (GInputFunction) irc_parse_incoming, server);
 }
 
+static void read_settings(void)
+{
+	read_time_budget = settings_get_time("server_read_time_budget");
+	read_size_budget = settings_get_size("server_read_size_budget");
+	if (read_size_budget <= 0)
+		read_size_budget = READ_BUFFER_SIZE;
+}
+
 void irc_irc_init(void)
 {
+	settings_add_time("server", "server_read_time_budget", "50msecs");
+	settings_add_size("server", "server_read_size_budget", "256k");
+
+	read_settings();
+	named_events = g_hash_table_new((GHashFunc) g_str_hash,
+					(GCompareFunc) g_str_equal);
+
 	signal_add("server event", (SIGNAL_FUNC) irc_server_event);
 	signal_add("server connected", (SIGNAL_FUNC) irc_init_server);
 	signal_add("server incoming", (SIGNAL_FUNC) irc_parse_incoming_line);
+	signal_add("setup changed", (SIGNAL_FUNC) read_settings);
 
 	current_server_event = NULL;
+	current_server_message = NULL;
 	signal_default_event = signal_get_uniq_id("default event");
 	signal_server_event = signal_get_uniq_id("server event");
 	signal_server_incoming = signal_get_uniq_id("server incoming");
@@ -421,4 +770,7 @@ void irc_irc_deinit(void)
 	signal_remove("server event", (SIGNAL_FUNC) irc_server_event);
 	signal_remove("server connected", (SIGNAL_FUNC) irc_init_server);
 	signal_remove("server incoming", (SIGNAL_FUNC) irc_parse_incoming_line);
+	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
+
+	irc_events_deinit();
 }
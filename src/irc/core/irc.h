@@ -6,6 +6,7 @@ typedef struct _IRC_SERVER_CONNECT_REC IRC_SERVER_CONNECT_REC;
 typedef struct _IRC_SERVER_REC IRC_SERVER_REC;
 typedef struct _IRC_CHANNEL_REC IRC_CHANNEL_REC;
 typedef struct _REDIRECT_REC REDIRECT_REC;
+typedef struct _IRC_CMDQUEUE_REC IRC_CMDQUEUE_REC;
 
 /* From ircd 2.9.5:
      none    I line with ident
@@ -31,7 +32,44 @@ typedef struct _REDIRECT_REC REDIRECT_REC;
 #define IS_IRC_ITEM(rec) (IS_IRC_CHANNEL(rec) || IS_IRC_QUERY(rec))
 #define IRC_PROTOCOL (chat_protocol_lookup("IRC"))
 
+/* IRC command of an incoming server event. These are created once for
+   each command and kept in memory, so "server event" handlers can use
+   them without parsing the command again. */
+typedef struct {
+	int signal; /* ID of the "event <command>" signal */
+	int numeric; /* numeric reply, or -1 if the command is a name */
+	char *name; /* "event <command>" in lowercase */
+	unsigned int temp:1; /* not cached, free with irc_event_release() */
+} IRC_EVENT_REC;
+
+#define IRC_MAX_PARAMS 15
+
+/* Incoming server line, parsed once when it's received */
+typedef struct {
+	char *tags; /* IRCv3 message tags without the leading '@', or NULL */
+	const char *nick; /* sender nick/server, or NULL */
+	const char *address; /* sender user@host, or NULL */
+	const char *host; /* host part of the address, or NULL */
+
+	IRC_EVENT_REC *event;
+	const char *args; /* everything after the command */
+
+	/* parameters as slices of args. these are split only when
+	   someone first asks for them with event_get_params_shared() */
+	int params_count;
+	struct {
+		int offset, len;
+	} params[IRC_MAX_PARAMS];
+	char *param_strs[IRC_MAX_PARAMS]; /* NUL-terminated copies */
+	unsigned int params_split:1;
+	unsigned int params_truncated:1; /* more than IRC_MAX_PARAMS params */
+
+	char *params_buf;
+	char static_buf[512];
+} IRC_MESSAGE_REC;
+
 extern char *current_server_event; /* current server event being processed */
+extern IRC_MESSAGE_REC *current_server_message; /* message of the current server event */
 
 /* Send command to IRC server */
 void irc_send_cmd(IRC_SERVER_REC *server, const char *cmd);
@@ -54,10 +92,31 @@ void irc_send_cmd_first(IRC_SERVER_REC *server, const char *cmd);
 void irc_send_cmd_full(IRC_SERVER_REC *server, const char *cmd,
 		       int send_now, int immediate, int raw);
 
+/* Add received lines and bytes to the server's incoming statistics. */
+void irc_server_incoming_stats(IRC_SERVER_REC *server, int lines, int bytes);
+/* Get the incoming lines and bytes per second without changing the
+   statistics. Unlike incoming_*_sec, these drop to zero when nothing has
+   been received for a while. */
+void irc_server_get_incoming_rates(IRC_SERVER_REC *server,
+				   int *lines_sec, int *bytes_sec);
+
+/* Return the event for the command in the beginning of `line'. Call
+   irc_event_release() for it once it's not needed anymore. */
+IRC_EVENT_REC *irc_event_lookup(const char *line);
+void irc_event_release(IRC_EVENT_REC *rec);
+/* Return the arguments after the command in `line' */
+const char *irc_event_get_args(const char *line);
+
 /* Get count parameters from data */
 #include "commands.h"
 char *event_get_param(char **data);
 char *event_get_params(const char *data, int count, ...);
+/* Like event_get_params(), but doesn't allocate memory if `data' is the
+   arguments of the server event currently being handled - its parameters
+   were split already and are shared between all the handlers, so they
+   must not be modified. The return value may be NULL, free it with
+   g_free() anyway in case the parameters had to be copied. */
+char *event_get_params_shared(const char *data, int count, ...);
 
 void irc_irc_init(void);
 void irc_irc_deinit(void);
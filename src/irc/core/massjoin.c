@@ -26,8 +26,9 @@
 #include "irc-channels.h"
 #include "irc-nicklist.h"
 
-static int massjoin_tag;
-static int massjoin_max_joins;
+static int massjoin_max_wait, massjoin_max_joins;
+
+static int sig_massjoin_timeout(IRC_CHANNEL_REC *channel);
 
 /* Massjoin support - really useful when trying to do things (like op/deop)
    to people after netjoins. It sends
@@ -38,7 +39,6 @@ static void event_join(IRC_SERVER_REC *server, const char *data,
 	char *params, *channel, *ptr;
 	IRC_CHANNEL_REC *chanrec;
 	NICK_REC *nickrec;
-	GSList *nicks, *tmp;
 
 	g_return_if_fail(data != NULL);
 
@@ -64,35 +64,11 @@ static void event_join(IRC_SERVER_REC *server, const char *data,
 		nicklist_remove(CHANNEL(chanrec), nickrec);
 	}
 
-	/* add user to nicklist */
+	/* add user to nicklist, sig_nicklist_new() queues it for massjoin.
+	   If the user is in some other channel already, the realname and
+	   other stuff are known from there. */
 	nickrec = irc_nicklist_insert(chanrec, nick, FALSE, FALSE, FALSE, TRUE, NULL);
         nicklist_set_host(CHANNEL(chanrec), nickrec, address);
-
-	if (chanrec->massjoins == 0) {
-		/* no nicks waiting in massjoin queue */
-		chanrec->massjoin_start = time(NULL);
-		chanrec->last_massjoins = 0;
-	}
-
-	if (nickrec->realname == NULL) {
-		/* Check if user is already in some other channel,
-		   get the realname and other stuff from there */
-		nicks = nicklist_get_same(SERVER(server), nick);
-		for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
-			NICK_REC *rec = tmp->next->data;
-
-			if (rec->realname != NULL) {
-				nickrec->last_check = rec->last_check;
-				nickrec->realname = g_strdup(rec->realname);
-				nickrec->gone = rec->gone;
-				nickrec->serverop = rec->serverop;
-				break;
-			}
-		}
-		g_slist_free(nicks);
-	}
-
-	chanrec->massjoins++;
 }
 
 static void event_part(IRC_SERVER_REC *server, const char *data,
@@ -120,14 +96,8 @@ static void event_part(IRC_SERVER_REC *server, const char *data,
 
 	/* remove user from nicklist */
 	nickrec = nicklist_find(CHANNEL(chanrec), nick);
-	if (nickrec != NULL) {
-		if (nickrec->send_massjoin) {
-			/* quick join/part after which it's useless to send
-			   nick in massjoin */
-			chanrec->massjoins--;
-		}
+	if (nickrec != NULL)
 		nicklist_remove(CHANNEL(chanrec), nickrec);
-	}
 	g_free(params);
 }
 
@@ -151,11 +121,6 @@ static void event_quit(IRC_SERVER_REC *server, const char *data,
                 channel = tmp->data;
 		nickrec = tmp->next->data;
 
-		if (nickrec->send_massjoin) {
-			/* quick join/quit after which it's useless to
-			   send nick in massjoin */
-			channel->massjoins--;
-		}
 		nicklist_remove(CHANNEL(channel), nickrec);
 	}
 	g_slist_free(nicks);
@@ -182,93 +147,118 @@ static void event_kick(IRC_SERVER_REC *server, const char *data)
 	nickrec = chanrec == NULL ? NULL :
 		nicklist_find(CHANNEL(chanrec), nick);
 
-	if (chanrec != NULL && nickrec != NULL) {
-		if (nickrec->send_massjoin) {
-			/* quick join/kick after which it's useless to
-			   send nick in massjoin */
-			chanrec->massjoins--;
-		}
+	if (chanrec != NULL && nickrec != NULL)
 		nicklist_remove(CHANNEL(chanrec), nickrec);
-	}
 
 	g_free(params);
 }
 
-static void massjoin_send_hash(gpointer key, NICK_REC *nick, GSList **list)
+static void sig_nicklist_new(IRC_CHANNEL_REC *channel, NICK_REC *nick)
 {
-	if (nick->send_massjoin) {
-		nick->send_massjoin = FALSE;
-		*list = g_slist_append(*list, nick);
+	if (!IS_IRC_CHANNEL(channel) || !nick->send_massjoin)
+		return;
+
+	if (channel->massjoins == 0) {
+		/* no nicks waiting in massjoin queue */
+		channel->massjoin_start = time(NULL);
+		channel->last_massjoins = 0;
+	}
+
+	channel->massjoin_nicks = g_slist_prepend(channel->massjoin_nicks, nick);
+	channel->massjoins++;
+
+	if (channel->massjoin_tag == -1) {
+		channel->massjoin_tag =
+			g_timeout_add(1000, (GSourceFunc) sig_massjoin_timeout,
+				      channel);
 	}
 }
 
+static void sig_nicklist_remove(IRC_CHANNEL_REC *channel, NICK_REC *nick)
+{
+	if (!IS_IRC_CHANNEL(channel) || !nick->send_massjoin)
+		return;
+
+	/* quick join/part after which it's useless to send nick in
+	   massjoin */
+	channel->massjoin_nicks = g_slist_remove(channel->massjoin_nicks, nick);
+	channel->massjoins--;
+}
+
 /* Send channel's massjoin list signal */
 static void massjoin_send(IRC_CHANNEL_REC *channel)
 {
-	GSList *list;
-
-	list = NULL;
-	g_hash_table_foreach(channel->nicks, (GHFunc) massjoin_send_hash, &list);
+	GSList *list, *tmp;
 
+	list = g_slist_reverse(channel->massjoin_nicks);
+	channel->massjoin_nicks = NULL;
 	channel->massjoins = 0;
+
+	for (tmp = list; tmp != NULL; tmp = tmp->next) {
+		NICK_REC *nick = tmp->data;
+
+		nick->send_massjoin = FALSE;
+	}
+
 	signal_emit("massjoin", 2, channel, list);
 	g_slist_free(list);
 }
 
-static void server_check_massjoins(IRC_SERVER_REC *server, time_t max)
+/*
+   1) First time always save massjoin count to last_massjoins
+   2) Next time check if there's been less than massjoin_max_joins
+      (yes, the name is misleading..) joins since previous check.
+        yes) send a massjoin signal and reset last_massjoin count
+        no) unless we've waited for massjoin_max_wait seconds already,
+	    goto 2.
+
+   So, with single joins the massjoin signal is sent 1-2 seconds after
+   the join.
+*/
+static int sig_massjoin_timeout(IRC_CHANNEL_REC *channel)
 {
-	GSList *tmp;
-
-	/*
-	   1) First time always save massjoin count to last_massjoins
-	   2) Next time check if there's been less than massjoin_max_joins
-	      (yes, the name is misleading..) joins since previous check.
-	        yes) send a massjoin signal and reset last_massjoin count
-	        no) unless we've waited for massjoin_max_wait seconds already,
-		    goto 2.
-
-	   So, with single joins the massjoin signal is sent 1-2 seconds after
-	   the join.
-	*/
-
-	/* Scan all channels through for massjoins */
-	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
-		IRC_CHANNEL_REC *rec = tmp->data;
-
-		if (!IS_IRC_CHANNEL(rec) || rec->massjoins <= 0)
-			continue;
-
-		if (rec->massjoin_start < max || /* We've waited long enough */
-		    (rec->last_massjoins > 0 &&
-		     rec->massjoins-massjoin_max_joins < rec->last_massjoins)) { /* Less than x joins since last check */
-			/* send them */
-			massjoin_send(rec);
-		} else {
-			/* Wait for some more.. */
-			rec->last_massjoins = rec->massjoins;
-		}
+	if (channel->massjoins <= 0) {
+		/* everyone left already */
+		channel->massjoin_tag = -1;
+		return 0;
 	}
 
+	if (channel->massjoin_start < time(NULL)-massjoin_max_wait || /* We've waited long enough */
+	    (channel->last_massjoins > 0 &&
+	     channel->massjoins-massjoin_max_joins < channel->last_massjoins)) { /* Less than x joins since last check */
+		/* send them */
+		channel->massjoin_tag = -1;
+		massjoin_send(channel);
+		return 0;
+	}
+
+	/* Wait for some more.. */
+	channel->last_massjoins = channel->massjoins;
+	return 1;
 }
 
-static int sig_massjoin_timeout(void)
+static void sig_channel_created(IRC_CHANNEL_REC *channel)
 {
-	GSList *tmp;
-	time_t max;
+	if (IS_IRC_CHANNEL(channel))
+		channel->massjoin_tag = -1;
+}
 
-	max = time(NULL)-settings_get_int("massjoin_max_wait");
-	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
-		IRC_SERVER_REC *server = tmp->data;
+static void sig_channel_destroyed(IRC_CHANNEL_REC *channel)
+{
+	if (!IS_IRC_CHANNEL(channel))
+		return;
 
-                if (IS_IRC_SERVER(server))
-			server_check_massjoins(server, max);
+	if (channel->massjoin_tag != -1) {
+		g_source_remove(channel->massjoin_tag);
+		channel->massjoin_tag = -1;
 	}
-
-	return 1;
+	g_slist_free(channel->massjoin_nicks);
+	channel->massjoin_nicks = NULL;
 }
 
 static void read_settings(void)
 {
+	massjoin_max_wait = settings_get_int("massjoin_max_wait");
 	massjoin_max_joins = settings_get_int("massjoin_max_joins");
 }
 
@@ -276,9 +266,11 @@ void massjoin_init(void)
 {
         settings_add_int("misc", "massjoin_max_wait", 5000);
         settings_add_int("misc", "massjoin_max_joins", 3);
-	massjoin_tag = g_timeout_add(1000, (GSourceFunc) sig_massjoin_timeout, NULL);
-
 	read_settings();
+	signal_add_first("channel created", (SIGNAL_FUNC) sig_channel_created);
+	signal_add_first("channel destroyed", (SIGNAL_FUNC) sig_channel_destroyed);
+	signal_add("nicklist new", (SIGNAL_FUNC) sig_nicklist_new);
+	signal_add("nicklist remove", (SIGNAL_FUNC) sig_nicklist_remove);
 	signal_add_first("event join", (SIGNAL_FUNC) event_join);
 	signal_add("event part", (SIGNAL_FUNC) event_part);
 	signal_add("event kick", (SIGNAL_FUNC) event_kick);
@@ -288,8 +280,10 @@ void massjoin_init(void)
 
 void massjoin_deinit(void)
 {
-	g_source_remove(massjoin_tag);
-
+	signal_remove("channel created", (SIGNAL_FUNC) sig_channel_created);
+	signal_remove("channel destroyed", (SIGNAL_FUNC) sig_channel_destroyed);
+	signal_remove("nicklist new", (SIGNAL_FUNC) sig_nicklist_new);
+	signal_remove("nicklist remove", (SIGNAL_FUNC) sig_nicklist_remove);
 	signal_remove("event join", (SIGNAL_FUNC) event_join);
 	signal_remove("event part", (SIGNAL_FUNC) event_part);
 	signal_remove("event kick", (SIGNAL_FUNC) event_kick);
@@ -96,7 +96,7 @@ static NETSPLIT_REC *netsplit_add(IRC_SERVER_REC *server, const char *nick,
 	NETSPLIT_REC *rec;
 	NETSPLIT_CHAN_REC *splitchan;
 	NICK_REC *nickrec;
-	GSList *tmp;
+	GSList *nicks, *tmp;
 	char *p, *dupservers;
 
 	g_return_val_if_fail(IS_IRC_SERVER(server), NULL);
@@ -122,14 +122,16 @@ static NETSPLIT_REC *netsplit_add(IRC_SERVER_REC *server, const char *nick,
 	rec->server->count++;
 	g_free(dupservers);
 
+	if (server->split_next_destroy == 0 ||
+	    rec->destroy < server->split_next_destroy)
+		server->split_next_destroy = rec->destroy;
+
 	/* copy the channel nick records.. */
-	for (tmp = server->channels; tmp != NULL; tmp = tmp->next) {
+	nicks = nicklist_get_same(SERVER(server), nick);
+	for (tmp = nicks; tmp != NULL; tmp = tmp->next->next) {
 		CHANNEL_REC *channel = tmp->data;
 
-		nickrec = nicklist_find(channel, nick);
-		if (nickrec == NULL)
-			continue;
-
+		nickrec = tmp->next->data;
 		splitchan = g_new0(NETSPLIT_CHAN_REC, 1);
 		splitchan->name = g_strdup(channel->visible_name);
 		splitchan->op = nickrec->op;
@@ -139,6 +141,7 @@ static NETSPLIT_REC *netsplit_add(IRC_SERVER_REC *server, const char *nick,
 
 		rec->channels = g_slist_append(rec->channels, splitchan);
 	}
+	g_slist_free(nicks);
 
 	if (rec->channels == NULL)
 		g_warning("netsplit_add(): nick '%s' not in any channels", nick);
@@ -301,13 +304,14 @@ static void split_set_timeout(void *key, NETSPLIT_REC *rec, NETSPLIT_REC *orig)
 {
 	/* same servers -> split over -> destroy old records sooner.. */
 	if (rec->server == orig->server)
-		rec->destroy = time(NULL)+60;
+		rec->destroy = orig->server->last_rejoin+60;
 }
 
 static void event_join(IRC_SERVER_REC *server, const char *data,
 		       const char *nick, const char *address)
 {
 	NETSPLIT_REC *rec;
+	time_t now;
 
 	if (nick == NULL)
 		return;
@@ -321,9 +325,19 @@ static void event_join(IRC_SERVER_REC *server, const char *data,
 
 		   .. if the user just changed server, she can't use the
 		   same nick (unless the server is broken) so don't bother
-		   checking that the nick's server matches the split. */
-		g_hash_table_foreach(server->splits,
-				     (GHFunc) split_set_timeout, rec);
+		   checking that the nick's server matches the split.
+
+		   with a large netjoin, do it only every few seconds,
+		   not for each joining nick. */
+		now = time(NULL);
+		if (now - rec->server->last_rejoin >= 5) {
+			rec->server->last_rejoin = now;
+			g_hash_table_foreach(server->splits,
+					     (GHFunc) split_set_timeout, rec);
+			if (server->split_next_destroy == 0 ||
+			    server->split_next_destroy > now+60)
+				server->split_next_destroy = now+60;
+		}
 	}
 }
 
@@ -361,7 +375,7 @@ static void event_nick(IRC_SERVER_REC *server, const char *data)
 	NETSPLIT_REC *rec;
 	char *params, *nick;
 
-	params = event_get_params(data, 1, &nick);
+	params = event_get_params_shared(data, 1, &nick);
 
 	/* remove nick from split list when somebody changed
 	   nick to this one during split */
@@ -391,8 +405,12 @@ static int split_server_check(void *key, NETSPLIT_REC *rec,
 			      IRC_SERVER_REC *server)
 {
 	/* Check if this split record is too old.. */
-	if (rec->destroy > time(NULL))
+	if (rec->destroy > time(NULL)) {
+		if (server->split_next_destroy == 0 ||
+		    rec->destroy < server->split_next_destroy)
+			server->split_next_destroy = rec->destroy;
 		return FALSE;
+	}
 
 	netsplit_destroy(server, rec);
 	return TRUE;
@@ -405,9 +423,11 @@ static int split_check_old(void)
 	for (tmp = servers; tmp != NULL; tmp = tmp->next) {
 		IRC_SERVER_REC *server = tmp->data;
 
-		if (!IS_IRC_SERVER(server))
+		if (!IS_IRC_SERVER(server) || server->split_next_destroy == 0 ||
+		    server->split_next_destroy > time(NULL))
 			continue;
 
+		server->split_next_destroy = 0;
 		g_hash_table_foreach_remove(server->splits,
 					    (GHRFunc) split_server_check,
 					    server);
@@ -10,6 +10,7 @@ typedef struct {
         int prints; /* temp variable */
 
 	time_t last; /* last time we received a QUIT msg here */
+	time_t last_rejoin; /* last time the records' timeouts were shortened */
 } NETSPLIT_SERVER_REC;
 
 typedef struct {
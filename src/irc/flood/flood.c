@@ -33,56 +33,140 @@ void autoignore_init(void);
 void autoignore_deinit(void);
 
 typedef struct {
+	/* time of the latest message, the record expires
+	   flood_timecheck seconds after it */
+	time_t last;
+} FLOOD_TIMER_REC;
+
+typedef struct _FLOOD_REC FLOOD_REC;
+
+typedef struct {
+	FLOOD_TIMER_REC timer;
+	FLOOD_REC *flood;
+
 	char *target;
 	int level;
 
-	GSList *msgtimes;
+	/* ring buffer of the latest flood_max_msgs+1 message times */
+	time_t *msgtimes;
+	int size, count, pos;
 } FLOOD_ITEM_REC;
 
-typedef struct {
+struct _FLOOD_REC {
 	char *nick;
         GSList *items;
-} FLOOD_REC;
+};
+
+typedef struct {
+	char *nick, *host;
+	time_t time;
+} FLOOD_SENDER_REC;
+
+typedef struct {
+	FLOOD_TIMER_REC timer;
+
+	char *text;
+	GSList *senders; /* newest first */
+	unsigned int reported:1;
+} FLOOD_REPEAT_REC;
+
+typedef void (*FLOOD_EXPIRE_FUNC)(void *rec, MODULE_SERVER_REC *mserver);
 
 static int flood_tag;
-static int flood_max_msgs, flood_timecheck;
+static int flood_max_msgs, flood_timecheck, flood_max_repeats;
 
-static int flood_hash_check_remove(const char *key, FLOOD_REC *flood,
-				   time_t *now)
+static void flood_wheel_add(FLOOD_WHEEL_REC *wheel, FLOOD_TIMER_REC *timer)
 {
-	GSList *tmp, *next, *times, *tnext;
+	int slot;
 
-	g_return_val_if_fail(key != NULL, FALSE);
-	g_return_val_if_fail(flood != NULL, FALSE);
+	slot = (timer->last + flood_timecheck) % FLOOD_WHEEL_SLOTS;
+	wheel->slots[slot] = g_slist_prepend(wheel->slots[slot], timer);
+}
 
-	for (tmp = flood->items; tmp != NULL; tmp = next) {
-		FLOOD_ITEM_REC *rec = tmp->data;
+/* Go through the slots that have passed since the last run. Records that
+   got new messages in the meantime are moved to their new slot, the rest
+   are given to expire(). */
+static void flood_wheel_run(FLOOD_WHEEL_REC *wheel, time_t now,
+			    FLOOD_EXPIRE_FUNC expire,
+			    MODULE_SERVER_REC *mserver)
+{
+	GSList *list, *tmp;
+	time_t t;
+	int slot;
+
+	t = wheel->tick;
+	if (now - t > FLOOD_WHEEL_SLOTS)
+		t = now - FLOOD_WHEEL_SLOTS;
+
+	for (t++; t <= now; t++) {
+		slot = t % FLOOD_WHEEL_SLOTS;
+		list = wheel->slots[slot];
+		wheel->slots[slot] = NULL;
+
+		for (tmp = list; tmp != NULL; tmp = tmp->next) {
+			FLOOD_TIMER_REC *timer = tmp->data;
+
+			if (now - timer->last >= flood_timecheck)
+				expire(timer, mserver);
+			else
+				flood_wheel_add(wheel, timer);
+		}
+		g_slist_free(list);
+	}
+	wheel->tick = now;
+}
 
-		next = tmp->next;
-		/* remove old time entries for current rec item */
-		for (times = rec->msgtimes; times != NULL; times = tnext) {
-                        time_t *data = times->data;
-			tnext = times->next;
+static void flood_wheel_clear(FLOOD_WHEEL_REC *wheel,
+			      FLOOD_EXPIRE_FUNC expire,
+			      MODULE_SERVER_REC *mserver)
+{
+	int slot;
 
-			if (*now-*((time_t *) times->data) >= flood_timecheck) {
-				rec->msgtimes = g_slist_remove(rec->msgtimes, data);
-				g_free(data);
-			}
-		}
-		/* if no more time entries remove rec item */
-		if (rec->msgtimes == NULL) {
-			flood->items = g_slist_remove(flood->items, rec);
-			g_free(rec->target);
-			g_free(rec);
-		}
+	for (slot = 0; slot < FLOOD_WHEEL_SLOTS; slot++) {
+		g_slist_foreach(wheel->slots[slot], (GFunc) expire, mserver);
+		g_slist_free(wheel->slots[slot]);
+		wheel->slots[slot] = NULL;
 	}
+}
 
-	if (flood->items != NULL)
-		return FALSE;
+static void flood_item_destroy(FLOOD_ITEM_REC *rec, MODULE_SERVER_REC *mserver)
+{
+	FLOOD_REC *flood = rec->flood;
+
+	flood->items = g_slist_remove(flood->items, rec);
+	if (flood->items == NULL) {
+		g_hash_table_remove(mserver->floodlist, flood->nick);
+		g_free(flood->nick);
+		g_free(flood);
+	}
+
+	g_free(rec->msgtimes);
+	g_free(rec->target);
+	g_free(rec);
+}
+
+static void flood_senders_free(GSList *senders)
+{
+	GSList *tmp;
+
+	for (tmp = senders; tmp != NULL; tmp = tmp->next) {
+		FLOOD_SENDER_REC *rec = tmp->data;
+
+		g_free(rec->nick);
+		g_free(rec->host);
+		g_free(rec);
+	}
+	g_slist_free(senders);
+}
+
+static void flood_repeat_destroy(FLOOD_REPEAT_REC *rec,
+				 MODULE_SERVER_REC *mserver)
+{
+	g_hash_table_remove(mserver->repeatlist, rec->text);
 
-	g_free(flood->nick);
-	g_free(flood);
-	return TRUE;
+	flood_senders_free(rec->senders);
+	g_free(rec->text);
+	g_free(rec);
 }
 
 static int flood_timeout(void)
@@ -100,9 +184,10 @@ static int flood_timeout(void)
                         continue;
 
 		mserver = MODULE_DATA(rec);
-		g_hash_table_foreach_remove(mserver->floodlist,
-					    (GHRFunc) flood_hash_check_remove,
-					    &now);
+		flood_wheel_run(&mserver->items, now,
+				(FLOOD_EXPIRE_FUNC) flood_item_destroy, mserver);
+		flood_wheel_run(&mserver->repeats, now,
+				(FLOOD_EXPIRE_FUNC) flood_repeat_destroy, mserver);
 	}
 	return 1;
 }
@@ -120,25 +205,11 @@ static void flood_init_server(IRC_SERVER_REC *server)
 	rec = g_new0(MODULE_SERVER_REC, 1);
 	MODULE_DATA_SET(server, rec);
 
+	rec->items.tick = rec->repeats.tick = time(NULL);
 	rec->floodlist = g_hash_table_new((GHashFunc) g_istr_hash,
 					  (GCompareFunc) g_istr_equal);
-}
-
-static void flood_hash_destroy(const char *key, FLOOD_REC *flood)
-{
-	while (flood->items != NULL) {
-		FLOOD_ITEM_REC *rec = flood->items->data;
-
-		flood->items = g_slist_remove(flood->items, rec);
-
-		g_slist_foreach(rec->msgtimes, (GFunc) g_free, NULL);
-		g_slist_free(rec->msgtimes);
-		g_free(rec->target);
-		g_free(rec);
-	}
-
-	g_free(flood->nick);
-	g_free(flood);
+	rec->repeatlist = g_hash_table_new((GHashFunc) g_istr_hash,
+					   (GCompareFunc) g_istr_equal);
 }
 
 /* Deinitialize flood protection */
@@ -152,12 +223,13 @@ static void flood_deinit_server(IRC_SERVER_REC *server)
                 return;
 
 	mserver = MODULE_DATA(server);
-	if (mserver != NULL && mserver->floodlist != NULL) {
-		flood_timecheck = 0;
-
-		g_hash_table_foreach(mserver->floodlist,
-				     (GHFunc) flood_hash_destroy, NULL);
+	if (mserver != NULL) {
+		flood_wheel_clear(&mserver->items,
+				  (FLOOD_EXPIRE_FUNC) flood_item_destroy, mserver);
+		flood_wheel_clear(&mserver->repeats,
+				  (FLOOD_EXPIRE_FUNC) flood_repeat_destroy, mserver);
 		g_hash_table_destroy(mserver->floodlist);
+		g_hash_table_destroy(mserver->repeatlist);
 	}
 	g_free(mserver);
 	MODULE_DATA_UNSET(server);
@@ -179,61 +251,157 @@ static FLOOD_ITEM_REC *flood_find(FLOOD_REC *flood, int level,
 	return NULL;
 }
 
+/* Returns TRUE if there's now more than flood_max_msgs messages
+   within flood_timecheck seconds. */
+static int flood_item_add_time(FLOOD_ITEM_REC *rec, time_t now)
+{
+	int oldest;
+
+	if (rec->size != flood_max_msgs+1) {
+		/* flood_max_msgs changed, start over */
+		g_free(rec->msgtimes);
+		rec->size = flood_max_msgs+1;
+		rec->msgtimes = g_new(time_t, rec->size);
+		rec->count = rec->pos = 0;
+	}
+
+	rec->msgtimes[rec->pos] = now;
+	rec->pos = (rec->pos+1) % rec->size;
+	if (rec->count < rec->size)
+		rec->count++;
+
+	rec->timer.last = now;
+	if (rec->count < rec->size)
+		return FALSE;
+
+	/* the buffer is full, pos points to the oldest entry */
+	oldest = rec->pos;
+	return now - rec->msgtimes[oldest] < flood_timecheck;
+}
+
+/* Check for the same text sent by more than flood_max_repeats different
+   nicks within flood_timecheck seconds. All of them are flooding then. */
+static void flood_repeat_check(IRC_SERVER_REC *server, int level,
+			       const char *nick, const char *host,
+			       const char *target, const char *text,
+			       time_t now)
+{
+	MODULE_SERVER_REC *mserver;
+	FLOOD_REPEAT_REC *rec;
+	FLOOD_SENDER_REC *sender;
+	GSList *tmp, *prev;
+
+	mserver = MODULE_DATA(server);
+	rec = g_hash_table_lookup(mserver->repeatlist, text);
+	if (rec == NULL) {
+		rec = g_new0(FLOOD_REPEAT_REC, 1);
+		rec->text = g_strdup(text);
+		g_hash_table_insert(mserver->repeatlist, rec->text, rec);
+
+		rec->timer.last = now;
+		flood_wheel_add(&mserver->repeats, &rec->timer);
+	}
+	rec->timer.last = now;
+
+	/* drop the senders too old to count, the list is newest first */
+	for (tmp = rec->senders, prev = NULL; tmp != NULL;
+	     prev = tmp, tmp = tmp->next) {
+		sender = tmp->data;
+		if (now - sender->time >= flood_timecheck)
+			break;
+	}
+	if (tmp != NULL) {
+		if (prev == NULL)
+			rec->senders = NULL;
+		else
+			prev->next = NULL;
+		flood_senders_free(tmp);
+		rec->reported = FALSE;
+	}
+
+	/* move the sender to the front */
+	sender = NULL;
+	for (tmp = rec->senders; tmp != NULL; tmp = tmp->next) {
+		FLOOD_SENDER_REC *srec = tmp->data;
+
+		if (g_strcasecmp(srec->nick, nick) == 0) {
+			sender = srec;
+			rec->senders = g_slist_delete_link(rec->senders, tmp);
+			break;
+		}
+	}
+	if (sender == NULL) {
+		sender = g_new0(FLOOD_SENDER_REC, 1);
+		sender->nick = g_strdup(nick);
+		sender->host = g_strdup(host);
+	}
+	sender->time = now;
+	rec->senders = g_slist_prepend(rec->senders, sender);
+
+	/* flood_max_repeats+1 latest senders are enough to know */
+	tmp = g_slist_nth(rec->senders, flood_max_repeats);
+	if (tmp == NULL)
+		return;
+	flood_senders_free(tmp->next);
+	tmp->next = NULL;
+
+	/* flooding! the earlier senders are reported only once */
+	for (tmp = rec->senders; tmp != NULL; tmp = tmp->next) {
+		sender = tmp->data;
+		signal_emit("flood", 5, server, sender->nick, sender->host,
+			    GINT_TO_POINTER(level), target);
+		if (rec->reported)
+			break;
+	}
+	rec->reported = TRUE;
+}
+
 /* All messages should go through here.. */
 static void flood_newmsg(IRC_SERVER_REC *server, int level, const char *nick,
-			 const char *host, const char *target)
+			 const char *host, const char *target,
+			 const char *text)
 {
 	MODULE_SERVER_REC *mserver;
 	FLOOD_REC *flood;
 	FLOOD_ITEM_REC *rec;
-	time_t now, *ttime;
-	GSList *times, *tnext;
+	time_t now;
 
 	g_return_if_fail(server != NULL);
 	g_return_if_fail(nick != NULL);
 
+	now = time(NULL);
 	mserver = MODULE_DATA(server);
 	flood = g_hash_table_lookup(mserver->floodlist, nick);
 
 	rec = flood == NULL ? NULL : flood_find(flood, level, target);
-	if (rec != NULL) {
-		now = time(NULL);
-		for (times = rec->msgtimes; times != NULL; times = tnext) {
-			time_t *data = times->data;
-			tnext = times->next;
-
-			if (now - *data >= flood_timecheck) {
-				rec->msgtimes = g_slist_remove(rec->msgtimes, data);
-				g_free(data);
-			} else
-				break;
-		}
-		ttime = g_new(time_t, 1);
-		*ttime = now;
-		rec->msgtimes = g_slist_append(rec->msgtimes, ttime);
-		if (g_slist_length(rec->msgtimes) > flood_max_msgs) {
-			/* flooding! */
-			signal_emit("flood", 5, server, nick, host,
-				    GINT_TO_POINTER(rec->level), target);
+	if (rec == NULL) {
+		if (flood == NULL) {
+			flood = g_new0(FLOOD_REC, 1);
+			flood->nick = g_strdup(nick);
+			g_hash_table_insert(mserver->floodlist,
+					    flood->nick, flood);
 		}
-		return;
-	}
 
-	if (flood == NULL) {
-		flood = g_new0(FLOOD_REC, 1);
-		flood->nick = g_strdup(nick);
-		g_hash_table_insert(mserver->floodlist, flood->nick, flood);
+		rec = g_new0(FLOOD_ITEM_REC, 1);
+		rec->flood = flood;
+		rec->level = level;
+		rec->target = g_strdup(target);
+		flood->items = g_slist_append(flood->items, rec);
+
+		rec->timer.last = now;
+		flood_wheel_add(&mserver->items, &rec->timer);
 	}
 
-	rec = g_new0(FLOOD_ITEM_REC, 1);
-	rec->level = level;
-	rec->msgtimes = NULL;
-	ttime = g_new(time_t, 1);
-	*ttime = time(NULL);
-	rec->msgtimes = g_slist_append(rec->msgtimes, ttime);
-	rec->target = g_strdup(target);
+	if (flood_item_add_time(rec, now)) {
+		/* flooding! */
+		signal_emit("flood", 5, server, nick, host,
+			    GINT_TO_POINTER(rec->level), target);
+	}
 
-	flood->items = g_slist_append(flood->items, rec);
+	if (flood_max_repeats > 0 && text != NULL && *text != '\0') {
+		flood_repeat_check(server, level, nick, host, target,
+				   text, now);
+	}
 }
 
 static void flood_privmsg(IRC_SERVER_REC *server, const char *data,
@@ -248,11 +416,11 @@ static void flood_privmsg(IRC_SERVER_REC *server, const char *data,
 	if (addr == NULL || g_strcasecmp(nick, server->nick) == 0)
 		return;
 
-	params = event_get_params(data, 2, &target, &text);
+	params = event_get_params_shared(data, 2, &target, &text);
 
 	level = ischannel(*target) ? MSGLEVEL_PUBLIC : MSGLEVEL_MSGS;
 	if (addr != NULL && !ignore_check(SERVER(server), nick, addr, target, text, level))
-		flood_newmsg(server, level, nick, addr, target);
+		flood_newmsg(server, level, nick, addr, target, text);
 
 	g_free(params);
 }
@@ -268,9 +436,9 @@ static void flood_notice(IRC_SERVER_REC *server, const char *data,
 	if (addr == NULL || g_strcasecmp(nick, server->nick) == 0)
 		return;
 
-	params = event_get_params(data, 2, &target, &text);
+	params = event_get_params_shared(data, 2, &target, &text);
 	if (!ignore_check(SERVER(server), nick, addr, target, text, MSGLEVEL_NOTICES))
-		flood_newmsg(server, MSGLEVEL_NOTICES, nick, addr, target);
+		flood_newmsg(server, MSGLEVEL_NOTICES, nick, addr, target, text);
 
 	g_free(params);
 }
@@ -289,13 +457,14 @@ static void flood_ctcp(IRC_SERVER_REC *server, const char *data,
 	level = g_ascii_strncasecmp(data, "ACTION ", 7) != 0 ? MSGLEVEL_CTCPS :
 		(ischannel(*target) ? MSGLEVEL_PUBLIC : MSGLEVEL_MSGS);
 	if (!ignore_check(SERVER(server), nick, addr, target, data, level))
-		flood_newmsg(server, level, nick, addr, target);
+		flood_newmsg(server, level, nick, addr, target, data);
 }
 
 static void read_settings(void)
 {
 	flood_timecheck = settings_get_int("flood_timecheck");
 	flood_max_msgs = settings_get_int("flood_max_msgs");
+	flood_max_repeats = settings_get_int("flood_max_repeats");
 
 	if (flood_timecheck > 0 && flood_max_msgs > 0) {
 		if (flood_tag == -1) {
@@ -319,6 +488,7 @@ void irc_flood_init(void)
 {
 	settings_add_int("flood", "flood_timecheck", 8);
 	settings_add_int("flood", "flood_max_msgs", 4);
+	settings_add_int("flood", "flood_max_repeats", 0);
 
 	flood_tag = -1;
 	read_settings();
@@ -1,9 +1,19 @@
 #include "common.h"
 #include "irc.h"
 
+/* flood records are expired with a timer wheel of one second slots */
+#define FLOOD_WHEEL_SLOTS 64
+
+typedef struct {
+	GSList *slots[FLOOD_WHEEL_SLOTS];
+	time_t tick;
+} FLOOD_WHEEL_REC;
+
 typedef struct {
 	/* Flood protection */
-	GHashTable *floodlist;
+	GHashTable *floodlist; /* nick => FLOOD_REC */
+	GHashTable *repeatlist; /* text => FLOOD_REPEAT_REC */
+	FLOOD_WHEEL_REC items, repeats;
 
 	/* Auto ignore list */
 	GSList *ignorelist;
@@ -318,7 +318,8 @@ static void sig_channel_wholist(IRC_CHANNEL_REC *channel)
 	for (tmp = nicks; tmp != NULL; tmp = tmp->next) {
 		NICK_REC *rec = tmp->data;
 
-		notifylist_check_join(channel->server, rec->nick, rec->host, rec->realname, rec->gone);
+		notifylist_check_join(channel->server, rec->nick, rec->user->host,
+				      rec->user->realname, rec->user->gone);
 	}
         g_slist_free(nicks);
 }
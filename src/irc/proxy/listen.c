@@ -35,6 +35,7 @@ GSList *proxy_clients;
 
 static GString *next_line;
 static int ignore_next;
+static int signal_event_privmsg, signal_event_ping, signal_event_pong;
 
 static void remove_client(CLIENT_REC *rec)
 {
@@ -323,6 +324,9 @@ static void sig_listen_client(CLIENT_REC *client)
 
 		g_free(cmd);
 	}
+
+	/* send what the commands produced to the server and clients */
+	net_sendbuffer_flush_all();
 }
 
 static void sig_listen(LISTEN_REC *listen)
@@ -373,48 +377,34 @@ static void sig_incoming(IRC_SERVER_REC *server, const char *line)
 	g_string_printf(next_line, "%s\n", line);
 }
 
-static void sig_server_event(IRC_SERVER_REC *server, const char *line,
-			     const char *nick, const char *address)
+static void proxy_server_event(IRC_SERVER_REC *server, const char *nick,
+			       IRC_EVENT_REC *event, const char *args)
 {
 	GSList *tmp;
         void *client;
         const char *signal;
-	char *event, *args;
         int redirected;
 
-	g_return_if_fail(line != NULL);
-	if (!IS_IRC_SERVER(server))
-		return;
-
-	/* get command.. */
-	event = g_strconcat("event ", line, NULL);
-	args = strchr(event+6, ' ');
-	if (args != NULL) *args++ = '\0'; else args = "";
-	while (*args == ' ') args++;
-	ascii_strdown(event);
-
-	signal = server_redirect_peek_signal(server, nick, event, args, &redirected);
+	signal = server_redirect_peek_signal(server, nick, event->name, args, &redirected);
 	if ((signal != NULL && strncmp(signal, "proxy ", 6) != 0) ||
 	    (signal == NULL && redirected)) {
 		/* we want to send this to one client (or proxy itself) only */
 		/* proxy only */
-		g_free(event);
 		return;
 	}
 
 	if (signal != NULL) {
-                server_redirect_get_signal(server, nick, event, args);
+                server_redirect_get_signal(server, nick, event->name, args);
 		if (sscanf(signal+6, "%p", &client) == 1) {
 			/* send it to specific client only */
 			if (g_slist_find(proxy_clients, client) != NULL)
 				net_sendbuffer_send(((CLIENT_REC *) client)->handle, next_line->str, next_line->len);
-			g_free(event);
                         signal_stop();
 			return;
 		}
 	}
 
-        if (strcmp(event, "event privmsg") == 0 &&
+        if (event->signal == signal_event_privmsg &&
 	    strstr(args, " :\001") != NULL &&
 	    strstr(args, " :\001ACTION") == NULL) {
 		/* CTCP - either answer ourself or forward it to one client */
@@ -430,22 +420,39 @@ static void sig_server_event(IRC_SERVER_REC *server, const char *line,
 				}
 			}
 		}
-		g_free(event);
 		return;
 	}
 
-	if (strcmp(event, "event ping") == 0 ||
-	    strcmp(event, "event pong") == 0) {
+	if (event->signal == signal_event_ping ||
+	    event->signal == signal_event_pong) {
 		/* We want to answer ourself to PINGs and CTCPs.
 		   Also hide PONGs from clients. */
-		g_free(event);
 		return;
 	}
 
 	/* send the data to clients.. */
         proxy_outdata_all(server, "%s", next_line->str);
+}
 
-	g_free(event);
+static void sig_server_event(IRC_SERVER_REC *server, const char *line,
+			     const char *nick, const char *address,
+			     IRC_MESSAGE_REC *msg)
+{
+	IRC_EVENT_REC *event;
+
+	g_return_if_fail(line != NULL);
+	if (!IS_IRC_SERVER(server))
+		return;
+
+	/* get command.. */
+	if (msg != NULL && msg->event != NULL) {
+		proxy_server_event(server, nick, msg->event, msg->args);
+		return;
+	}
+
+	event = irc_event_lookup(line);
+	proxy_server_event(server, nick, event, irc_event_get_args(line));
+	irc_event_release(event);
 }
 
 static void event_connected(IRC_SERVER_REC *server)
@@ -681,6 +688,10 @@ void proxy_listen_init(void)
 	proxy_listens = NULL;
 	read_settings();
 
+	signal_event_privmsg = signal_get_uniq_id("event privmsg");
+	signal_event_ping = signal_get_uniq_id("event ping");
+	signal_event_pong = signal_get_uniq_id("event pong");
+
 	signal_add("server incoming", (SIGNAL_FUNC) sig_incoming);
 	signal_add("server event", (SIGNAL_FUNC) sig_server_event);
 	signal_add("event connected", (SIGNAL_FUNC) event_connected);
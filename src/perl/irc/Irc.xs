@@ -10,6 +10,8 @@ static void perl_irc_connect_fill_hash(HV *hv, IRC_SERVER_CONNECT_REC *conn)
 
 static void perl_irc_server_fill_hash(HV *hv, IRC_SERVER_REC *server)
 {
+	int lines_sec, bytes_sec;
+
        	perl_server_fill_hash(hv, (SERVER_REC *) server);
 
        	hv_store(hv, "real_address", 12, new_pv(server->real_address), 0);
@@ -25,6 +27,19 @@ static void perl_irc_server_fill_hash(HV *hv, IRC_SERVER_REC *server)
 	hv_store(hv, "max_modes_in_cmd", 16, newSViv(server->max_modes_in_cmd), 0);
 	hv_store(hv, "max_whois_in_cmd", 16, newSViv(server->max_whois_in_cmd), 0);
 	hv_store(hv, "isupport_sent", 13, newSViv(server->isupport_sent), 0);
+
+	irc_server_get_incoming_rates(server, &lines_sec, &bytes_sec);
+	hv_store(hv, "incoming_lines", 14, newSViv(server->incoming_lines), 0);
+	hv_store(hv, "incoming_bytes", 14, newSViv(server->incoming_bytes), 0);
+	hv_store(hv, "incoming_lines_sec", 18, newSViv(lines_sec), 0);
+	hv_store(hv, "incoming_bytes_sec", 18, newSViv(bytes_sec), 0);
+
+	hv_store(hv, "cmdqueue_length", 15, newSViv(server->cmdcount), 0);
+	hv_store(hv, "cmdqueue_max", 12, newSViv(server->cmdqueue_max), 0);
+	hv_store(hv, "cmds_sent", 9, newSViv(server->cmds_sent), 0);
+	hv_store(hv, "cmds_queued", 11, newSViv(server->cmds_queued), 0);
+	hv_store(hv, "cmd_wait_total", 14, newSViv(server->cmd_wait_total), 0);
+	hv_store(hv, "cmd_wait_max", 12, newSViv(server->cmd_wait_max), 0);
 }
 
 static void perl_ban_fill_hash(HV *hv, BAN_REC *ban)
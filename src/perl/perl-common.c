@@ -422,12 +422,12 @@ void perl_nick_fill_hash(HV *hv, NICK_REC *nick)
 	hv_store(hv, "chat_type", 9, new_pv(chat_type), 0);
 
 	hv_store(hv, "nick", 4, new_pv(nick->nick), 0);
-	hv_store(hv, "host", 4, new_pv(nick->host), 0);
-	hv_store(hv, "realname", 8, new_pv(nick->realname), 0);
-	hv_store(hv, "hops", 4, newSViv(nick->hops), 0);
+	hv_store(hv, "host", 4, new_pv(nick->user->host), 0);
+	hv_store(hv, "realname", 8, new_pv(nick->user->realname), 0);
+	hv_store(hv, "hops", 4, newSViv(nick->user->hops), 0);
 
-	hv_store(hv, "gone", 4, newSViv(nick->gone), 0);
-	hv_store(hv, "serverop", 8, newSViv(nick->serverop), 0);
+	hv_store(hv, "gone", 4, newSViv(nick->user->gone), 0);
+	hv_store(hv, "serverop", 8, newSViv(nick->user->serverop), 0);
 
 	hv_store(hv, "op", 2, newSViv(nick->op), 0);
 	hv_store(hv, "halfop", 6, newSViv(nick->halfop), 0);
@@ -435,7 +435,7 @@ void perl_nick_fill_hash(HV *hv, NICK_REC *nick)
 	hv_store(hv, "other", 5, newSViv(nick->prefixes[0]), 0);
 	hv_store(hv, "prefixes", 8, new_pv(nick->prefixes), 0);
 
-	hv_store(hv, "last_check", 10, newSViv(nick->last_check), 0);
+	hv_store(hv, "last_check", 10, newSViv(nick->user->last_check), 0);
 	hv_store(hv, "send_massjoin", 13, newSViv(nick->send_massjoin), 0);
 }
 